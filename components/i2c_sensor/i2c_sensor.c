@@ -0,0 +1,102 @@
+/*------------------------------------------------------------*-
+  I2C sensor - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Shared I2C bus helpers for the Sensirion probes
+ * (16-bit command words, data words protected by CRC-8).
+ * 
+ --------------------------------------------------------------*/
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+#include "i2c_sensor.h"
+
+// ------ Private constants -----------------------------------
+#define I2C_TIMEOUT_MS       (50)
+#define CRC8_POLYNOMIAL      (0x31)
+#define CRC8_INIT            (0xFF)
+#define MAX_WORDS            (9)
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+/** @brief tag used for ESP serial console messages */
+static const char *TAG = "i2c_sensor";
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+esp_err_t i2c_sensor_bus_init(i2c_port_t port, int sda_gpio, int scl_gpio, uint32_t clk_hz)
+{
+    i2c_config_t conf = {
+        .mode = I2C_MODE_MASTER,
+        .sda_io_num = sda_gpio,
+        .sda_pullup_en = GPIO_PULLUP_ENABLE,
+        .scl_io_num = scl_gpio,
+        .scl_pullup_en = GPIO_PULLUP_ENABLE,
+        .master.clk_speed = clk_hz,
+    };
+    esp_err_t err = i2c_param_config(port, &conf);
+    if (err == ESP_OK) err = i2c_driver_install(port, conf.mode, 0, 0, 0); //no slave buffers
+    if (err != ESP_OK) ESP_LOGE(TAG, "bus init failed: %s", esp_err_to_name(err));
+    return err;
+}
+
+uint8_t i2c_sensor_crc8(const uint8_t *data, uint8_t len)
+{
+    uint8_t crc = CRC8_INIT;
+    for (uint8_t i = 0; i < len; ++i)
+    {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc & 0x80) ? (crc << 1) ^ CRC8_POLYNOMIAL : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+esp_err_t i2c_sensor_write_cmd(i2c_port_t port, uint8_t address, uint16_t cmd)
+{
+    i2c_cmd_handle_t link = i2c_cmd_link_create();
+    i2c_master_start(link);
+    i2c_master_write_byte(link, (address << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_write_byte(link, cmd >> 8, true);
+    i2c_master_write_byte(link, cmd & 0xFF, true);
+    i2c_master_stop(link);
+    esp_err_t err = i2c_master_cmd_begin(port, link, I2C_TIMEOUT_MS / portTICK_PERIOD_MS);
+    i2c_cmd_link_delete(link);
+    if (err != ESP_OK) ESP_LOGD(TAG, "cmd 0x%04x to 0x%02x failed: %s", cmd, address, esp_err_to_name(err));
+    return err;
+}
+
+esp_err_t i2c_sensor_read_words(i2c_port_t port, uint8_t address, uint16_t *words, uint8_t num_words)
+{
+    uint8_t buf[MAX_WORDS * 3];
+    if (num_words == 0 || num_words > MAX_WORDS) return ESP_ERR_INVALID_ARG;
+
+    i2c_cmd_handle_t link = i2c_cmd_link_create();
+    i2c_master_start(link);
+    i2c_master_write_byte(link, (address << 1) | I2C_MASTER_READ, true);
+    i2c_master_read(link, buf, num_words * 3, I2C_MASTER_LAST_NACK);
+    i2c_master_stop(link);
+    esp_err_t err = i2c_master_cmd_begin(port, link, I2C_TIMEOUT_MS / portTICK_PERIOD_MS);
+    i2c_cmd_link_delete(link);
+    if (err != ESP_OK)
+    {
+        ESP_LOGD(TAG, "read from 0x%02x failed: %s", address, esp_err_to_name(err));
+        return err;
+    }
+
+    for (uint8_t i = 0; i < num_words; ++i)
+    {
+        const uint8_t *word = buf + i * 3;
+        if (i2c_sensor_crc8(word, 2) != word[2])
+        {
+            ESP_LOGE(TAG, "CRC failed on word %d from 0x%02x", i, address);
+            return ESP_ERR_INVALID_CRC;
+        }
+        words[i] = (word[0] << 8) | word[1];
+    }
+    return ESP_OK;
+}
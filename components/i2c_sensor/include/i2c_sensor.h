@@ -0,0 +1,55 @@
+/*------------------------------------------------------------*-
+  I2C sensor - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Shared I2C bus helpers for the Sensirion probes
+ * (16-bit command words, data words protected by CRC-8).
+ * 
+ --------------------------------------------------------------*/
+#ifndef __I2C_SENSOR_H
+#define __I2C_SENSOR_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/i2c.h"
+
+#include "sht3x.h"
+#include "scd4x.h"
+
+// ------ Public constants ------------------------------------
+// ------ Public function prototypes --------------------------
+/**
+ * @brief Install the I2C master driver on a port
+ * @param[in] port I2C port number
+ * @param[in] sda_gpio SDA pin
+ * @param[in] scl_gpio SCL pin
+ * @param[in] clk_hz bus clock, 100 kHz is safe for every supported sensor
+ */
+esp_err_t i2c_sensor_bus_init(i2c_port_t port, int sda_gpio, int scl_gpio, uint32_t clk_hz);
+/**
+ * @brief Send a 16-bit command word, MSB first
+ */
+esp_err_t i2c_sensor_write_cmd(i2c_port_t port, uint8_t address, uint16_t cmd);
+/**
+ * @brief Read data words, each followed by its CRC-8 byte
+ * @return ESP_ERR_INVALID_CRC if any word fails the check
+ */
+esp_err_t i2c_sensor_read_words(i2c_port_t port, uint8_t address, uint16_t *words, uint8_t num_words);
+/**
+ * @brief Sensirion CRC-8 (polynomial 0x31, init 0xFF) over a data word
+ */
+uint8_t i2c_sensor_crc8(const uint8_t *data, uint8_t len);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,61 @@
+/*------------------------------------------------------------*-
+  SCD4x CO2 sensor - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Sensirion SCD41 photoacoustic NDIR CO2 sensor,
+ * used in single shot mode (the SCD40 does not support it).
+ * 
+ --------------------------------------------------------------*/
+#ifndef __SCD4X_H
+#define __SCD4X_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/i2c.h"
+
+// ------ Public constants ------------------------------------
+#define SCD4X_I2C_ADDRESS        (0x62)
+#define SCD4X_MEASUREMENT_MS     (5000)  // duration of a single shot measurement
+
+/**
+ * @brief Structure containing information related to a single SCD4x device
+ */
+typedef struct
+{
+    bool init;           ///< True if the device answered during init
+    i2c_port_t port;     ///< I2C port the device is connected to
+    uint8_t address;     ///< 7-bit I2C address
+} SCD4X_Info;
+// ------ Public function prototypes --------------------------
+/**
+ * @brief Stop any periodic measurement left running and check the device is present
+ * @note blocks for 500 ms as required by the datasheet
+ */
+esp_err_t scd4x_init(SCD4X_Info *scd4x_info, i2c_port_t port, uint8_t address);
+/**
+ * @brief Start a single shot measurement
+ * @note result is available SCD4X_MEASUREMENT_MS later, the bus is free meanwhile
+ */
+esp_err_t scd4x_start_measurement(const SCD4X_Info *scd4x_info);
+/**
+ * @brief Read the result of the last measurement
+ * @param[out] co2 CO2 concentration in ppm
+ * @param[out] temperature degrees Celsius
+ * @param[out] humidity relative humidity in %
+ */
+esp_err_t scd4x_read_measurement(const SCD4X_Info *scd4x_info, uint16_t *co2, float *temperature, float *humidity);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,59 @@
+/*------------------------------------------------------------*-
+  SHT3x humidity sensor - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Sensirion SHT30/31/35 temperature and humidity sensor,
+ * used in single shot mode without clock stretching.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __SHT3X_H
+#define __SHT3X_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/i2c.h"
+
+// ------ Public constants ------------------------------------
+#define SHT3X_I2C_ADDRESS        (0x44)  // ADDR pin low, 0x45 when high
+#define SHT3X_MEASUREMENT_MS     (16)    // max duration of a high repeatability measurement
+
+/**
+ * @brief Structure containing information related to a single SHT3x device
+ */
+typedef struct
+{
+    bool init;           ///< True if the device answered during init
+    i2c_port_t port;     ///< I2C port the device is connected to
+    uint8_t address;     ///< 7-bit I2C address
+} SHT3X_Info;
+// ------ Public function prototypes --------------------------
+/**
+ * @brief Soft reset the device and check it is present
+ */
+esp_err_t sht3x_init(SHT3X_Info *sht3x_info, i2c_port_t port, uint8_t address);
+/**
+ * @brief Start a single shot, high repeatability measurement
+ * @note result is available SHT3X_MEASUREMENT_MS later
+ */
+esp_err_t sht3x_start_measurement(const SHT3X_Info *sht3x_info);
+/**
+ * @brief Read the result of the last measurement
+ * @param[out] temperature degrees Celsius
+ * @param[out] humidity relative humidity in %
+ */
+esp_err_t sht3x_read_measurement(const SHT3X_Info *sht3x_info, float *temperature, float *humidity);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,66 @@
+/*------------------------------------------------------------*-
+  SCD4x CO2 sensor - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Sensirion SCD41 photoacoustic NDIR CO2 sensor,
+ * used in single shot mode (the SCD40 does not support it).
+ * 
+ --------------------------------------------------------------*/
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "i2c_sensor.h"
+
+// ------ Private constants -----------------------------------
+#define SCD4X_CMD_STOP_PERIODIC     (0x3F86)
+#define SCD4X_CMD_SINGLE_SHOT       (0x219D)
+#define SCD4X_CMD_READ_MEASUREMENT  (0xEC05)
+#define SCD4X_STOP_MS               (500)
+#define SCD4X_CMD_MS                (1)     // execution time of the read command
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+/** @brief tag used for ESP serial console messages */
+static const char *TAG = "scd4x";
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+esp_err_t scd4x_init(SCD4X_Info *scd4x_info, i2c_port_t port, uint8_t address)
+{
+    if (scd4x_info == NULL) return ESP_ERR_INVALID_ARG;
+    scd4x_info->port = port;
+    scd4x_info->address = address;
+    esp_err_t err = i2c_sensor_write_cmd(port, address, SCD4X_CMD_STOP_PERIODIC);
+    scd4x_info->init = (err == ESP_OK);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "no device at 0x%02x", address);
+        return err;
+    }
+    vTaskDelay(SCD4X_STOP_MS / portTICK_PERIOD_MS);
+    return ESP_OK;
+}
+
+esp_err_t scd4x_start_measurement(const SCD4X_Info *scd4x_info)
+{
+    if (scd4x_info == NULL || !scd4x_info->init) return ESP_ERR_INVALID_STATE;
+    return i2c_sensor_write_cmd(scd4x_info->port, scd4x_info->address, SCD4X_CMD_SINGLE_SHOT);
+}
+
+esp_err_t scd4x_read_measurement(const SCD4X_Info *scd4x_info, uint16_t *co2, float *temperature, float *humidity)
+{
+    if (scd4x_info == NULL || !scd4x_info->init) return ESP_ERR_INVALID_STATE;
+    esp_err_t err = i2c_sensor_write_cmd(scd4x_info->port, scd4x_info->address, SCD4X_CMD_READ_MEASUREMENT);
+    if (err != ESP_OK) return err;
+    vTaskDelay(SCD4X_CMD_MS / portTICK_PERIOD_MS + 1);
+
+    uint16_t words[3];
+    err = i2c_sensor_read_words(scd4x_info->port, scd4x_info->address, words, 3);
+    if (err != ESP_OK) return err;
+    if (co2)         *co2 = words[0];
+    if (temperature) *temperature = -45.0f + 175.0f * words[1] / 65535.0f;
+    if (humidity)    *humidity = 100.0f * words[2] / 65535.0f;
+    return ESP_OK;
+}
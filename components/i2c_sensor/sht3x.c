@@ -0,0 +1,59 @@
+/*------------------------------------------------------------*-
+  SHT3x humidity sensor - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Sensirion SHT30/31/35 temperature and humidity sensor,
+ * used in single shot mode without clock stretching.
+ * 
+ --------------------------------------------------------------*/
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+
+#include "i2c_sensor.h"
+
+// ------ Private constants -----------------------------------
+#define SHT3X_CMD_SOFT_RESET        (0x30A2)
+#define SHT3X_CMD_SINGLE_SHOT_HIGH  (0x2400)  // high repeatability, clock stretching disabled
+#define SHT3X_RESET_MS              (2)
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+/** @brief tag used for ESP serial console messages */
+static const char *TAG = "sht3x";
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+esp_err_t sht3x_init(SHT3X_Info *sht3x_info, i2c_port_t port, uint8_t address)
+{
+    if (sht3x_info == NULL) return ESP_ERR_INVALID_ARG;
+    sht3x_info->port = port;
+    sht3x_info->address = address;
+    esp_err_t err = i2c_sensor_write_cmd(port, address, SHT3X_CMD_SOFT_RESET);
+    sht3x_info->init = (err == ESP_OK);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "no device at 0x%02x", address);
+        return err;
+    }
+    vTaskDelay(SHT3X_RESET_MS / portTICK_PERIOD_MS + 1);
+    return ESP_OK;
+}
+
+esp_err_t sht3x_start_measurement(const SHT3X_Info *sht3x_info)
+{
+    if (sht3x_info == NULL || !sht3x_info->init) return ESP_ERR_INVALID_STATE;
+    return i2c_sensor_write_cmd(sht3x_info->port, sht3x_info->address, SHT3X_CMD_SINGLE_SHOT_HIGH);
+}
+
+esp_err_t sht3x_read_measurement(const SHT3X_Info *sht3x_info, float *temperature, float *humidity)
+{
+    if (sht3x_info == NULL || !sht3x_info->init) return ESP_ERR_INVALID_STATE;
+    uint16_t words[2];
+    esp_err_t err = i2c_sensor_read_words(sht3x_info->port, sht3x_info->address, words, 2);
+    if (err != ESP_OK) return err;
+    if (temperature) *temperature = -45.0f + 175.0f * words[0] / 65535.0f;
+    if (humidity)    *humidity = 100.0f * words[1] / 65535.0f;
+    return ESP_OK;
+}
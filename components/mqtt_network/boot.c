@@ -0,0 +1,130 @@
+/*------------------------------------------------------------*-
+  Boot pipeline - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Boot steps run on their own tasks as soon as the phases they
+ * depend on are done. Every phase is timed since boot.
+ *
+ --------------------------------------------------------------*/
+#ifndef __BOOT_C
+#define __BOOT_C
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "boot.h"
+
+// ------ Private constants -----------------------------------
+#define BOOT_TASK_PRIORITY  (1)
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+/** @brief tag used for ESP serial console messages */
+static const char *TAG = "boot";
+static const char *_names[BOOT_PHASES] = { "nvs", "sensors", "tls", "network", "mqtt", "publish" };
+static portMUX_TYPE _boot_mux = portMUX_INITIALIZER_UNLOCKED;
+static StaticEventGroup_t _group_buf;
+static EventGroupHandle_t _group = NULL;  // one bit per phase done
+static boot_span_t _spans[BOOT_PHASES];   // guarded by _boot_mux
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+/**
+ * @brief the event group is created on first use, phases may be marked before boot_run()
+ */
+static EventGroupHandle_t __group(void)
+{
+    portENTER_CRITICAL(&_boot_mux);
+    if (_group == NULL) _group = xEventGroupCreateStatic(&_group_buf);
+    portEXIT_CRITICAL(&_boot_mux);
+    return _group;
+}
+/**
+ * @brief us since boot, never 0 so 0 can mean "not reached"
+ */
+static uint32_t __now_us(void)
+{
+    uint32_t now_us = (uint32_t)esp_timer_get_time();
+    return now_us ? now_us : 1;
+}
+/**
+ * @brief wait for the dependencies of one step, then run it
+ */
+static void __step_task(void *arg)
+{
+    const boot_step_t *step = (const boot_step_t *)arg;
+    if (step->after) xEventGroupWaitBits(__group(), step->after, pdFALSE, pdTRUE, portMAX_DELAY);
+    boot_begin(step->phase);
+    ESP_ERROR_CHECK(step->fn());
+    if (!step->async) boot_end(step->phase);
+    vTaskDelete(NULL);
+}
+esp_err_t boot_run(const boot_step_t *steps, uint8_t count)
+{
+    __group();
+    for (uint8_t i = 0; i < count; i++)
+    {
+        BaseType_t created = xTaskCreate(
+            &__step_task,            /* Task Function */
+            _names[steps[i].phase],  /* Name of Task */
+            steps[i].stack,          /* Stack size of Task */
+            (void *)&steps[i],       /* Parameter of the task */
+            BOOT_TASK_PRIORITY,      /* Priority of the task, vary from 0 to N, bigger means higher piority, need to be 0 to be lower than the watchdog*/
+            NULL);                   /* Task handle to keep track of created task */
+        if (created != pdPASS) return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+void boot_begin(boot_phase_t phase)
+{
+    uint32_t now_us = __now_us();
+    portENTER_CRITICAL(&_boot_mux);
+    if (_spans[phase].start_us == 0) _spans[phase].start_us = now_us;
+    portEXIT_CRITICAL(&_boot_mux);
+}
+void boot_end(boot_phase_t phase)
+{
+    uint32_t now_us = __now_us();
+    bool first = false;
+    portENTER_CRITICAL(&_boot_mux);
+    if (_spans[phase].end_us == 0)
+    {
+        if (_spans[phase].start_us == 0) _spans[phase].start_us = now_us;
+        _spans[phase].end_us = now_us;
+        first = true;
+    }
+    boot_span_t span = _spans[phase];
+    portEXIT_CRITICAL(&_boot_mux);
+    if (!first) return;
+    xEventGroupSetBits(__group(), BOOT_BIT(phase));
+    ESP_LOGW(TAG, "%s: %u us, done at %u ms", _names[phase], span.end_us - span.start_us, span.end_us / 1000);
+}
+bool boot_done(uint32_t phases)
+{
+    return (xEventGroupGetBits(__group()) & phases) == phases;
+}
+void boot_timeline(boot_span_t spans[BOOT_PHASES])
+{
+    portENTER_CRITICAL(&_boot_mux);
+    for (uint8_t i = 0; i < BOOT_PHASES; i++) spans[i] = _spans[i];
+    portEXIT_CRITICAL(&_boot_mux);
+}
+int boot_record(char *buf, size_t len)
+{
+    boot_span_t spans[BOOT_PHASES];
+    boot_timeline(spans);
+    int n = snprintf(buf, len, "{");
+    for (uint8_t i = 0; i < BOOT_PHASES; i++)
+    {
+        uint32_t took_us = spans[i].end_us ? spans[i].end_us - spans[i].start_us : 0;
+        n += snprintf(buf + (n < len ? n : len), n < len ? len - n : 0, "%s%s:[%u,%u]",
+                      i ? "," : "", _names[i], spans[i].start_us, took_us);
+    }
+    n += snprintf(buf + (n < len ? n : len), n < len ? len - n : 0, "}");
+    return n;
+}
+#endif
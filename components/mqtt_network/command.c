@@ -0,0 +1,231 @@
+/*------------------------------------------------------------*-
+  Cloud to device COMMANDS - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Reassembles fragmented MQTT messages into preallocated slots
+ * and routes them by topic to the registered handlers, on a
+ * dispatcher task instead of the MQTT event task.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __COMMAND_C
+#define __COMMAND_C
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "command.h"
+#include "topic_trie.h"
+#include "mqtt.h"
+
+// ------ Private constants -----------------------------------
+#define CMD_SLOTS            (CONFIG_MQTT_CMD_SLOTS)
+#define CMD_BUFFER_SIZE      (CONFIG_MQTT_CMD_BUFFER_SIZE)
+#define HANDLER_BUDGET_US    (CONFIG_MQTT_CMD_HANDLER_BUDGET * 1000)
+#define NO_SLOT              (-1)
+
+/**
+ * @brief one reassembled message, owned by the MQTT task while filling
+ *        and by the dispatcher task once queued
+ */
+typedef struct {
+    volatile bool busy;
+    uint16_t topic_len;
+    uint32_t len;
+    uint32_t total;
+    int64_t done_us;
+    char topic[COMMAND_TOPIC_MAX_LEN];
+    char data[CMD_BUFFER_SIZE + 1];     // null terminated for the handlers
+} cmd_slot_t;
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+/** @brief tag used for ESP serial console messages */
+static const char *TAG = "CMD";
+static topic_trie_t _trie;
+static bool _trie_ready = false;
+static portMUX_TYPE _trie_mux = portMUX_INITIALIZER_UNLOCKED;
+static const char *_filters[COMMAND_MAX_HANDLERS];
+static command_handler_t _handlers[COMMAND_MAX_HANDLERS];
+static uint8_t _num_handlers = 0;
+static cmd_slot_t _slots[CMD_SLOTS];
+static int8_t _filling = NO_SLOT;     // MQTT task only
+static xQueueHandle _cmd_queue = NULL;
+static command_stats_t _stats;
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+/**
+ * @brief run the handlers of one message
+ */
+static void __dispatch(cmd_slot_t *slot)
+{
+    uint8_t routes[COMMAND_MAX_HANDLERS];
+    uint32_t latency_us = (uint32_t)(esp_timer_get_time() - slot->done_us);
+    if (latency_us > _stats.latency_us_max) _stats.latency_us_max = latency_us;
+
+    portENTER_CRITICAL(&_trie_mux);
+    uint8_t count = topic_trie_match(&_trie, slot->topic, slot->topic_len, routes, COMMAND_MAX_HANDLERS);
+    portEXIT_CRITICAL(&_trie_mux);
+    if (count == 0)
+    {
+        _stats.unrouted++;
+        ESP_LOGW(TAG, "No handler for %.*s", slot->topic_len, slot->topic);
+        return;
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+        int64_t start_us = esp_timer_get_time();
+        _handlers[routes[i]](slot->topic, slot->topic_len, slot->data, slot->len);
+        uint32_t handler_us = (uint32_t)(esp_timer_get_time() - start_us);
+        if (handler_us > _stats.handler_us_max) _stats.handler_us_max = handler_us;
+        if (handler_us > HANDLER_BUDGET_US)
+        {
+            ESP_LOGW(TAG, "Handler for %s took %u ms", _filters[routes[i]], handler_us / 1000);
+        }
+    }
+    _stats.dispatched++;
+}
+/**
+ * @brief RTOS task running the handlers, one complete message at a time
+ */
+static void __dispatcher_task(void *pvParameter)
+{
+    int8_t index;
+    for (;;)
+    {
+        xQueueReceive(_cmd_queue, &index, portMAX_DELAY);
+        __dispatch(&_slots[index]);
+        _slots[index].busy = false;
+    }
+}
+/**
+ * @brief register a handler for a topic filter (public)
+ */
+esp_err_t command_register(const char *filter, command_handler_t handler)
+{
+    if (filter == NULL || handler == NULL) return ESP_ERR_INVALID_ARG;
+    if (_num_handlers >= COMMAND_MAX_HANDLERS) return ESP_ERR_NO_MEM;
+
+    bool ok;
+    portENTER_CRITICAL(&_trie_mux);
+    if (!_trie_ready)
+    {
+        topic_trie_init(&_trie);
+        _trie_ready = true;
+    }
+    ok = topic_trie_insert(&_trie, filter, _num_handlers);
+    if (ok)
+    {
+        _filters[_num_handlers] = filter;
+        _handlers[_num_handlers] = handler;
+        _num_handlers++;
+    }
+    portEXIT_CRITICAL(&_trie_mux);
+    if (!ok) return ESP_ERR_NO_MEM;
+
+    mqtt_sub(filter, 1); // already connected: subscribe now, otherwise on connection
+    return ESP_OK;
+}
+/**
+ * @brief copy the dispatcher counters (public)
+ */
+void command_stats(command_stats_t *stats)
+{
+    *stats = _stats;
+}
+/**
+ * @brief create the dispatcher task (public)
+ */
+esp_err_t command_init(void)
+{
+    if (_cmd_queue != NULL) return ESP_OK;
+    _cmd_queue = xQueueCreate(CMD_SLOTS, sizeof(int8_t));
+    if (_cmd_queue == NULL) return ESP_ERR_NO_MEM;
+    xTaskCreate(
+        &__dispatcher_task,  /* Task Function */
+        "cmd_task",          /* Name of Task */
+        3072,                /* Stack size of Task */
+        NULL,                /* Parameter of the task */
+        3,                   /* Priority of the task, above the sensor and publisher tasks so commands are not held back*/
+        NULL);               /* Task handle to keep track of created task */
+    return ESP_OK;
+}
+/**
+ * @brief subscribe every registered filter (public)
+ */
+void command_subscribe_all(void)
+{
+    for (uint8_t i = 0; i < _num_handlers; i++)
+    {
+        if (strcmp(_filters[i], CMD_TOPIC) != 0) mqtt_sub(_filters[i], 1); // CMD_TOPIC is always subscribed
+    }
+}
+/**
+ * @brief reassemble one fragment, queue the message once complete (public)
+ */
+void command_on_data(const char *topic, int topic_len, const char *data, int data_len,
+                     int offset, int total_len)
+{
+    if (offset == 0)
+    {
+        if (_filling != NO_SLOT)
+        {
+            // the previous message never completed, reuse its slot
+            _stats.incomplete++;
+            _slots[_filling].busy = false;
+            _filling = NO_SLOT;
+        }
+        if (total_len > CMD_BUFFER_SIZE || topic_len >= COMMAND_TOPIC_MAX_LEN)
+        {
+            _stats.oversize++;
+            ESP_LOGW(TAG, "Dropped %d byte message on %.*s", total_len, topic_len, topic);
+            return;
+        }
+        for (int8_t i = 0; i < CMD_SLOTS && _filling == NO_SLOT; i++)
+        {
+            if (!_slots[i].busy) _filling = i;
+        }
+        if (_filling == NO_SLOT)
+        {
+            _stats.dropped++;
+            return;
+        }
+        cmd_slot_t *slot = &_slots[_filling];
+        slot->busy = true;
+        memcpy(slot->topic, topic, topic_len);
+        slot->topic[topic_len] = '\0';
+        slot->topic_len = topic_len;
+        slot->len = 0;
+        slot->total = total_len;
+    }
+    if (_filling == NO_SLOT) return;  // rest of a dropped message
+
+    cmd_slot_t *slot = &_slots[_filling];
+    if (offset != slot->len || slot->len + data_len > slot->total)
+    {
+        _stats.incomplete++;
+        slot->busy = false;
+        _filling = NO_SLOT;
+        return;
+    }
+    memcpy(slot->data + slot->len, data, data_len);
+    slot->len += data_len;
+    if (slot->len < slot->total) return;
+
+    slot->data[slot->len] = '\0';
+    slot->done_us = esp_timer_get_time();
+    int8_t index = _filling;
+    _filling = NO_SLOT;
+    if (_cmd_queue == NULL || xQueueSend(_cmd_queue, &index, 0) != pdTRUE)
+    {
+        _stats.dropped++;
+        slot->busy = false;
+    }
+}
+
+#endif
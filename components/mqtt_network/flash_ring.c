@@ -0,0 +1,298 @@
+/*------------------------------------------------------------*-
+  FLASH RING log - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Append only record ring over raw NOR flash sectors, used to
+ * keep QoS 1 messages across resets. Sectors are erased in turn
+ * as the head goes round, which spreads the wear evenly, and a
+ * record is acknowledged by clearing bits of its state byte.
+ * Pure logic, the flash is reached through flash_ring_io_t.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __FLASH_RING_C
+#define __FLASH_RING_C
+#include <stddef.h>
+#include <string.h>
+
+#include "flash_ring.h"
+
+// ------ Private constants -----------------------------------
+#define RECORD_MAGIC     (0x5AA5)
+#define STATE_PENDING    (0xFE)   // written with the record
+#define STATE_ACKED      (0xFC)   // one bit cleared, no erase needed
+#define BLANK_CHUNK      (64)
+#define ALIGN4(x)        (((x) + 3) & ~3)
+
+/**
+ * @brief record header, followed by the topic and the data, padded to 4 bytes
+ * @note written after the body, so a torn write leaves no valid magic
+ */
+typedef struct {
+    uint16_t magic;
+    uint8_t state;
+    uint8_t flags;
+    uint16_t topic_len;
+    uint16_t data_len;
+    uint32_t seq;
+    uint32_t crc;             // flags, lengths, seq, topic and data
+} record_hdr_t;
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+static uint32_t __crc32(uint32_t crc, const void *buf, uint32_t len)
+{
+    const uint8_t *p = buf;
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *p++;
+        for (uint8_t i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+static uint32_t __record_crc(const record_hdr_t *hdr, const char *topic, const char *data)
+{
+    uint32_t crc = __crc32(0, &hdr->flags, 1);
+    crc = __crc32(crc, &hdr->topic_len, sizeof(hdr->topic_len));
+    crc = __crc32(crc, &hdr->data_len, sizeof(hdr->data_len));
+    crc = __crc32(crc, &hdr->seq, sizeof(hdr->seq));
+    crc = __crc32(crc, topic, hdr->topic_len);
+    return __crc32(crc, data, hdr->data_len);
+}
+static uint32_t __record_size(const record_hdr_t *hdr)
+{
+    return ALIGN4(sizeof(record_hdr_t) + hdr->topic_len + hdr->data_len);
+}
+static uint32_t __sector_start(const flash_ring_t *ring, uint32_t addr)
+{
+    return addr - addr % ring->io->sector_size;
+}
+/**
+ * @brief read a header, false past the last record of a sector
+ */
+static bool __read_hdr(const flash_ring_t *ring, uint32_t addr, record_hdr_t *hdr)
+{
+    uint32_t offset = addr % ring->io->sector_size;
+    if (offset + sizeof(record_hdr_t) > ring->io->sector_size) return false;
+    if (!ring->io->read(ring->io->ctx, addr, hdr, sizeof(record_hdr_t))) return false;
+    if (hdr->magic != RECORD_MAGIC) return false;
+    return offset + __record_size(hdr) <= ring->io->sector_size;
+}
+/**
+ * @brief address after a record, the next sector starts when this one is full
+ */
+static uint32_t __step(const flash_ring_t *ring, uint32_t addr, uint32_t size)
+{
+    addr += size;
+    return (addr % ring->io->sector_size == 0) ? addr % ring->io->size : addr;
+}
+static bool __blank(const flash_ring_t *ring, uint32_t addr, uint32_t end)
+{
+    uint8_t buf[BLANK_CHUNK];
+    while (addr < end)
+    {
+        uint32_t len = (end - addr < BLANK_CHUNK) ? end - addr : BLANK_CHUNK;
+        if (!ring->io->read(ring->io->ctx, addr, buf, len)) return false;
+        for (uint32_t i = 0; i < len; i++)
+        {
+            if (buf[i] != 0xFF) return false;
+        }
+        addr += len;
+    }
+    return true;
+}
+/**
+ * @brief erase a sector and move the head to it, pending records there are lost
+ */
+static bool __open_sector(flash_ring_t *ring, uint32_t sector)
+{
+    uint32_t end = sector + ring->io->sector_size;
+    record_hdr_t hdr;
+    for (uint32_t addr = sector; addr < end && __read_hdr(ring, addr, &hdr); addr += __record_size(&hdr))
+    {
+        if (hdr.state == STATE_PENDING)
+        {
+            ring->lost++;
+            ring->pending--;
+        }
+    }
+    if (ring->cursor == ring->head)                          ring->cursor = sector;  // nothing left to replay
+    else if (ring->cursor >= sector && ring->cursor < end)   ring->cursor = end % ring->io->size;
+    ring->head = sector;
+    ring->erases++;
+    return ring->io->erase(ring->io->ctx, sector);
+}
+
+bool flash_ring_mount(flash_ring_t *ring, const flash_ring_io_t *io)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->io = io;
+    if (io->sector_size == 0 || io->size < 2 * io->sector_size || io->size % io->sector_size) return false;
+
+    bool found = false;
+    bool has_pending = false;
+    uint32_t min_seq = 0;
+    record_hdr_t hdr;
+    for (uint32_t sector = 0; sector < io->size; sector += io->sector_size)
+    {
+        uint32_t end = sector + io->sector_size;
+        for (uint32_t addr = sector; addr < end && __read_hdr(ring, addr, &hdr); addr += __record_size(&hdr))
+        {
+            if (!found || (int32_t)(hdr.seq - ring->seq) >= 0)
+            {
+                found = true;
+                ring->seq = hdr.seq + 1;
+                ring->head = addr + __record_size(&hdr);
+            }
+            if (hdr.state == STATE_PENDING)
+            {
+                ring->pending++;
+                if (!has_pending || (int32_t)(hdr.seq - min_seq) < 0)
+                {
+                    has_pending = true;
+                    min_seq = hdr.seq;
+                    ring->cursor = addr;
+                }
+            }
+        }
+    }
+    if (!has_pending) ring->cursor = ring->head;
+
+    // the head must sit on blank flash, strictly inside a sector
+    uint32_t sector = __sector_start(ring, ring->head);
+    if (found && ring->head % io->sector_size == 0)
+    {
+        return __open_sector(ring, ring->head % io->size);
+    }
+    if (!__blank(ring, ring->head, sector + io->sector_size))
+    {
+        // torn write or foreign data
+        return __open_sector(ring, found ? (sector + io->sector_size) % io->size : 0);
+    }
+    return true;
+}
+
+bool flash_ring_append(flash_ring_t *ring, flash_ring_msg_t *msg)
+{
+    record_hdr_t hdr = {
+        .magic = RECORD_MAGIC,
+        .state = STATE_PENDING,
+        .flags = msg->flags,
+        .topic_len = msg->topic_len,
+        .data_len = msg->data_len,
+        .seq = ring->seq,
+    };
+    uint32_t size = __record_size(&hdr);
+    if (size > ring->io->sector_size) return false;
+    if (ring->head % ring->io->sector_size + size > ring->io->sector_size)
+    {
+        uint32_t next = (__sector_start(ring, ring->head) + ring->io->sector_size) % ring->io->size;
+        if (!__open_sector(ring, next)) return false;
+    }
+    hdr.crc = __record_crc(&hdr, msg->topic, msg->data);
+
+    // body first, the header makes the record valid
+    uint32_t addr = ring->head;
+    const flash_ring_io_t *io = ring->io;
+    if (hdr.topic_len && !io->write(io->ctx, addr + sizeof(hdr), msg->topic, hdr.topic_len)) return false;
+    if (hdr.data_len && !io->write(io->ctx, addr + sizeof(hdr) + hdr.topic_len, msg->data, hdr.data_len)) return false;
+    if (!io->write(io->ctx, addr, &hdr, sizeof(hdr))) return false;
+
+    msg->addr = addr;
+    msg->seq = hdr.seq;
+    ring->seq++;
+    ring->pending++;
+    ring->appended++;
+    ring->payload_bytes += hdr.topic_len + hdr.data_len;
+    ring->programmed_bytes += size;
+    ring->head = addr + size;
+    // keep one erased sector ahead, so the head never sits on a sector boundary
+    if (ring->head % io->sector_size == 0) return __open_sector(ring, ring->head % io->size);
+    return true;
+}
+
+/**
+ * @brief read the body of a record into msg and check it against its header
+ */
+static bool __load(const flash_ring_t *ring, uint32_t addr, const record_hdr_t *hdr, flash_ring_msg_t *msg)
+{
+    const flash_ring_io_t *io = ring->io;
+    if (hdr->topic_len >= msg->topic_size || hdr->data_len > msg->data_size ||
+        !io->read(io->ctx, addr + sizeof(*hdr), msg->topic, hdr->topic_len) ||
+        !io->read(io->ctx, addr + sizeof(*hdr) + hdr->topic_len, msg->data, hdr->data_len) ||
+        __record_crc(hdr, msg->topic, msg->data) != hdr->crc) return false;
+    msg->topic[hdr->topic_len] = '\0';
+    msg->topic_len = hdr->topic_len;
+    msg->data_len = hdr->data_len;
+    msg->flags = hdr->flags;
+    msg->addr = addr;
+    msg->seq = hdr->seq;
+    return true;
+}
+
+bool flash_ring_peek(flash_ring_t *ring, flash_ring_msg_t *msg)
+{
+    record_hdr_t hdr;
+    while (ring->cursor != ring->head)
+    {
+        uint32_t addr = ring->cursor;
+        if (!__read_hdr(ring, addr, &hdr))
+        {
+            // end of the records of this sector
+            ring->cursor = (__sector_start(ring, addr) + ring->io->sector_size) % ring->io->size;
+            continue;
+        }
+        uint32_t size = __record_size(&hdr);
+        if (hdr.state != STATE_PENDING)
+        {
+            ring->cursor = __step(ring, addr, size);
+            continue;
+        }
+        if (!__load(ring, addr, &hdr, msg))
+        {
+            ring->corrupt++;
+            ring->cursor = __step(ring, addr, size);
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool flash_ring_read(const flash_ring_t *ring, uint32_t addr, uint32_t seq, flash_ring_msg_t *msg)
+{
+    record_hdr_t hdr;
+    if (!__read_hdr(ring, addr, &hdr) || hdr.seq != seq || hdr.state != STATE_PENDING) return false;
+    return __load(ring, addr, &hdr, msg);
+}
+
+void flash_ring_advance(flash_ring_t *ring, const flash_ring_msg_t *msg)
+{
+    if (ring->cursor != msg->addr) return;
+    record_hdr_t hdr = { .topic_len = msg->topic_len, .data_len = msg->data_len };
+    ring->cursor = __step(ring, msg->addr, __record_size(&hdr));
+}
+
+bool flash_ring_ack(flash_ring_t *ring, uint32_t addr, uint32_t seq)
+{
+    record_hdr_t hdr;
+    if (!__read_hdr(ring, addr, &hdr) || hdr.seq != seq || hdr.state != STATE_PENDING) return false;
+    uint8_t state = STATE_ACKED;
+    if (!ring->io->write(ring->io->ctx, addr + offsetof(record_hdr_t, state), &state, 1)) return false;
+    ring->pending--;
+    ring->acked++;
+    ring->programmed_bytes++;
+    return true;
+}
+
+uint32_t flash_ring_write_amp(const flash_ring_t *ring)
+{
+    if (ring->payload_bytes == 0) return 0;
+    return (uint32_t)(ring->programmed_bytes * 100 / ring->payload_bytes);
+}
+
+#endif
@@ -0,0 +1,103 @@
+/*------------------------------------------------------------*-
+  FLASH WEAR accounting - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Logical bytes kept versus bytes programmed and sectors erased,
+ * for every flash area the firmware writes, and the erase cycles
+ * left at the current rate.
+ * Pure logic, also built by the host flash emulator.
+ *
+ --------------------------------------------------------------*/
+#ifndef __FLASH_WEAR_C
+#define __FLASH_WEAR_C
+#include <stddef.h>
+
+#include "flash_wear.h"
+
+// ------ Private constants -----------------------------------
+#define SECONDS_PER_DAY     (86400)
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+static flash_wear_t _areas[WEAR_AREAS] = {
+    [WEAR_CONFIG] = { .name = "config" },
+    [WEAR_OUTBOX] = { .name = "outbox" },
+};
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+static bool __read(void *ctx, uint32_t addr, void *buf, uint32_t len)
+{
+    const flash_ring_io_t *inner = ((flash_wear_t *)ctx)->inner;
+    return inner->read(inner->ctx, addr, buf, len);
+}
+static bool __write(void *ctx, uint32_t addr, const void *buf, uint32_t len)
+{
+    flash_wear_t *wear = (flash_wear_t *)ctx;
+    wear->programmed_bytes += len;
+    return wear->inner->write(wear->inner->ctx, addr, buf, len);
+}
+static bool __erase(void *ctx, uint32_t addr)
+{
+    flash_wear_t *wear = (flash_wear_t *)ctx;
+    wear->erases++;
+    return wear->inner->erase(wear->inner->ctx, addr);
+}
+flash_wear_t *flash_wear(wear_area_t area)
+{
+    return &_areas[area];
+}
+void flash_wear_setup(wear_area_t area, uint32_t sectors, uint32_t endurance)
+{
+    _areas[area].sectors = sectors;
+    _areas[area].endurance = endurance;
+}
+const flash_ring_io_t *flash_wear_wrap(wear_area_t area, const flash_ring_io_t *inner)
+{
+    flash_wear_t *wear = &_areas[area];
+    wear->inner = inner;
+    wear->io = *inner;
+    wear->io.read = __read;
+    wear->io.write = __write;
+    wear->io.erase = __erase;
+    wear->io.ctx = wear;
+    return &wear->io;
+}
+void flash_wear_logical(wear_area_t area, uint32_t bytes)
+{
+    _areas[area].logical_bytes += bytes;
+}
+void flash_wear_nvs_write(wear_area_t area, uint32_t len, bool variable)
+{
+    flash_wear_t *wear = &_areas[area];
+    uint32_t entries = variable ? 1 + (len + FLASH_WEAR_NVS_ENTRY - 1) / FLASH_WEAR_NVS_ENTRY : 1;
+    wear->logical_bytes += len;
+    wear->programmed_bytes += entries * FLASH_WEAR_NVS_ENTRY;
+    wear->nvs_entries += entries;
+    while (wear->nvs_entries >= FLASH_WEAR_NVS_PAGE)
+    {
+        wear->nvs_entries -= FLASH_WEAR_NVS_PAGE;
+        wear->erases++;
+    }
+}
+uint32_t flash_wear_amp(const flash_wear_t *wear)
+{
+    if (wear->logical_bytes == 0) return 0;
+    return (uint32_t)(wear->programmed_bytes * 100 / wear->logical_bytes);
+}
+uint32_t flash_wear_remaining(const flash_wear_t *wear)
+{
+    if (wear->sectors == 0) return 0;
+    uint32_t used = (wear->erases_before + wear->erases) / wear->sectors;
+    return (used >= wear->endurance) ? 0 : wear->endurance - used;
+}
+uint32_t flash_wear_days_left(const flash_wear_t *wear, uint32_t uptime_s)
+{
+    if (wear->erases == 0 || uptime_s == 0) return UINT32_MAX;
+    // erases left in the whole area, over the erases per day of this boot
+    uint64_t left = (uint64_t)flash_wear_remaining(wear) * wear->sectors;
+    uint64_t days = left * uptime_s / ((uint64_t)wear->erases * SECONDS_PER_DAY);
+    return (days > UINT32_MAX) ? UINT32_MAX : (uint32_t)days;
+}
+#endif
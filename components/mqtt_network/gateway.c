@@ -0,0 +1,349 @@
+/*------------------------------------------------------------*-
+  Gateway - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Many boards, one MQTT connection: child boards send their
+ * readings over ESP-NOW, the uplink board publishes them on
+ * GATEWAY_TOPIC followed by the child id.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __GATEWAY_C
+#define __GATEWAY_C
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_wifi.h"
+#include "esp_now.h"
+
+#include "gateway.h"
+#include "mqtt.h"
+
+#if defined(CONFIG_GATEWAY_UPLINK) || defined(CONFIG_GATEWAY_CHILD)
+// ------ Private constants -----------------------------------
+#define GATEWAY_MAGIC       (0xE1)
+#define HEADER_LEN          (4)    // magic, child id length, sequence number
+#define QUEUE_DEPTH         (CONFIG_GATEWAY_QUEUE_DEPTH)
+#define GATEWAY_STACK       (2560 + sizeof(frame_t) + MQTT_TOPIC_MAX_LEN)
+#ifdef CONFIG_GATEWAY_UPLINK
+#define MAX_CHILDREN        (CONFIG_GATEWAY_MAX_CHILDREN)
+#define SIM_CHILDREN        (CONFIG_GATEWAY_SIM_CHILDREN)
+#define SIM_PERIOD_MS       (CONFIG_GATEWAY_SIM_PERIOD)
+#endif
+#define SEND_TIMEOUT_MS     (100)
+#define CHANNEL_TRIES       (3)    // failed sends before the next channel is tried
+#define CHANNEL_MAX         (13)
+
+/**
+ * @brief one frame, as sent over the air: header, child id, payload
+ */
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];   // sender, uplink only
+    uint16_t len;
+    uint8_t bytes[GATEWAY_FRAME_MAX];
+} frame_t;
+
+#ifdef CONFIG_GATEWAY_UPLINK
+/**
+ * @brief last frame seen from a child, the radio retries with the same sequence number
+ */
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint16_t last_seq;
+} child_t;
+#endif
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+/** @brief tag used for ESP serial console messages */
+static const char *TAG = "GATEWAY";
+static xQueueHandle _frames = NULL;
+static gateway_stats_t _stats;   // each counter has a single writer
+#ifdef CONFIG_GATEWAY_UPLINK
+static child_t _children[MAX_CHILDREN];  // uplink task only
+#else
+static uint8_t _peer[ESP_NOW_ETH_ALEN];
+static TaskHandle_t _child_task = NULL;
+static uint16_t _seq = 0;                 // producer task only
+static uint8_t _channel = CONFIG_GATEWAY_CHANNEL;
+#endif
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+/**
+ * @brief the child id goes into the topic, keep it to characters the property bag allows
+ */
+static bool __valid_id(const char *id, uint8_t id_len)
+{
+    if (id_len == 0 || id_len > GATEWAY_ID_MAX) return false;
+    for (uint8_t i = 0; i < id_len; i++)
+    {
+        char c = id[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+              c == '-' || c == '_' || c == '.')) return false;
+    }
+    return true;
+}
+/**
+ * @brief fill a frame, false if it does not fit
+ */
+static bool __build(frame_t *frame, uint16_t seq, const char *id, uint8_t id_len, const char *data, int data_len)
+{
+    if (!__valid_id(id, id_len) || data_len < 0 || HEADER_LEN + id_len + data_len > GATEWAY_FRAME_MAX) return false;
+    frame->bytes[0] = GATEWAY_MAGIC;
+    frame->bytes[1] = id_len;
+    frame->bytes[2] = seq & 0xFF;
+    frame->bytes[3] = seq >> 8;
+    memcpy(frame->bytes + HEADER_LEN, id, id_len);
+    memcpy(frame->bytes + HEADER_LEN + id_len, data, data_len);
+    frame->len = HEADER_LEN + id_len + data_len;
+    return true;
+}
+#ifdef CONFIG_GATEWAY_UPLINK
+/**
+ * @brief find a child by its MAC address, added if new
+ * @return NULL when the table is full, the frame is then forwarded without duplicate detection
+ */
+static child_t *__child(const uint8_t *mac, bool *is_new)
+{
+    for (uint16_t i = 0; i < _stats.children; i++)
+    {
+        if (memcmp(_children[i].mac, mac, ESP_NOW_ETH_ALEN) == 0)
+        {
+            *is_new = false;
+            return &_children[i];
+        }
+    }
+    if (_stats.children >= MAX_CHILDREN) return NULL;
+    child_t *child = &_children[_stats.children++];
+    memcpy(child->mac, mac, ESP_NOW_ETH_ALEN);
+    *is_new = true;
+    ESP_LOGW(TAG, "New child %02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return child;
+}
+/**
+ * @brief publish one child frame on the shared connection
+ */
+static void __forward(const frame_t *frame)
+{
+    _stats.frames++;
+    uint8_t id_len = frame->bytes[1];
+    const char *id = (const char *)frame->bytes + HEADER_LEN;
+    if (frame->len < HEADER_LEN || frame->bytes[0] != GATEWAY_MAGIC ||
+        HEADER_LEN + id_len > frame->len || !__valid_id(id, id_len))
+    {
+        _stats.malformed++;
+        return;
+    }
+    uint16_t seq = frame->bytes[2] | (frame->bytes[3] << 8);
+    bool is_new;
+    child_t *child = __child(frame->mac, &is_new);
+    if (child)
+    {
+        if (!is_new && child->last_seq == seq)
+        {
+            _stats.duplicates++;
+            return;
+        }
+        child->last_seq = seq;
+    }
+
+    char topic[MQTT_TOPIC_MAX_LEN];
+    int topic_len = snprintf(topic, sizeof(topic), GATEWAY_TOPIC "%.*s", id_len, id);
+    mqtt_pub_status_t status = mqtt_enqueue_len(topic, topic_len, (const char *)frame->bytes + HEADER_LEN + id_len,
+                                                frame->len - HEADER_LEN - id_len, 1, 0); //topic, data, qos, retain
+    if (status == MQTT_PUB_DROPPED) _stats.refused++;
+    else                            _stats.forwarded++;
+}
+/**
+ * @brief benchmark: readings of fake children, through the same path as real ones
+ */
+static void __simulate(void)
+{
+    static uint16_t seq = 0;
+    frame_t frame;
+    char id[GATEWAY_ID_MAX + 1];
+    char data[24];
+    for (uint8_t i = 0; i < SIM_CHILDREN; i++)
+    {
+        int id_len = snprintf(id, sizeof(id), "sim%02u", i);
+        int data_len = snprintf(data, sizeof(data), "{temp:%u.%u}", 20 + i % 10, seq % 10);
+        const uint8_t mac[ESP_NOW_ETH_ALEN] = {0x02, 'S', 'I', 'M', 0, i};  // locally administered
+        memcpy(frame.mac, mac, ESP_NOW_ETH_ALEN);
+        if (__build(&frame, seq, id, id_len, data, data_len)) __forward(&frame);
+    }
+    seq++;
+}
+/**
+ * @brief ESP-NOW receive callback, runs in the Wi-Fi task: copy and hand over
+ */
+static void __on_recv(const uint8_t *mac, const uint8_t *data, int len)
+{
+    if (len < HEADER_LEN || len > GATEWAY_FRAME_MAX)
+    {
+        _stats.bad_length++;
+        return;
+    }
+    frame_t frame;
+    memcpy(frame.mac, mac, ESP_NOW_ETH_ALEN);
+    frame.len = len;
+    memcpy(frame.bytes, data, len);
+    if (xQueueSend(_frames, &frame, 0) != pdTRUE) _stats.overflow++;
+}
+/**
+ * @brief forward child frames to the MQTT outbox
+ */
+static void __uplink_task(void *pvParameter)
+{
+    frame_t frame;
+    uint32_t sim_due_ms = esp_timer_get_time() / 1000 + SIM_PERIOD_MS;
+    for (;;)
+    {
+        TickType_t wait = portMAX_DELAY;
+        if (SIM_CHILDREN > 0)
+        {
+            int32_t left_ms = (int32_t)(sim_due_ms - esp_timer_get_time() / 1000);
+            wait = (left_ms > 0) ? left_ms / portTICK_PERIOD_MS + 1 : 0;
+        }
+        if (xQueueReceive(_frames, &frame, wait) == pdTRUE) __forward(&frame);
+        if (SIM_CHILDREN > 0 && (int32_t)(esp_timer_get_time() / 1000 - sim_due_ms) >= 0)
+        {
+            sim_due_ms += SIM_PERIOD_MS;
+            __simulate();
+        }
+    }
+}
+#else
+/**
+ * @brief ESP-NOW send callback, runs in the Wi-Fi task: wake the child task with the result
+ */
+static void __on_sent(const uint8_t *mac, esp_now_send_status_t status)
+{
+    xTaskNotify(_child_task, (status == ESP_NOW_SEND_SUCCESS) ? 1 : 2, eSetValueWithOverwrite);
+}
+/**
+ * @brief send one frame and wait for the radio acknowledgement of the uplink board
+ */
+static bool __send(const frame_t *frame)
+{
+    uint32_t result = 0;
+    xTaskNotifyWait(0, UINT32_MAX, NULL, 0);  // drop a late result of the previous try
+    if (esp_now_send(_peer, frame->bytes, frame->len) != ESP_OK) return false;
+    return xTaskNotifyWait(0, UINT32_MAX, &result, SEND_TIMEOUT_MS / portTICK_PERIOD_MS) == pdTRUE && result == 1;
+}
+/**
+ * @brief send queued readings, hunting for the channel of the uplink board when it does not answer
+ */
+static void __child_task(void *pvParameter)
+{
+    frame_t frame;
+    for (;;)
+    {
+        xQueueReceive(_frames, &frame, portMAX_DELAY);
+        bool sent = false;
+        for (uint8_t tries = 1; !sent && tries <= CHANNEL_TRIES * CHANNEL_MAX; tries++)
+        {
+            sent = __send(&frame);
+            if (sent) break;
+            _stats.retries++;
+            if (tries % CHANNEL_TRIES == 0)
+            {
+                _channel = _channel % CHANNEL_MAX + 1;
+                esp_wifi_set_channel(_channel, WIFI_SECOND_CHAN_NONE);
+            }
+        }
+        if (sent) _stats.sent++;
+        else
+        {
+            _stats.failed++;
+            ESP_LOGE(TAG, "Uplink board not found on any channel");
+        }
+        _stats.channel = _channel;
+    }
+}
+/**
+ * @brief queue a reading for the uplink board (public)
+ */
+mqtt_pub_status_t gateway_forward(const char *data, int data_len)
+{
+    frame_t frame;
+    if (_frames == NULL || !__build(&frame, _seq, CONFIG_DEVICEID, sizeof(CONFIG_DEVICEID) - 1, data, data_len))
+        return MQTT_PUB_DROPPED;
+    if (xQueueSend(_frames, &frame, 0) != pdTRUE) return MQTT_PUB_DROPPED;
+    _seq++;
+    return (uxQueueMessagesWaiting(_frames) > QUEUE_DEPTH / 2) ? MQTT_PUB_DEFERRED : MQTT_PUB_ACCEPTED;
+}
+#endif
+/**
+ * @brief copy the link counters (public)
+ */
+void gateway_stats(gateway_stats_t *stats)
+{
+    *stats = _stats;
+}
+/**
+ * @brief start the ESP-NOW link (public)
+ */
+esp_err_t gateway_start(void)
+{
+    _frames = xQueueCreate(QUEUE_DEPTH, sizeof(frame_t));
+    if (_frames == NULL) return ESP_ERR_NO_MEM;
+#ifdef CONFIG_GATEWAY_CHILD
+    if (sscanf(CONFIG_GATEWAY_PEER_MAC, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
+               &_peer[0], &_peer[1], &_peer[2], &_peer[3], &_peer[4], &_peer[5]) != ESP_NOW_ETH_ALEN)
+    {
+        ESP_LOGE(TAG, "Bad uplink board MAC: %s", CONFIG_GATEWAY_PEER_MAC);
+        return ESP_ERR_INVALID_ARG;
+    }
+    // radio only, no access point and no IP
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_start());
+    ESP_ERROR_CHECK(esp_wifi_set_channel(_channel, WIFI_SECOND_CHAN_NONE));
+    ESP_ERROR_CHECK(esp_now_init());
+    ESP_ERROR_CHECK(esp_now_register_send_cb(&__on_sent));
+    esp_now_peer_info_t peer = {
+        .channel = 0,   // follow the current channel while hunting
+        .ifidx = ESP_IF_WIFI_STA,
+        .encrypt = false,
+    };
+    memcpy(peer.peer_addr, _peer, ESP_NOW_ETH_ALEN);
+    ESP_ERROR_CHECK(esp_now_add_peer(&peer));
+    _seq = esp_random();  // a reboot must not look like a retransmission to the uplink board
+    _stats.channel = _channel;
+    xTaskCreate(
+        &__child_task,      /* Task Function */
+        "gw_child_task",    /* Name of Task */
+        GATEWAY_STACK,      /* Stack size of Task */
+        NULL,               /* Parameter of the task */
+        2,                  /* Priority of the task, vary from 0 to N, bigger means higher piority, need to be 0 to be lower than the watchdog*/
+        &_child_task);      /* Task handle to keep track of created task */
+#else
+    // the uplink radio must stay awake to hear its children, they arrive on the access point channel
+    esp_wifi_set_ps(WIFI_PS_NONE);
+    ESP_ERROR_CHECK(esp_now_init());
+    ESP_ERROR_CHECK(esp_now_register_recv_cb(&__on_recv));
+    xTaskCreate(
+        &__uplink_task,     /* Task Function */
+        "gw_uplink_task",   /* Name of Task */
+        GATEWAY_STACK,      /* Stack size of Task */
+        NULL,               /* Parameter of the task */
+        2,                  /* Priority of the task, vary from 0 to N, bigger means higher piority, need to be 0 to be lower than the watchdog*/
+        NULL);              /* Task handle to keep track of created task */
+#endif
+    ESP_LOGW(TAG, "ESP-NOW link started");
+    return ESP_OK;
+}
+
+#endif // CONFIG_GATEWAY_UPLINK || CONFIG_GATEWAY_CHILD
+
+#endif
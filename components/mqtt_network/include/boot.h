@@ -0,0 +1,87 @@
+/*------------------------------------------------------------*-
+  Boot pipeline - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Boot steps run on their own tasks as soon as the phases they
+ * depend on are done. Every phase is timed since boot.
+ *
+ --------------------------------------------------------------*/
+#ifndef __BOOT_H
+#define __BOOT_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// ------ Public constants ------------------------------------
+typedef enum {
+    BOOT_NVS = 0,            // NVS flash init
+    BOOT_SENSORS,            // bus setup and device discovery
+    BOOT_TLS,                // CA store parsed, outbox and publisher task ready
+    BOOT_NETWORK,            // interfaces up, until the first IP
+    BOOT_MQTT,               // client start, until the first CONNACK
+    BOOT_PUBLISH,            // first CONNACK, until the first message handed to the client
+    BOOT_PHASES
+} boot_phase_t;
+#define BOOT_BIT(phase)      (1UL << (phase))
+
+typedef esp_err_t (*boot_fn_t)(void);
+/**
+ * @brief one node of the boot graph
+ * @note the table must outlive boot_run(), each step reads it from its own task
+ */
+typedef struct {
+    boot_phase_t phase;
+    uint32_t after;          // BOOT_BIT() of the phases to wait for, 0 to start at once
+    boot_fn_t fn;            // a failure aborts, like the ESP_ERROR_CHECK() of a serial boot
+    uint32_t stack;
+    bool async;              // fn only starts the phase, its owner calls boot_end()
+} boot_step_t;
+/**
+ * @brief one phase, in us since boot, 0 if not reached yet
+ */
+typedef struct {
+    uint32_t start_us;
+    uint32_t end_us;
+} boot_span_t;
+// ------ Public function prototypes --------------------------
+/**
+ * @brief Start every step of the graph, returns without waiting for them
+ */
+esp_err_t boot_run(const boot_step_t *steps, uint8_t count);
+/**
+ * @brief Mark a phase as started, only the first call counts
+ */
+void boot_begin(boot_phase_t phase);
+/**
+ * @brief Mark a phase as done and release the steps waiting for it, only the first call counts
+ */
+void boot_end(boot_phase_t phase);
+/**
+ * @brief True once every phase in the BOOT_BIT() mask is done
+ */
+bool boot_done(uint32_t phases);
+/**
+ * @brief Copy the timeline, one span per phase
+ */
+void boot_timeline(boot_span_t spans[BOOT_PHASES]);
+/**
+ * @brief Format the timeline as a diagnostics record: {phase:[start,duration],...} in us
+ * @return length as snprintf(), the record is incomplete if it is not below len
+ */
+int boot_record(char *buf, size_t len);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
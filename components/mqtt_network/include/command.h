@@ -0,0 +1,76 @@
+/*------------------------------------------------------------*-
+  Cloud to device COMMANDS - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Reassembles fragmented MQTT messages into preallocated slots
+ * and routes them by topic to the registered handlers, on a
+ * dispatcher task instead of the MQTT event task.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __COMMAND_H
+#define __COMMAND_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// ------ Public constants ------------------------------------
+#define COMMAND_MAX_HANDLERS  (8)
+#define COMMAND_TOPIC_MAX_LEN (192)   // Azure appends the message properties to the topic
+
+/**
+ * @brief command handler, runs on the dispatcher task
+ * @note keep it short, the next command waits for it. data is null terminated
+ */
+typedef void (*command_handler_t)(const char *topic, int topic_len, const char *data, int data_len);
+
+/**
+ * @brief dispatcher counters, since boot
+ */
+typedef struct {
+    uint32_t dispatched;
+    uint32_t unrouted;         // no filter matched the topic
+    uint32_t dropped;          // no free slot, or the dispatcher queue was full
+    uint32_t oversize;         // larger than a slot
+    uint32_t incomplete;       // a fragment was missing
+    uint32_t latency_us_max;   // last fragment received to handler start
+    uint32_t handler_us_max;
+} command_stats_t;
+// ------ Public function prototypes --------------------------
+/**
+ * @brief Register a handler for a topic filter, '+' and '#' allowed
+ * @note the filter is subscribed at every connection. Register at init,
+ *       before or after mqtt_start()
+ */
+esp_err_t command_register(const char *filter, command_handler_t handler);
+/**
+ * @brief Read the dispatcher counters
+ */
+void command_stats(command_stats_t *stats);
+/**
+ * @brief Create the dispatcher task (called by mqtt_start)
+ */
+esp_err_t command_init(void);
+/**
+ * @brief Subscribe every registered filter (called on MQTT_EVENT_CONNECTED)
+ */
+void command_subscribe_all(void);
+/**
+ * @brief Feed one MQTT_EVENT_DATA fragment (called by the MQTT event handler)
+ * @note topic is only given with the first fragment
+ */
+void command_on_data(const char *topic, int topic_len, const char *data, int data_len,
+                     int offset, int total_len);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,110 @@
+/*------------------------------------------------------------*-
+  FLASH RING log - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Append only record ring over raw NOR flash sectors, used to
+ * keep QoS 1 messages across resets. Sectors are erased in turn
+ * as the head goes round, which spreads the wear evenly, and a
+ * record is acknowledged by clearing bits of its state byte.
+ * Pure logic, the flash is reached through flash_ring_io_t.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __FLASH_RING_H
+#define __FLASH_RING_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// ------ Public constants ------------------------------------
+#define FLASH_RING_QOS_MASK   (0x03)
+#define FLASH_RING_RETAIN     (0x04)
+
+/**
+ * @brief Flash access, every function returns true on success
+ * @note write only clears bits, erase sets a whole sector to 0xFF
+ */
+typedef struct {
+    bool (*read)(void *ctx, uint32_t addr, void *buf, uint32_t len);
+    bool (*write)(void *ctx, uint32_t addr, const void *buf, uint32_t len);
+    bool (*erase)(void *ctx, uint32_t addr);
+    void *ctx;
+    uint32_t size;            // multiple of sector_size, at least two sectors
+    uint32_t sector_size;
+} flash_ring_io_t;
+
+typedef struct {
+    const flash_ring_io_t *io;
+    uint32_t head;            // next write address
+    uint32_t cursor;          // next record to replay
+    uint32_t seq;             // sequence number of the next record
+    uint32_t pending;         // written and not acknowledged
+    uint32_t appended;
+    uint32_t acked;
+    uint32_t lost;            // pending records erased by the head
+    uint32_t corrupt;         // torn or unreadable records skipped
+    uint32_t erases;
+    uint64_t payload_bytes;   // topic and data appended
+    uint64_t programmed_bytes;// everything written: headers, padding, state updates
+} flash_ring_t;
+
+/**
+ * @brief One record, the caller provides the buffers and their sizes
+ */
+typedef struct {
+    uint8_t flags;            // qos | FLASH_RING_RETAIN
+    char *topic;              // null terminated on read
+    uint16_t topic_size;
+    uint16_t topic_len;
+    char *data;
+    uint16_t data_size;
+    uint16_t data_len;
+    uint32_t addr;            // where the record lives, for flash_ring_ack()
+    uint32_t seq;
+} flash_ring_msg_t;
+// ------ Public function prototypes --------------------------
+/**
+ * @brief Scan the flash, find the head and the oldest unsent record
+ * @note every record still pending after a reset is replayed
+ */
+bool flash_ring_mount(flash_ring_t *ring, const flash_ring_io_t *io);
+/**
+ * @brief Append a record, erasing the oldest sector when the head reaches it
+ * @note topic, topic_len, data, data_len and flags of msg are used, addr and seq are filled in
+ */
+bool flash_ring_append(flash_ring_t *ring, flash_ring_msg_t *msg);
+/**
+ * @brief Read the record at the replay cursor, acknowledged and torn records are skipped
+ * @return false when everything has been replayed
+ */
+bool flash_ring_peek(flash_ring_t *ring, flash_ring_msg_t *msg);
+/**
+ * @brief Move the replay cursor past the record returned by flash_ring_peek()
+ */
+void flash_ring_advance(flash_ring_t *ring, const flash_ring_msg_t *msg);
+/**
+ * @brief Read a record again by its place, whatever the replay cursor
+ * @return false if it was acknowledged or its sector was reused since
+ */
+bool flash_ring_read(const flash_ring_t *ring, uint32_t addr, uint32_t seq, flash_ring_msg_t *msg);
+/**
+ * @brief Mark a record delivered, ignored if its sector was reused since
+ */
+bool flash_ring_ack(flash_ring_t *ring, uint32_t addr, uint32_t seq);
+/**
+ * @brief Flash bytes programmed per payload byte, x100
+ */
+uint32_t flash_ring_write_amp(const flash_ring_t *ring);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
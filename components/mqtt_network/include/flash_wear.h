@@ -0,0 +1,89 @@
+/*------------------------------------------------------------*-
+  FLASH WEAR accounting - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Logical bytes kept versus bytes programmed and sectors erased,
+ * for every flash area the firmware writes, and the erase cycles
+ * left at the current rate.
+ * Pure logic, also built by the host flash emulator.
+ *
+ --------------------------------------------------------------*/
+#ifndef __FLASH_WEAR_H
+#define __FLASH_WEAR_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "flash_ring.h"
+
+// ------ Public constants ------------------------------------
+#define FLASH_WEAR_NVS_ENTRY      (32)    // bytes per NVS entry
+#define FLASH_WEAR_NVS_PAGE       (126)   // entries per 4 KB NVS page
+
+typedef enum {
+    WEAR_CONFIG = 0,         // NVS: config store, ROM cache, fast connect cache
+    WEAR_OUTBOX,             // flash ring of the persistent outbox
+    WEAR_AREAS
+} wear_area_t;
+
+typedef struct {
+    const char *name;
+    uint32_t sectors;            // erase units of the area
+    uint32_t endurance;          // erase cycles per sector
+    uint32_t erases_before;      // erases of earlier boots, from the last checkpoint
+    uint32_t erases;             // this boot
+    uint32_t nvs_entries;        // NVS: entries written since the last page erase
+    uint64_t logical_bytes;      // what the subsystem asked to keep
+    uint64_t programmed_bytes;   // what reached the flash: headers, padding, state updates
+    flash_ring_io_t io;          // counting io in front of inner
+    const flash_ring_io_t *inner;
+} flash_wear_t;
+// ------ Public function prototypes --------------------------
+/**
+ * @brief The counters of one area
+ */
+flash_wear_t *flash_wear(wear_area_t area);
+/**
+ * @brief Size of the area and erase cycles of its sectors, counters are kept
+ */
+void flash_wear_setup(wear_area_t area, uint32_t sectors, uint32_t endurance);
+/**
+ * @brief Put the counting io in front of a raw flash io, give the result to flash_ring_mount()
+ */
+const flash_ring_io_t *flash_wear_wrap(wear_area_t area, const flash_ring_io_t *inner);
+/**
+ * @brief Account bytes the subsystem asked to keep
+ */
+void flash_wear_logical(wear_area_t area, uint32_t bytes);
+/**
+ * @brief Account one NVS key write of len bytes
+ * @note an integer takes one entry, a string or blob one more per 32 bytes. NVS
+ *       fills its pages in turn, so in steady state a page is erased per page of entries.
+ */
+void flash_wear_nvs_write(wear_area_t area, uint32_t len, bool variable);
+/**
+ * @brief Bytes programmed per logical byte, x100
+ */
+uint32_t flash_wear_amp(const flash_wear_t *wear);
+/**
+ * @brief Erase cycles left per sector, assuming the area spreads its erases evenly
+ */
+uint32_t flash_wear_remaining(const flash_wear_t *wear);
+/**
+ * @brief Days until the endurance is reached at the erase rate of this boot
+ * @return UINT32_MAX if nothing was erased yet
+ */
+uint32_t flash_wear_days_left(const flash_wear_t *wear, uint32_t uptime_s);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
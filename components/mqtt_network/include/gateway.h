@@ -0,0 +1,68 @@
+/*------------------------------------------------------------*-
+  Gateway - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Many boards, one MQTT connection: child boards send their
+ * readings over ESP-NOW, the uplink board publishes them with
+ * the child id as a message property.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __GATEWAY_H
+#define __GATEWAY_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "mqtt.h"
+
+// ------ Public constants ------------------------------------
+#define GATEWAY_FRAME_MAX    (250)  // ESP-NOW payload limit
+#define GATEWAY_ID_MAX       (32)   // child device id, without the null
+#define GATEWAY_TOPIC        TOPIC_DIR "child="  // followed by the child id
+
+/**
+ * @brief link counters, since boot
+ */
+typedef struct {
+    // uplink
+    uint32_t frames;           // received from children
+    uint32_t duplicates;       // retransmissions of a frame already forwarded
+    uint32_t bad_length;       // shorter than a header or longer than a frame, Wi-Fi task
+    uint32_t malformed;        // bad magic or child id, uplink task
+    uint32_t overflow;         // lost, the forward queue was full
+    uint32_t forwarded;        // accepted by the MQTT outbox
+    uint32_t refused;          // refused by the MQTT outbox
+    uint16_t children;
+    // child
+    uint32_t sent;             // acknowledged by the uplink radio
+    uint32_t retries;
+    uint32_t failed;           // given up after every channel was tried
+    uint8_t channel;
+} gateway_stats_t;
+// ------ Public function prototypes --------------------------
+/**
+ * @brief Start the ESP-NOW link
+ * @note uplink: after the network is up, child: instead of the network
+ */
+esp_err_t gateway_start(void);
+/**
+ * @brief Child: queue a reading for the uplink board, never blocks
+ */
+mqtt_pub_status_t gateway_forward(const char *data, int data_len);
+/**
+ * @brief Read the link counters
+ */
+void gateway_stats(gateway_stats_t *stats);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -15,7 +15,12 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
 // ------ Public constants ------------------------------------
+#define LED_PATTERN_MAX   (8)   // steps of a pattern
 // ------ Public function prototypes --------------------------
 /**
  * @brief Init indicating LED
@@ -37,6 +42,11 @@ void led_blink(void);
  * @brief fast blinking the LED
  */
 void led_fastblink(void);
+/**
+ * @brief play a pattern: step durations in ms, lit first then alternating
+ * @note a pattern that does not repeat leaves the LED off when it ends
+ */
+esp_err_t led_pattern(const uint16_t *steps_ms, uint8_t count, bool repeat);
 // ------ Public variable -------------------------------------
 
 #ifdef __cplusplus
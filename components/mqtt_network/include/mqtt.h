@@ -15,18 +15,94 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
 #include "esp_err.h"
+#include "puback.h"
 
 // ------ Public constants ------------------------------------
-#define MQTT_HOST     "mqtts://" CONFIG_IOTHUBNAME ".azure-devices.net"
+#define MQTT_HOSTNAME CONFIG_IOTHUBNAME ".azure-devices.net"
+#define MQTT_HOST     "mqtts://" MQTT_HOSTNAME
 #define MQTT_USERNAME CONFIG_IOTHUBNAME ".azure-devices.net/" CONFIG_DEVICEID "/?api-version=2018-06-30"
 #define MQTT_PASSWORD CONFIG_MQTT_PASSWORD
 #define TOPIC_DIR     "devices/" CONFIG_DEVICEID "/messages/events/"//"trai" CONFIG_FARM_NAME "/chuong" CONFIG_BARN_NAME "/thietbi" CONFIG_DEVICE_NAME
 #define CMD_TOPIC     "devices/" CONFIG_DEVICEID "/messages/devicebound/#" //TOPIC_DIR "/cmd"
 #define LWT_TOPIC     TOPIC_DIR  //TOPIC_DIR "/status"
 #define DATA_TOPIC    TOPIC_DIR  //TOPIC_DIR "/data"
+#define DIAG_TOPIC    TOPIC_DIR "type=diag"  // telemetry with a message property, so it can be routed apart
+#define BOOT_TOPIC    TOPIC_DIR "type=boot"  // boot timeline, once per boot
+#define SYS_TOPIC     TOPIC_DIR "type=sys"   // task and heap statistics
+#define TRACE_TOPIC   TOPIC_DIR "type=trace" // event trace dump, on request
+
+#define MQTT_TOPIC_MAX_LEN   (96)                          // outbox slot topic, null included
+#define MQTT_OUTBOX_MSG_LEN  (CONFIG_MQTT_OUTBOX_MSG_LEN)  // outbox slot data
+
+/**
+ * @brief answer of mqtt_enqueue() to the producer
+ */
+typedef enum {
+    MQTT_PUB_ACCEPTED = 0,   // queued
+    MQTT_PUB_DEFERRED,       // queued, but the outbox is above its high water mark: produce less
+    MQTT_PUB_DROPPED,        // not queued: outbox full, message too long or MQTT not started
+} mqtt_pub_status_t;
+
+/**
+ * @brief outbox counters, since boot
+ */
+typedef struct {
+    uint16_t depth;            // messages waiting now
+    uint16_t depth_max;
+    uint32_t accepted;
+    uint32_t deferred;
+    uint32_t dropped;
+    uint32_t sent;             // handed to the MQTT client
+    uint32_t expired;          // dropped after waiting longer than the message expiry
+    uint32_t throttled;        // held back until their publish budget had a token
+    uint32_t payload_bytes;    // payload of the sent messages
+    uint32_t wire_bytes;       // PUBLISH packets of the sent messages, headers and topic included
+    uint32_t enqueue_us_max;   // time spent inside mqtt_enqueue()
+    uint32_t enqueue_us_avg;
+    uint32_t wait_ms_max;      // time spent in the outbox
+    uint32_t wait_ms_avg;
+    uint32_t publish_us_max;   // time spent in the client publish call, logging included
+    uint32_t publish_us_avg;
+    uint32_t persisted;        // QoS 1 messages written to the flash outbox
+    uint32_t persist_us_max;   // time to append one message to flash
+    uint32_t persist_us_avg;
+    uint32_t flash_pending;    // in flash, not acknowledged yet
+    uint32_t flash_lost;       // overwritten before they could be sent
+    uint32_t write_amp_pct;    // flash bytes programmed per payload byte, x100
+} mqtt_outbox_stats_t;
+
+
+/**
+ * @brief connection counters, since boot
+ */
+typedef struct {
+    uint32_t connects;
+    uint32_t failures;           // lost connections and failed attempts
+    uint32_t dns_ms_last;        // broker name lookup
+    uint32_t session_ms_last;    // TCP + full TLS handshake + MQTT CONNECT, until CONNACK
+    uint32_t handshake_ms_last;  // both phases above
+    uint32_t handshake_ms_min;
+    uint32_t handshake_ms_max;
+    uint32_t handshake_ms_avg;
+    uint32_t handshake_cpu_last; // MQTT task run time during the last connection, 0 without FreeRTOS run time stats
+    uint32_t reconnect_ms;       // wait after the next lost connection
+    uint32_t boot_connect_ms;    // first CONNACK, since boot
+    uint32_t boot_publish_ms;    // first message handed to the client, since boot
+    uint32_t failovers;          // switches to the next broker after failed attempts
+    uint32_t rebind_ms_last;     // default route change to CONNACK on the new interface
+    uint8_t endpoint;            // broker in use, 0 is the preferred one
+} mqtt_connect_stats_t;
 
 // ------ Public function prototypes --------------------------
+/**
+ * @brief Parse the CA store and start the outbox, before the network is up
+ * @note mqtt_enqueue() accepts messages from here on, called by mqtt_start() if needed
+ */
+esp_err_t mqtt_prepare(void);
 /**
  * @brief Connect to MQTT broker
  * @return ESP_OK on successful connection
@@ -47,6 +123,52 @@ int mqtt_unsub(const char *topic);
  * @return msg_id on successful publishment
  */
 int mqtt_pub(const char *topic, const char *data, int qos, int retain);
+/**
+ * @brief Queue a preformatted message in the outbox, never blocks on the network
+ * @note topic and data are copied, the publisher task sends them once connected.
+ *       Neither needs to be null terminated. Nothing is logged on success.
+ * @return backpressure signal for the producer
+ */
+mqtt_pub_status_t mqtt_enqueue_len(const char *topic, size_t topic_len,
+                                   const char *data, size_t data_len, int qos, int retain);
+/**
+ * @brief Same as mqtt_enqueue_len() for null terminated strings
+ */
+mqtt_pub_status_t mqtt_enqueue(const char *topic, const char *data, int qos, int retain);
+/**
+ * @brief Read the outbox counters
+ */
+void mqtt_outbox_stats(mqtt_outbox_stats_t *stats);
+/**
+ * @brief Reconnect at once, through the current default interface
+ * @note called by the network when the default route moves, returns without waiting
+ */
+void mqtt_rebind(void);
+/**
+ * @brief Read the connection counters and the handshake timing
+ */
+void mqtt_connect_stats(mqtt_connect_stats_t *stats);
+/**
+ * @brief Read the PUBACK counters and the publish latency percentiles
+ * @note the percentiles cover the time since the last diagnostics message,
+ *       or since boot when the diagnostics message is disabled
+ */
+void mqtt_puback_stats(puback_stats_t *stats);
+/**
+ * @brief Dump the event trace on TRACE_TOPIC, a few lines per second, returns at once
+ * @note recording is paused until the dump is over. ESP_ERR_NOT_SUPPORTED without CONFIG_TRACE_ENABLE
+ */
+esp_err_t mqtt_trace_dump(void);
+/**
+ * @brief Block until the broker connection is up
+ * @return true if connected before the timeout
+ */
+bool mqtt_wait_connected(uint32_t timeout_ms);
+/**
+ * @brief Block until the outbox is empty and every QoS>0 message is acknowledged
+ * @return true if nothing is left in flight before the timeout
+ */
+bool mqtt_wait_delivered(uint32_t timeout_ms);
 // ------ Public variable -------------------------------------
 
 #ifdef __cplusplus
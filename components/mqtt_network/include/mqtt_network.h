@@ -18,6 +18,9 @@ extern "C" {
 
 #include "network.h"
 #include "mqtt.h"
+#include "command.h"
+#include "gateway.h"
+#include "boot.h"
 
 #ifdef __cplusplus
 }
@@ -31,10 +31,14 @@ extern "C" {
 // #endif
 // ------ Public function prototypes --------------------------
 /**
- * @brief Connect to Wi-Fi and/or Ethernet, wait for IP
- * @return ESP_OK on successful connection
+ * @brief network_init() then network_start(), or the ESP-NOW link of a gateway child
+ * @note blocks until an IP is obtained, the boot graph runs it on its own task
+ */
+esp_err_t network_connect(void);
+/**
+ * @brief Start what needs the network: the MQTT client, and the gateway uplink side
  */
-esp_err_t network_startTask(void);
+esp_err_t network_uplink(void);
 /**
  * @brief network initialize function - needed for any net interface
  */
@@ -0,0 +1,102 @@
+/*------------------------------------------------------------*-
+  PUBACK tracking - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Fixed size msg_id -> timestamp table for QoS 1 publishes,
+ * resolved on PUBACK, with a streaming latency histogram.
+ * Pure logic, the caller serialises access and gives the time.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __PUBACK_H
+#define __PUBACK_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// ------ Public constants ------------------------------------
+#ifdef CONFIG_MQTT_PUBACK_TABLE_SIZE
+#define PUBACK_TABLE_SIZE    (CONFIG_MQTT_PUBACK_TABLE_SIZE)
+#else
+#define PUBACK_TABLE_SIZE    (16)
+#endif
+#define PUBACK_OCTAVES       (17)     // histogram covers 1 ms to 131 s
+#define PUBACK_SUB_BUCKETS   (4)      // per octave, a bucket spans 25% of its lower bound
+#define PUBACK_BUCKETS       (PUBACK_OCTAVES * PUBACK_SUB_BUCKETS)
+
+typedef struct {
+    int msg_id;
+    uint32_t sent_ms;
+    bool used;
+    bool timed_out;           // counted once, still resolved if the PUBACK comes late
+} puback_entry_t;
+
+typedef struct {
+    puback_entry_t entries[PUBACK_TABLE_SIZE];
+    uint32_t histogram[PUBACK_BUCKETS];  // latencies of the current window
+    uint32_t window_max_ms;
+    int early_id;             // PUBACK seen before its publish was recorded
+    uint32_t early_ms;
+    bool early_valid;
+    uint32_t acked;
+    uint32_t timeouts;
+    uint32_t retransmits;
+    uint32_t evicted;         // dropped from a full table, never resolved
+    uint32_t unmatched;       // PUBACK for an unknown msg_id
+} puback_table_t;
+
+/**
+ * @brief Snapshot, the percentiles cover the window since the last reset
+ */
+typedef struct {
+    uint16_t inflight;
+    uint32_t acked;
+    uint32_t timeouts;
+    uint32_t retransmits;
+    uint32_t evicted;
+    uint32_t unmatched;
+    uint32_t samples;         // latencies in the window
+    uint32_t p50_ms;
+    uint32_t p95_ms;
+    uint32_t p99_ms;
+    uint32_t max_ms;
+} puback_stats_t;
+// ------ Public function prototypes --------------------------
+/**
+ * @brief Empty the table and the counters
+ */
+void puback_init(puback_table_t *table);
+/**
+ * @brief Record a QoS 1 publish, the oldest entry is evicted when the table is full
+ */
+void puback_sent(puback_table_t *table, int msg_id, uint32_t sent_ms);
+/**
+ * @brief Resolve a PUBACK
+ * @return true if the msg_id was in flight
+ */
+bool puback_acked(puback_table_t *table, int msg_id, uint32_t now_ms);
+/**
+ * @brief Count the entries older than timeout_ms as timed out, once each
+ */
+void puback_expire(puback_table_t *table, uint32_t now_ms, uint32_t timeout_ms);
+/**
+ * @brief Session resumed: the client resends every message still in flight
+ */
+void puback_reconnected(puback_table_t *table);
+/**
+ * @brief Fill the snapshot, optionally start a new percentile window
+ */
+void puback_stats(puback_table_t *table, puback_stats_t *stats, bool reset_window);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -5,6 +5,7 @@
 ---------------------------------------------------------------
  * Save important data in NVS - non volatile storage memory (in flash! not EEPROM, perfect!)
  * Ported from Cpp Preference library of arduino-esp32.
+ * Typed config store: loaded once into RAM, written per transaction.
  * 
  * ref: https://github.com/espressif/arduino-esp32/tree/master/libraries/Preferences
  * 
@@ -19,16 +20,96 @@ extern "C" {
 #endif
 
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "flash_wear.h"
 
 // ------ Public constants ------------------------------------
+#define STORE_ROMS_MAX       (10)   // 1-Wire devices remembered, one payload key each
+#define STORE_BROKERS_MAX    (2)    // brokers in preference order
+/**
+ * @brief last good Wi-Fi association and DHCP lease, for the fast reconnect
+ */
+typedef struct {
+    char ssid[33];
+    uint8_t bssid[6];
+    uint8_t channel;          // 0 if nothing is cached
+    uint32_t ip;              // lease, network byte order, 0 if unknown
+    uint32_t netmask;
+    uint32_t gw;
+    uint32_t dns;
+} wifi_fast_t;
+/**
+ * @brief 1-Wire ROM codes in payload key order: "temp" is codes[0]
+ */
+typedef struct {
+    uint8_t count;
+    uint8_t codes[STORE_ROMS_MAX][8];
+} store_roms_t;
+/**
+ * @brief broker that replaces the menuconfig one at the same place, empty uri for none
+ */
+typedef struct {
+    char uri[96];
+    char host[64];            // resolved and probed on its own
+    uint16_t port;
+} store_broker_t;
+/**
+ * @brief everything kept in NVS, loaded once at boot and read from RAM afterwards
+ * @note 0 or empty means "not set": the menuconfig value applies
+ */
+typedef struct {
+    uint8_t wifi_valid;       // credentials from smartconfig
+    char wifi_ssid[33];
+    char wifi_pass[65];
+    wifi_fast_t wifi_fast;
+    uint32_t sample_period;   // ms
+    uint8_t resolution;       // bits
+    store_roms_t roms;
+    store_broker_t brokers[STORE_BROKERS_MAX];
+    uint32_t wear[WEAR_AREAS];  // sector erases up to the last checkpoint
+} config_store_t;
 // ------ Public function prototypes --------------------------
 /**
- * @brief Init indicating PREFERENCE
+ * @brief Load every key into RAM, once after nvs_flash_init()
+ * @note credentials and fast connect data of the older namespaces are moved over
+ */
+esp_err_t config_load(void);
+/**
+ * @brief nvs_flash_init(), erasing a full or newer partition, then config_load()
+ * @note the BOOT_NVS step, everything reading the store runs after it
+ */
+esp_err_t config_init(void);
+/**
+ * @brief The RAM copy, no NVS access
+ * @note a commit from another task may change it between two reads,
+ *       use config_read() when several fields must agree
+ */
+const config_store_t* config_get(void);
+/**
+ * @brief Consistent copy of the RAM store
+ */
+void config_read(config_store_t* config);
+/**
+ * @brief Start a transaction: returns a copy of the store to edit
+ * @note blocks while another task is in a transaction, always end with config_commit()
+ *       or config_abort(). Aborts when config_load() has not run yet
+ */
+config_store_t* config_begin(void);
+/**
+ * @brief Write the keys changed since config_begin() with a single nvs_commit, then publish them in RAM
+ * @note nothing is written if nothing changed. On error the transaction is dropped.
+ */
+esp_err_t config_commit(void);
+/**
+ * @brief End a transaction without writing anything, the store is left as it was
+ */
+void config_abort(void);
+/**
+ * @brief Save the erase counts of every flash area, they are added back at the next boot
  */
-void store_WifiCredentials(char* WSSID, char* WPASS);
-void del_WifiCredentials(void);
-bool read_WifiSSID(char* ssid);
-bool read_WifiPass(char* pass);
+esp_err_t config_wear_checkpoint(void);
 
 // ------ Public variable -------------------------------------
 
@@ -0,0 +1,77 @@
+/*------------------------------------------------------------*-
+  System MONITOR - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * CPU share and stack headroom of every task, free heap and
+ * largest free block. Sampled at a low rate by the caller,
+ * nothing is measured on the sensor or publish paths.
+ *
+ --------------------------------------------------------------*/
+#ifndef __SYSMON_H
+#define __SYSMON_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+// ------ Public constants ------------------------------------
+#define SYSMON_TASKS_MAX     (24)
+#define SYSMON_STACK_LOW     (256)    // bytes of headroom below which a task is reported
+#define SYSMON_NO_CPU        (0xFFFF) // cpu_pml when run time stats are off or on the first sample
+
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];
+    uint8_t priority;
+    int8_t core;               // -1: no affinity
+    uint16_t cpu_pml;          // of one core since the previous sample, per mille
+    uint32_t stack_free;       // bytes of stack never used since the task started
+} sysmon_task_t;
+
+typedef struct {
+    uint32_t heap_free;        // 8 bit capable heap
+    uint32_t heap_min;         // lowest heap_free since boot
+    uint32_t heap_largest;     // largest block that can be allocated now
+    uint32_t interval_ms;      // since the previous sample, 0 on the first
+    uint8_t count;             // tasks filled in
+    uint8_t missed;            // tasks that did not fit in SYSMON_TASKS_MAX
+    sysmon_task_t tasks[SYSMON_TASKS_MAX];
+} sysmon_t;
+// ------ Public function prototypes --------------------------
+/**
+ * @brief Take a sample and keep it as the latest one
+ * @note walks every task with the scheduler suspended, call it at a low rate
+ */
+esp_err_t sysmon_sample(sysmon_t *sample);
+/**
+ * @brief Copy the latest sample, ESP_ERR_INVALID_STATE if none was taken yet
+ */
+esp_err_t sysmon_get(sysmon_t *sample);
+/**
+ * @brief Print a sample on the serial console, one line per task
+ */
+void sysmon_log(const sysmon_t *sample);
+/**
+ * @brief Format part of a sample as a diagnostics record:
+ *        {heap:[free,min,largest],ms:interval,tasks:{"name":[cpu_pml,stack_free],...}}
+ * @param next first task to format, updated to the first task left out
+ * @note task names are quoted, they may hold spaces, cpu_pml is -1 without run time stats.
+ *       The heap is only in the record that starts at task 0. Call again while
+ *       *next < sample->count, every record is complete and shorter than len
+ * @return length of the record, 0 if not even one task fits
+ */
+int sysmon_record(const sysmon_t *sample, uint8_t *next, char *buf, size_t len);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
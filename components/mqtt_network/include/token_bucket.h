@@ -0,0 +1,51 @@
+/*------------------------------------------------------------*-
+  Token bucket - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Publish budget: tokens refill at a steady rate up to a burst,
+ * one message takes one token.
+ * Pure logic, the caller serialises access and gives the time.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __TOKEN_BUCKET_H
+#define __TOKEN_BUCKET_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// ------ Public constants ------------------------------------
+typedef struct {
+    uint32_t rate_per_min;    // refill
+    uint32_t burst;           // capacity, in tokens, at most 70000
+    uint32_t credit;          // one token is 60000, the refill is rate_per_min per ms
+    uint32_t last_ms;
+    uint32_t granted;
+    uint32_t throttled;       // calls that found the bucket empty
+} token_bucket_t;
+// ------ Public function prototypes --------------------------
+/**
+ * @brief Start with a full bucket
+ */
+void token_bucket_init(token_bucket_t *bucket, uint32_t rate_per_min, uint32_t burst, uint32_t now_ms);
+/**
+ * @brief Take one token if there is one
+ */
+bool token_bucket_take(token_bucket_t *bucket, uint32_t now_ms);
+/**
+ * @brief Time until the next token, 0 if one is available
+ */
+uint32_t token_bucket_wait_ms(token_bucket_t *bucket, uint32_t now_ms);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
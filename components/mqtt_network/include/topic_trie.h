@@ -0,0 +1,65 @@
+/*------------------------------------------------------------*-
+  TOPIC TRIE - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Compact trie of MQTT topic filters, one node per topic level,
+ * with the '+' and '#' wildcards. Fixed node and name pools.
+ * Pure logic, the caller serialises insert and match.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __TOPIC_TRIE_H
+#define __TOPIC_TRIE_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// ------ Public constants ------------------------------------
+#define TOPIC_TRIE_MAX_NODES  (48)
+#define TOPIC_TRIE_POOL_SIZE  (384)   // level names, not null terminated
+#define TOPIC_TRIE_NONE       (0xFF)
+
+typedef struct {
+    uint16_t name;            // offset in the pool
+    uint8_t name_len;
+    uint8_t child;            // first child
+    uint8_t sibling;          // next node on the same level
+    uint8_t route;            // value given at insert, TOPIC_TRIE_NONE if the filter ends deeper
+} topic_node_t;
+
+typedef struct {
+    topic_node_t nodes[TOPIC_TRIE_MAX_NODES];
+    char pool[TOPIC_TRIE_POOL_SIZE];
+    uint16_t pool_used;
+    uint8_t count;
+    uint8_t root;             // first node of the first level
+} topic_trie_t;
+// ------ Public function prototypes --------------------------
+/**
+ * @brief Empty the trie
+ */
+void topic_trie_init(topic_trie_t *trie);
+/**
+ * @brief Add a filter, e.g. "devices/dev01/messages/devicebound/#"
+ * @return false if the pools are full or the filter already has a route
+ */
+bool topic_trie_insert(topic_trie_t *trie, const char *filter, uint8_t route);
+/**
+ * @brief Find every filter matching a topic
+ * @return the number of routes written, at most max_routes
+ */
+uint8_t topic_trie_match(const topic_trie_t *trie, const char *topic, int topic_len,
+                         uint8_t *routes, uint8_t max_routes);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
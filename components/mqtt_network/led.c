@@ -1,42 +1,110 @@
 /*------------------------------------------------------------*-
   Indicating LED - header file
   (c) Minh-An Dao 2020
-  version 1.00 - 13/10/2020
+  version 1.10 - 19/10/2026
 ---------------------------------------------------------------
  * Setup LED for indicating network status.
- * Based on ledc lib.
- * 
+ * Patterns are played by an esp_timer, one callback per edge,
+ * no task and no CPU between two edges.
+ *
  --------------------------------------------------------------*/
 #ifndef __LED_C
 #define __LED_C
 #include <stdio.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "freertos/queue.h"
 #include "driver/gpio.h"
 #include "sdkconfig.h"
 #include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
 
+#include "led.h"
 
 // ------ Private constants -----------------------------------
 #define BLINK_GPIO       (CONFIG_LED_PIN)
 #define BLINK_INTERVAL   (CONFIG_LED_INTERVAL)
-typedef enum {
-    LED_BLINK,
-    LED_BLINK_FAST,
-    LED_LIT,
-    LED_OFF
-} led_state_t;
+#define LED_ON_LEVEL     (0)   // the LED is wired active low
 // ------ Private function prototypes -------------------------
+static void __led_step(void *arg);
 // ------ Private variables -----------------------------------
-xQueueHandle _blink_queue;
-led_state_t _led_status = LED_BLINK;
+/** @brief tag used for ESP serial console messages */
+static const char *TAG = "led";
+static portMUX_TYPE _led_mux = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t _led_timer = NULL;
+// the pattern being played, guarded by _led_mux
+static uint16_t _steps[LED_PATTERN_MAX];
+static uint8_t _count = 0;       // 0: steady, no timer running
+static uint8_t _step = 0;
+static bool _repeat = false;
+static int64_t _due_us = 0;      // end of the current step, older callbacks are stale
 // ------ PUBLIC variable definitions -------------------------
 //--------------------------------------------------------------
 // FUNCTION DEFINITIONS
 //--------------------------------------------------------------
-static void blink_task(void* arg)
+/**
+ * @brief even steps lit the LED, odd steps turn it off - called with _led_mux held
+ */
+static void __led_show(uint8_t step)
 {
+    gpio_set_level(BLINK_GPIO, (step & 1) ? !LED_ON_LEVEL : LED_ON_LEVEL);
+    _due_us = esp_timer_get_time() + (int64_t)_steps[step] * 1000;
+    esp_timer_start_once(_led_timer, (uint64_t)_steps[step] * 1000);
+}
+/**
+ * @brief replace the pattern, the timer is stopped first so no old edge is played after
+ */
+static void __led_play(const uint16_t *steps_ms, uint8_t count, bool repeat)
+{
+    if (_led_timer == NULL) return;
+    portENTER_CRITICAL(&_led_mux);
+    esp_timer_stop(_led_timer);
+    _count = count;
+    _step = 0;
+    _repeat = repeat;
+    memcpy(_steps, steps_ms, count * sizeof(steps_ms[0]));
+    __led_show(0);
+    portEXIT_CRITICAL(&_led_mux);
+}
+static void __led_steady(bool lit)
+{
+    if (_led_timer == NULL) return;
+    portENTER_CRITICAL(&_led_mux);
+    esp_timer_stop(_led_timer);
+    _count = 0;
+    gpio_set_level(BLINK_GPIO, lit ? LED_ON_LEVEL : !LED_ON_LEVEL);
+    portEXIT_CRITICAL(&_led_mux);
+}
+/**
+ * @brief one edge of the pattern - runs on the esp_timer task
+ */
+static void __led_step(void *arg)
+{
+    portENTER_CRITICAL(&_led_mux);
+    // fired just before the pattern was replaced
+    if (_count == 0 || esp_timer_get_time() < _due_us)
+    {
+        portEXIT_CRITICAL(&_led_mux);
+        return;
+    }
+    if (++_step >= _count)
+    {
+        _step = 0;
+        if (!_repeat)
+        {
+            _count = 0;
+            gpio_set_level(BLINK_GPIO, !LED_ON_LEVEL);
+            portEXIT_CRITICAL(&_led_mux);
+            return;
+        }
+    }
+    __led_show(_step);
+    portEXIT_CRITICAL(&_led_mux);
+}
+
+void led_init(void)
+{
+    if (_led_timer != NULL) return;
     /* Configure the IOMUX register for pad BLINK_GPIO (some pads are
        muxed to GPIO on reset already, but some default to other
        functions and need to be switched to GPIO. Consult the
@@ -46,77 +114,49 @@ static void blink_task(void* arg)
     gpio_pad_select_gpio(BLINK_GPIO);
     /* Set the GPIO as a push/pull output */
     gpio_set_direction(BLINK_GPIO, GPIO_MODE_OUTPUT);
-    led_state_t status_now;
-    while(1) {
-        if(xQueueReceive(_blink_queue, &status_now, 0)) //no waiting, just checking for any news
-        {
-            _led_status = status_now; 
-        }
-        switch (_led_status)
-        {
-        case LED_BLINK:
-            /* LED off (output low) */
-            gpio_set_level(BLINK_GPIO, 0);
-            vTaskDelay(BLINK_INTERVAL / portTICK_PERIOD_MS);
-            /* LED on (output high) */
-            gpio_set_level(BLINK_GPIO, 1);
-            vTaskDelay(BLINK_INTERVAL / portTICK_PERIOD_MS);
-            break;
-        case LED_BLINK_FAST:
-            /* LED off (output low) */
-            gpio_set_level(BLINK_GPIO, 0);
-            vTaskDelay((uint16_t)(BLINK_INTERVAL/5)/portTICK_PERIOD_MS);
-            /* LED on (output high) */
-            gpio_set_level(BLINK_GPIO, 1);
-            vTaskDelay((uint16_t)(BLINK_INTERVAL/5)/portTICK_PERIOD_MS);
-            break;
-        case LED_LIT:
-            /* LED off (output low) --> turn on LED */
-            gpio_set_level(BLINK_GPIO, 0);
-            break;
-        default:
-            /* LED on (output high) --> turn off LED */
-            gpio_set_level(BLINK_GPIO, 1);
-            break;
-        }
+    gpio_set_level(BLINK_GPIO, !LED_ON_LEVEL);
+    const esp_timer_create_args_t args = {
+        .callback = &__led_step,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "led",
+    };
+    if (esp_timer_create(&args, &_led_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "No timer for the LED, it stays off");
+        _led_timer = NULL;
     }
 }
 
-void led_init(void)
-{
-    _blink_queue = xQueueCreate(3, sizeof(led_state_t));
-    //------------ blink task -----------------
-    xTaskCreate(
-        &blink_task,    /* Task Function */
-        "blink task",   /* Name of Task */
-        1024,           /* Stack size of Task */
-        NULL,           /* Parameter of the task */
-        0,              /* Priority of the task, vary from 0 to N, bigger means higher piority, need to be 0 to be lower than the watchdog*/
-        NULL);          /* Task handle to keep track of created task */
-
-}
-
 void led_lit(void)
 {
-    led_state_t led_now = LED_LIT;
-    xQueueSend(_blink_queue, &led_now,  portMAX_DELAY);     
+    __led_steady(true);
 }
 
 void led_off(void)
 {
-    led_state_t led_now = LED_OFF;
-    xQueueSend(_blink_queue, &led_now,  portMAX_DELAY);   
+    __led_steady(false);
 }
 
 void led_blink(void)
 {
-    led_state_t led_now = LED_BLINK;
-    xQueueSend(_blink_queue, &led_now,  portMAX_DELAY);    
+    static const uint16_t blink[] = { BLINK_INTERVAL, BLINK_INTERVAL };
+    __led_play(blink, 2, true);
 }
 
 void led_fastblink(void)
 {
-    led_state_t led_now = LED_BLINK_FAST;
-    xQueueSend(_blink_queue, &led_now,  portMAX_DELAY);    
+    static const uint16_t fast[] = { BLINK_INTERVAL / 5, BLINK_INTERVAL / 5 };
+    __led_play(fast, 2, true);
+}
+
+esp_err_t led_pattern(const uint16_t *steps_ms, uint8_t count, bool repeat)
+{
+    if (steps_ms == NULL || count == 0 || count > LED_PATTERN_MAX) return ESP_ERR_INVALID_ARG;
+    for (uint8_t i = 0; i < count; i++)
+        if (steps_ms[i] == 0) return ESP_ERR_INVALID_ARG;
+    if (_led_timer == NULL) return ESP_ERR_INVALID_STATE;
+    __led_play(steps_ms, count, repeat);
+    return ESP_OK;
 }
-#endif
\ No newline at end of file
+#endif
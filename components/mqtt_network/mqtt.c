@@ -12,27 +12,544 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
 #include "esp_event.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_idf_version.h"
+#ifdef CONFIG_MQTT_PERSISTENT_OUTBOX
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#endif
 
 #include "esp_log.h"
+#include "esp_tls.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
 #include "mqtt_client.h"
 
 #include "mqtt.h"
+#include "boot.h"
+#include "puback.h"
+#include "token_bucket.h"
+#include "flash_ring.h"
+#include "flash_wear.h"
+#include "command.h"
+#include "storage.h"
+#include "sysmon.h"
+#include "trace.h"
+#include "dlog.h"
 #include "led.h"
 
 // ------ Private constants -----------------------------------
+#define WAIT_POLL_MS        (100)
+#define OUTBOX_DEPTH        (CONFIG_MQTT_OUTBOX_DEPTH)
+#define OUTBOX_HIGH_WATER   (CONFIG_MQTT_OUTBOX_HIGH_WATER)
+#define DIAG_OUTBOX_DEPTH   (8)   // boot, diagnostics, system and trace messages, queued apart from telemetry
+#define PUBLISH_RETRIES     (3)   // attempts before a message the client refuses is dropped
+#define BENCHMARK_EVERY     (100) // publishes per benchmark report
+#define PUBACK_TIMEOUT_MS   (CONFIG_MQTT_PUBACK_TIMEOUT)
+#define DIAG_PERIOD_MS      (CONFIG_MQTT_DIAG_PERIOD)  // 0 disables the diagnostics message
+#define DIAG_POLL_MS        (1000)  // PUBACK timeouts are checked at least this often
+#define DIAG_MAX_LEN        (192)
+#define BOOT_RECORD_LEN     (MQTT_OUTBOX_MSG_LEN)
+#define SYS_PERIOD_MS       (CONFIG_MQTT_SYS_PERIOD)  // 0 disables the task and heap statistics
+#define EXPIRY_US           (CONFIG_MQTT_MESSAGE_EXPIRY * 1000000LL)  // 0 disables the expiry
+#define RECONNECT_MIN_MS    (CONFIG_MQTT_RECONNECT_MIN)
+#define RECONNECT_MAX_MS    (CONFIG_MQTT_RECONNECT_MAX)
+#ifdef CONFIG_MQTT_EDGE_BROKER
+#define FAILOVER_ATTEMPTS   (CONFIG_MQTT_FAILOVER_ATTEMPTS)
+#define FAILBACK_PERIOD_MS  (CONFIG_MQTT_FAILBACK_PERIOD * 1000)
+#else
+#define FAILOVER_ATTEMPTS   (UINT8_MAX)  // one broker only
+#define FAILBACK_PERIOD_MS  (0)
+#endif
+#define PROBE_TIMEOUT_MS    (2000)
+#define PROBE_POLL_MS       (1000)
+#define PROBE_STACK         (3072)  // getaddrinfo() and a socket
+#define SWITCH_NONE         (-1)
+#define SWITCH_STAY         (-2)    // reconnect to the broker in use
+#define RATE_BURST          (CONFIG_MQTT_RATE_BURST)
+#define PERSIST_PARTITION   "outbox"
+#define PERSIST_WINDOW      (8)   // records replayed from flash and not acknowledged yet
+#define WEAR_CHECKPOINT_MS  (CONFIG_FLASH_WEAR_CHECKPOINT * 3600000U)
+#if defined(CONFIG_MQTT_CLIENT_ENQUEUE) && ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 3, 0)
+#define CLIENT_ENQUEUE                   // esp_mqtt_client_enqueue() first shipped in ESP-IDF 4.3
+#endif
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+// ESP-IDF 5 nests the client configuration
+#define CFG_URI             broker.address.uri
+#define CFG_PORT            broker.address.port
+#define CFG_USERNAME        credentials.username
+#define CFG_PASSWORD        credentials.authentication.password
+#define CFG_RECONNECT_MS    network.reconnect_timeout_ms
+#ifdef CONFIG_MQTT_PROTOCOL_5
+#define MQTT_V5                          // CONFIG_MQTT_PROTOCOL_5 is the esp-mqtt switch
+#define TOPIC_ALIASES       (CONFIG_MQTT_V5_TOPIC_ALIASES)  // 0 sends every topic in full
+#endif
+#else
+#define CFG_URI             uri
+#define CFG_PORT            port
+#define CFG_USERNAME        username
+#define CFG_PASSWORD        password
+#define CFG_RECONNECT_MS    reconnect_timeout_ms
+#endif
+
+/**
+ * @brief one outbox slot, topic and data are copied so the producer buffers can be reused
+ * @note topic is null terminated for the client, data is not
+ */
+typedef struct {
+    int64_t enqueued_us;
+    uint16_t data_len;
+    uint8_t qos;
+    uint8_t retain;
+    char topic[MQTT_TOPIC_MAX_LEN];
+    char data[MQTT_OUTBOX_MSG_LEN];
+} outbox_msg_t;
+#define PUBLISHER_STACK     (2560 + 2 * sizeof(outbox_msg_t))  // its own slot, and the copy mqtt_enqueue_len() makes of a report
+/**
+ * @brief one broker the client can connect to
+ */
+typedef struct {
+    const char *name;        // for the logs
+    const char *uri;
+    const char *host;        // resolved and probed on its own
+    uint32_t port;
+    const char *username;
+    const char *password;
+} endpoint_t;
+/**
+ * @brief publish budgets, each message takes a token from one of them
+ */
+typedef enum {
+    BUDGET_TELEMETRY = 0,
+    BUDGET_DIAG,
+    BUDGET_BACKFILL,         // flash records written while offline or before a reset
+    BUDGET_TRACE,            // event trace dump, on request
+    BUDGET_COUNT
+} budget_t;
+// empty options keep the IoT Hub, the host is taken from the URI by mqtt_start()
+#define PRIMARY_URI         ((sizeof(CONFIG_MQTT_PRIMARY_URI) > 1) ? CONFIG_MQTT_PRIMARY_URI : MQTT_HOST)
+#define PRIMARY_USERNAME    ((sizeof(CONFIG_MQTT_PRIMARY_USERNAME) > 1) ? CONFIG_MQTT_PRIMARY_USERNAME : MQTT_USERNAME)
+#define PRIMARY_ENDPOINT    { "primary", PRIMARY_URI, NULL, CONFIG_MQTT_PRIMARY_PORT, PRIMARY_USERNAME, MQTT_PASSWORD }
+#define EDGE_ENDPOINT       { "edge", "mqtt://" CONFIG_MQTT_EDGE_HOST, CONFIG_MQTT_EDGE_HOST, CONFIG_MQTT_EDGE_PORT, \
+                              CONFIG_MQTT_EDGE_USERNAME, CONFIG_MQTT_EDGE_PASSWORD }
+#ifdef CONFIG_MQTT_PERSISTENT_OUTBOX
+typedef enum {
+    SLOT_FREE,
+    SLOT_SENT,               // replayed, waiting for the PUBACK
+    SLOT_ACKED,              // PUBACK received, flash not updated yet
+    SLOT_RETRY               // PUBACK timed out, replayed again from its place in flash
+} slot_state_t;
+/**
+ * @brief msg_id of a replayed record, to find it again on PUBACK
+ */
+typedef struct {
+    int msg_id;
+    uint32_t addr;
+    uint32_t seq;
+    uint32_t sent_ms;
+    slot_state_t state;
+} persist_slot_t;
+/**
+ * @brief PUBACK that matched no slot, it may belong to the publish being recorded
+ */
+typedef struct {
+    int msg_id;
+    uint32_t ms;
+} early_ack_t;
+#endif
 // ------ Private function prototypes -------------------------
+static void __publisher_task(void *pvParameter);
+static void __diagnostics(void);
+#ifdef CONFIG_MQTT_PERSISTENT_OUTBOX
+static bool __flash_read(void *ctx, uint32_t addr, void *buf, uint32_t len);
+static bool __flash_write(void *ctx, uint32_t addr, const void *buf, uint32_t len);
+static bool __flash_erase(void *ctx, uint32_t addr);
+static void __persist_puback(int msg_id);
+static bool __persist_idle(void);
+#endif
 // ------ Private variables -----------------------------------
 /** @brief tag used for ESP serial console messages */
 static const char *TAG = "MQTT";
 esp_mqtt_client_handle_t _client;
 uint8_t MQTT_CONNECTED_FLAG = 0;
+static int _inflight = 0; // QoS>0 publishes not acknowledged yet, atomic: a PUBACK can be counted first
+static xQueueHandle _outbox = NULL;       // telemetry
+static xQueueHandle _diag_outbox = NULL;  // the diagnostics budget, its head must not hold telemetry back
+static portMUX_TYPE _stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static mqtt_outbox_stats_t _stats;
+static uint64_t _enqueue_us_sum = 0;
+static uint64_t _wait_ms_sum = 0;
+static uint64_t _publish_us_sum = 0;
+static puback_table_t _puback;  // guarded by _stats_mux
+static uint32_t _diag_due_ms = DIAG_PERIOD_MS;
+static bool _boot_reported = false;
+static uint32_t _wear_due_ms = WEAR_CHECKPOINT_MS;
+static uint32_t _sys_due_ms = SYS_PERIOD_MS;
+static sysmon_t _sysmon;        // publisher task only, too big for its stack
+static char _report[MQTT_OUTBOX_MSG_LEN + 1];  // publisher task only, boot, sys and trace records are built here
+#ifdef CONFIG_TRACE_ENABLE
+_Static_assert(TRACE_LINE_LEN - 1 <= MQTT_OUTBOX_MSG_LEN, "a trace line must fit an outbox slot");
+static volatile bool _trace_requested = false;
+static bool _trace_dumping = false;
+static trace_dump_t _trace_dump;  // publisher task only
+#endif
+#ifdef CONFIG_MQTT_RATE_LIMIT
+static token_bucket_t _budgets[BUDGET_COUNT];  // publisher task only
+#endif
+static bool _head_throttled = false;
+static bool _diag_throttled = false;
+static mqtt_connect_stats_t _connect;   // MQTT task only
+static uint8_t _reconnect_attempts = 0;
+/** @brief the preferred broker comes first, the client moves down the list when it cannot connect */
+static endpoint_t _endpoints[] = {
+#if defined(CONFIG_MQTT_EDGE_BROKER) && defined(CONFIG_MQTT_EDGE_FIRST)
+    EDGE_ENDPOINT,
+    PRIMARY_ENDPOINT,
+#elif defined(CONFIG_MQTT_EDGE_BROKER)
+    PRIMARY_ENDPOINT,
+    EDGE_ENDPOINT,
+#else
+    PRIMARY_ENDPOINT,
+#endif
+};
+#define ENDPOINT_COUNT      (sizeof(_endpoints) / sizeof(_endpoints[0]))
+static store_broker_t _brokers[ENDPOINT_COUNT];  // from the config store, replace the menuconfig brokers
+static char _primary_host[64];
+static uint8_t _endpoint = 0;            // index in _endpoints, written by the MQTT task only
+static uint8_t _endpoint_attempts = 0;   // failed attempts on the current endpoint
+static uint32_t _failback_due_ms = 0;    // written by the MQTT task, read by the probe task
+static int _switch_to = SWITCH_NONE;     // broker switch asked by another task, applied by the MQTT task
+static int64_t _switch_since_us = 0;     // rebind: route changed at, published by _switch_to
+static int64_t _rebind_us = 0;  // default route changed at, 0 if no rebind is pending, atomic: set by the event loop
+static int64_t _rebinding_us = 0;        // MQTT task: rebind in progress since
+static int64_t _connect_start_us = 0;
+static int64_t _session_start_us = 0;
+static uint64_t _handshake_ms_sum = 0;
+#if defined(CONFIG_FREERTOS_USE_TRACE_FACILITY) && defined(CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+static uint32_t _connect_start_cpu = 0;
+#endif
+#ifdef CONFIG_MQTT_PERSISTENT_OUTBOX
+/** @note the ring and the flash are only touched by the publisher task */
+static flash_ring_io_t _ring_io = {
+    .read = __flash_read,
+    .write = __flash_write,
+    .erase = __flash_erase,
+    .sector_size = SPI_FLASH_SEC_SIZE,
+};
+static flash_ring_t _ring;
+static bool _ring_ok = false;
+static persist_slot_t _slots[PERSIST_WINDOW];  // state guarded by _stats_mux
+static early_ack_t _early_acks[PERSIST_WINDOW];   // guarded by _stats_mux, msg_id 0 is empty
+static uint8_t _early_next = 0;
+static outbox_msg_t _replay_msg;
+static uint8_t _replay_attempts = 0;
+static bool _replay_throttled = false;
+static bool _live = false;         // connected, as seen by the publisher task
+static uint32_t _live_seq = 0;     // records below this one are backfill
+static uint64_t _persist_us_sum = 0;
+#endif
 // ------ PUBLIC variable definitions -------------------------
-extern const uint8_t cert_pem_start[]   asm("_binary_cert_pem_start");
-extern const uint8_t cert_pem_end[]     asm("_binary_cert_pem_end");
+/**
+ * @brief broker CA, CONFIG_MQTT_CA_FILE, by default the DER form of ssl/cert.pem
+ * @note loaded once into the esp-tls global CA store, so connects skip the PEM decode and parse
+ */
+extern const uint8_t cert_der_start[]   asm("_binary_cert_der_start");
+extern const uint8_t cert_der_end[]     asm("_binary_cert_der_end");
+/** @brief kept for esp_mqtt_set_config(), which takes the whole configuration */
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+static esp_mqtt_client_config_t _mqtt_cfg = {
+    // uri, port, username and password come from _endpoints
+    .session.last_will = {
+        .topic = LWT_TOPIC,
+        .msg = "0",
+        .msg_len = 1,
+        .qos = 1,
+        .retain = 0,
+    },
+    .session.keepalive = 120,
+#ifdef MQTT_V5
+    .session.protocol_ver = MQTT_PROTOCOL_V_5,
+#endif
+    .credentials.client_id = CONFIG_DEVICEID,
+    .broker.verification.use_global_ca_store = true,
+    .network.reconnect_timeout_ms = RECONNECT_MIN_MS,
+};
+#else
+static esp_mqtt_client_config_t _mqtt_cfg = {
+    // .host = CONFIG_BROKER_HOST,
+    // .port = CONFIG_BROKER_PORT,
+    // .username = CONFIG_MQTT_USERNAME,
+    // .password = CONFIG_MQTT_PASSWORD,
+    // uri, port, username and password come from _endpoints
+    .lwt_topic = LWT_TOPIC,
+    .lwt_msg = "0",
+    .lwt_msg_len = 1,
+    .lwt_qos = 1,
+    .lwt_retain = 0,
+    .keepalive = 120,
+    .client_id = CONFIG_DEVICEID,
+    .use_global_ca_store = true,
+    .reconnect_timeout_ms = RECONNECT_MIN_MS,
+};
+#endif
+#ifdef MQTT_V5
+static char _aliases[TOPIC_ALIASES + 1][MQTT_TOPIC_MAX_LEN];  // publisher task only, _aliases[n] is alias n
+static uint8_t _alias_count = 0;
+static uint8_t _alias_limit = TOPIC_ALIASES;  // lowered when the broker allows fewer, per connection
+static bool _alias_reset = false;             // set on connect, aliases only live as long as the connection
+#endif
 //--------------------------------------------------------------
 // FUNCTION DEFINITIONS
 //--------------------------------------------------------------
+/**
+ * @brief exponential backoff with equal jitter: half the step is fixed, half is random,
+ *        so a fleet that lost the broker together does not come back in lockstep
+ */
+static uint32_t __backoff_step(uint8_t attempt)
+{
+    uint32_t step = RECONNECT_MIN_MS;
+    while (attempt-- && step < RECONNECT_MAX_MS) step *= 2;
+    return (step > RECONNECT_MAX_MS) ? RECONNECT_MAX_MS : step;
+}
+static uint32_t __backoff_ms(uint8_t attempt)
+{
+    uint32_t step = __backoff_step(attempt);
+    return step / 2 + esp_random() % (step / 2 + 1);
+}
+/**
+ * @brief run time of the calling task, the MQTT task does the TLS handshake
+ */
+static uint32_t __task_cpu(void)
+{
+#if defined(CONFIG_FREERTOS_USE_TRACE_FACILITY) && defined(CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+    TaskStatus_t status;
+    vTaskGetInfo(xTaskGetCurrentTaskHandle(), &status, pdFALSE, eRunning);
+    return status.ulRunTimeCounter;
+#else
+    return 0;
+#endif
+}
+/**
+ * @brief resolve the broker ahead of the client and time it
+ * @note the lwIP DNS table keeps the answer, so the lookup inside esp-tls is a cache hit
+ *       and the rest of the connect time is TCP, TLS and CONNACK only
+ */
+static void __resolve_broker(void)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *res = NULL;
+    int err = getaddrinfo(_endpoints[_endpoint].host, NULL, &hints, &res);
+    if (err || !res) ESP_LOGW(TAG, "DNS lookup failed: %d", err);
+    if (res) freeaddrinfo(res);
+    _session_start_us = esp_timer_get_time();
+    _connect.dns_ms_last = (_session_start_us - _connect_start_us) / 1000;
+}
+/**
+ * @brief time the connection: DNS, then TCP, TLS handshake and MQTT CONNECT/CONNACK
+ * @note every connect is a full TLS handshake: the esp-mqtt transport builds a new SSL
+ *       context each time and takes no esp_tls_client_session_t, so a session ticket
+ *       cannot be carried over from the last connection
+ */
+static void __connect_done(void)
+{
+    int64_t now_us = esp_timer_get_time();
+    uint32_t handshake_ms = (now_us - _connect_start_us) / 1000;
+    _connect.connects++;
+    _connect.session_ms_last = (now_us - _session_start_us) / 1000;
+    _connect.handshake_ms_last = handshake_ms;
+    if (!_connect.boot_connect_ms)
+    {
+        _connect.boot_connect_ms = now_us / 1000;
+        boot_end(BOOT_MQTT);
+        boot_begin(BOOT_PUBLISH);
+    }
+    if (_connect.connects == 1 || handshake_ms < _connect.handshake_ms_min) _connect.handshake_ms_min = handshake_ms;
+    if (handshake_ms > _connect.handshake_ms_max) _connect.handshake_ms_max = handshake_ms;
+    _handshake_ms_sum += handshake_ms;
+    _connect.handshake_ms_avg = _handshake_ms_sum / _connect.connects;
+#if defined(CONFIG_FREERTOS_USE_TRACE_FACILITY) && defined(CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+    _connect.handshake_cpu_last = __task_cpu() - _connect_start_cpu;
+#endif
+    ESP_LOGW(TAG, "Connected in %u ms (dns %u, tcp+tls+connack %u)",
+             handshake_ms, _connect.dns_ms_last, _connect.session_ms_last);
+    if (_rebinding_us)
+    {
+        _connect.rebind_ms_last = (now_us - _rebinding_us) / 1000;
+        _rebinding_us = 0;
+        ESP_LOGW(TAG, "Back online %u ms after the interface change", _connect.rebind_ms_last);
+    }
+}
+/**
+ * @brief pick the delay esp-mqtt waits after the next lost connection
+ * @note esp-mqtt copies reconnect_timeout_ms when a connection is lost, before the
+ *       DISCONNECTED event: the wait in progress was picked by the previous call,
+ *       the one picked here only starts at the following disconnect
+ * @return the wait in progress
+ */
+static uint32_t __schedule_reconnect(uint8_t attempt)
+{
+    uint32_t waiting_ms = _mqtt_cfg.CFG_RECONNECT_MS;
+    uint32_t step = __backoff_step(attempt);
+    // a delay already drawn for this step is kept, esp_mqtt_set_config() copies the whole configuration.
+    // Only the delay is skipped here, __use_endpoint() always pushes a new broker
+    if (waiting_ms < step / 2 || waiting_ms > step)
+    {
+        _mqtt_cfg.CFG_RECONNECT_MS = __backoff_ms(attempt);
+        esp_mqtt_set_config(_client, &_mqtt_cfg);
+    }
+    _connect.reconnect_ms = _mqtt_cfg.CFG_RECONNECT_MS;
+    return waiting_ms;
+}
+/**
+ * @brief brokers saved in the config store replace the menuconfig ones at the same place
+ * @note copied, so a later commit does not change a URI under the client
+ */
+static void __load_brokers(void)
+{
+    const config_store_t *config = config_get();
+    for (uint8_t i = 0; i < ENDPOINT_COUNT && i < STORE_BROKERS_MAX; i++)
+    {
+        if (config->brokers[i].uri[0] == '\0') continue;
+        _brokers[i] = config->brokers[i];
+        _endpoints[i].uri = _brokers[i].uri;
+        _endpoints[i].host = _brokers[i].host;
+        _endpoints[i].port = _brokers[i].port;
+        ESP_LOGW(TAG, "Broker %u from the config store: %s", i, _brokers[i].uri);
+    }
+}
+/**
+ * @brief host part of scheme://host[:port][/path], probed and resolved on its own
+ */
+static void __uri_host(const char *uri, char *host, size_t size)
+{
+    const char *start = strstr(uri, "://");
+    start = start ? start + 3 : uri;
+    size_t len = strcspn(start, ":/");
+    if (len >= size) len = size - 1;
+    memcpy(host, start, len);
+    host[len] = '\0';
+}
+/**
+ * @brief point the client at another broker, it is used from the next connection attempt
+ * @note MQTT task only, or before the client is started
+ */
+static void __use_endpoint(uint8_t index)
+{
+    const endpoint_t *ep = &_endpoints[index];
+    __atomic_store_n(&_endpoint, index, __ATOMIC_RELAXED);
+    _endpoint_attempts = 0;
+    __atomic_store_n(&_failback_due_ms, (uint32_t)(esp_timer_get_time() / 1000) + FAILBACK_PERIOD_MS, __ATOMIC_RELAXED);
+    _connect.endpoint = index;
+    _mqtt_cfg.CFG_URI = ep->uri;
+    _mqtt_cfg.CFG_PORT = ep->port;
+    _mqtt_cfg.CFG_USERNAME = ep->username;
+    _mqtt_cfg.CFG_PASSWORD = ep->password;
+    // esp_mqtt_client_set_uri() leaves the credentials, and the port of a URI without one
+    if (_client) esp_mqtt_set_config(_client, &_mqtt_cfg);
+}
+/**
+ * @brief health probe: can a TCP connection to the broker be opened
+ */
+static bool __probe(const endpoint_t *ep)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *res = NULL;
+    char port[6];
+    snprintf(port, sizeof(port), "%u", ep->port);
+    if (getaddrinfo(ep->host, port, &hints, &res) || !res) return false;
+
+    bool up = false;
+    int sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (sock >= 0)
+    {
+        fcntl(sock, F_SETFL, O_NONBLOCK);
+        if (connect(sock, res->ai_addr, res->ai_addrlen) == 0) up = true;
+        else if (errno == EINPROGRESS)
+        {
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(sock, &fds);
+            struct timeval timeout = {
+                .tv_sec = PROBE_TIMEOUT_MS / 1000,
+                .tv_usec = (PROBE_TIMEOUT_MS % 1000) * 1000,
+            };
+            int err = 0;
+            socklen_t len = sizeof(err);
+            up = select(sock + 1, NULL, &fds, NULL, &timeout) == 1
+                 && getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0;
+        }
+        close(sock);
+    }
+    freeaddrinfo(res);
+    return up;
+}
+/**
+ * @brief ask the MQTT task to move to a broker and connect at once, from any other task
+ * @note a live connection is closed, MQTT_EVENT_BEFORE_CONNECT then applies the switch
+ */
+static void __request_switch(int endpoint, int64_t since_us)
+{
+    __atomic_store_n(&_switch_since_us, since_us, __ATOMIC_RELAXED);
+    __atomic_store_n(&_switch_to, endpoint, __ATOMIC_RELEASE);
+    if (MQTT_CONNECTED_FLAG) esp_mqtt_client_disconnect(_client);
+    else esp_mqtt_client_reconnect(_client);  // cut the backoff wait short, if there is one
+}
+/**
+ * @brief apply a switch asked by another task, MQTT task only
+ */
+static void __apply_switch(void)
+{
+    int to = __atomic_exchange_n(&_switch_to, SWITCH_NONE, __ATOMIC_ACQUIRE);
+    if (to == SWITCH_NONE) return;
+    int64_t since_us = __atomic_load_n(&_switch_since_us, __ATOMIC_RELAXED);
+    if (since_us) _rebinding_us = since_us;
+    if (to != SWITCH_STAY) __use_endpoint(to);
+    _reconnect_attempts = 0;
+    _endpoint_attempts = 0;
+    __schedule_reconnect(0);
+}
+/**
+ * @brief while on a fallback broker, probe the preferred one and go back to it once it answers
+ * @note own task: the probe blocks on DNS and on a TCP connect for up to PROBE_TIMEOUT_MS
+ */
+static void __probe_task(void *pvParameter)
+{
+    for (;;)
+    {
+        vTaskDelay(PROBE_POLL_MS / portTICK_PERIOD_MS);
+        uint32_t now_ms = esp_timer_get_time() / 1000;
+        if (__atomic_load_n(&_endpoint, __ATOMIC_RELAXED) == 0 || !MQTT_CONNECTED_FLAG ||
+            (int32_t)(now_ms - __atomic_load_n(&_failback_due_ms, __ATOMIC_RELAXED)) < 0) continue;
+        __atomic_store_n(&_failback_due_ms, now_ms + FAILBACK_PERIOD_MS, __ATOMIC_RELAXED);
+        if (!__probe(&_endpoints[0])) continue;
+
+        ESP_LOGW(TAG, "The %s broker answers again, switching back", _endpoints[0].name);
+        __request_switch(0, 0);
+    }
+}
+/**
+ * @brief the default route moved to another interface, the old socket is bound to a dead address
+ */
+static void __rebind(void)
+{
+    // read and clear at once, a rebind signalled in between is not lost
+    int64_t since_us = __atomic_exchange_n(&_rebind_us, 0, __ATOMIC_ACQ_REL);
+    if (since_us == 0) return;
+    if (_client == NULL) return; // prepared but not started, the first connection uses the new route
+    ESP_LOGW(TAG, "Network interface changed, reconnecting");
+    __request_switch(SWITCH_STAY, since_us);
+}
 /**
  * @brief MQTT event handler
  * @note mostly used for subscribe topic handling
@@ -49,13 +566,56 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
             ESP_LOGW(TAG, "MQTT Connected!");
             led_lit();
             MQTT_CONNECTED_FLAG = 1;
-            esp_mqtt_client_publish(client, LWT_TOPIC, "1", 0, 1, 0); //client, topic, data, len, qos, retain  
+            __connect_done();
+            _reconnect_attempts = 0;
+            _endpoint_attempts = 0;
+            __schedule_reconnect(0);
+#ifdef MQTT_V5
+            __atomic_store_n(&_alias_reset, true, __ATOMIC_RELAXED);
+            // the publisher may have set its properties and not published yet: the LWT must
+            // not take its alias, this task holds the client lock until the publish below
+            esp_mqtt5_client_set_publish_property(client, &(esp_mqtt5_publish_property_config_t){ 0 });
+#endif
+            portENTER_CRITICAL(&_stats_mux);
+            puback_reconnected(&_puback);
+            portEXIT_CRITICAL(&_stats_mux);
+            // its PUBACK comes through MQTT_EVENT_PUBLISHED like any other, it is not unmatched
+            int lwt_id = esp_mqtt_client_publish(client, LWT_TOPIC, "1", 0, 1, 0); //client, topic, data, len, qos, retain
+            if (lwt_id > 0)
+            {
+                __atomic_fetch_add(&_inflight, 1, __ATOMIC_RELAXED);
+                portENTER_CRITICAL(&_stats_mux);
+                puback_sent(&_puback, lwt_id, esp_timer_get_time() / 1000);
+                portEXIT_CRITICAL(&_stats_mux);
+            }
             esp_mqtt_client_subscribe(client, CMD_TOPIC, 1); //client, topic, qos
+            command_subscribe_all();
             break;
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "MQTT Disconnected!");
             led_blink();
             MQTT_CONNECTED_FLAG = 0;
+            if (__atomic_load_n(&_switch_to, __ATOMIC_ACQUIRE) != SWITCH_NONE)
+            {
+                // closed by __request_switch(), not a failure
+                esp_mqtt_client_reconnect(client);
+                break;
+            }
+            _connect.failures++;
+            if (_reconnect_attempts < UINT8_MAX) _reconnect_attempts++;
+            if (ENDPOINT_COUNT > 1 && ++_endpoint_attempts >= FAILOVER_ATTEMPTS)
+            {
+                __use_endpoint((_endpoint + 1) % ENDPOINT_COUNT);
+                _connect.failovers++;
+                ESP_LOGW(TAG, "Failing over to the %s broker", _endpoints[_endpoint].name);
+                __schedule_reconnect(_reconnect_attempts <= FAILOVER_ATTEMPTS ? 0 : _reconnect_attempts);
+                // the wait in progress was picked before this event, the first failover
+                // of an outage skips it, after that the backoff goes on
+                if (_reconnect_attempts <= FAILOVER_ATTEMPTS) esp_mqtt_client_reconnect(client);
+                break;
+            }
+            ESP_LOGW(TAG, "Reconnect attempt %u in %u ms", _reconnect_attempts,
+                     __schedule_reconnect(_reconnect_attempts));
             break;
         case MQTT_EVENT_SUBSCRIBED:
             ESP_LOGW(TAG, " - Subscribed, msg_id=%d", event->msg_id);
@@ -64,11 +624,22 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
             ESP_LOGW(TAG, " - Unsubscribed, msg_id=%d", event->msg_id);
             break;
         case MQTT_EVENT_PUBLISHED:
-            ESP_LOGW(TAG, " - Published, msg_id=%d", event->msg_id);
+            DLOGD(TAG, " - Published, msg_id=%d", event->msg_id);
+            __atomic_fetch_sub(&_inflight, 1, __ATOMIC_RELAXED);  // may go below 0 until the publisher counts it
+            portENTER_CRITICAL(&_stats_mux);
+            puback_acked(&_puback, event->msg_id, esp_timer_get_time() / 1000);
+            portEXIT_CRITICAL(&_stats_mux);
+#ifdef CONFIG_MQTT_PERSISTENT_OUTBOX
+            __persist_puback(event->msg_id);
+#endif
             break;
         case MQTT_EVENT_DATA:
-            ESP_LOGW(TAG, "Cmd Received from: %.*s", event->topic_len, event->topic);
-            ESP_LOGW(TAG, " - Cmd: %.*s", event->data_len, event->data);
+            if (event->current_data_offset == 0)
+            {
+                ESP_LOGW(TAG, "Cmd Received from: %.*s", event->topic_len, event->topic);
+            }
+            command_on_data(event->topic, event->topic_len, event->data, event->data_len,
+                            event->current_data_offset, event->total_data_len);
             break;
         case MQTT_EVENT_ERROR:
             ESP_LOGI(TAG, "MQTT event Error!");
@@ -76,6 +647,12 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
             break;
         case MQTT_EVENT_BEFORE_CONNECT:
             ESP_LOGI(TAG, "MQTT event before connect");
+            __apply_switch();
+            _connect_start_us = esp_timer_get_time();
+#if defined(CONFIG_FREERTOS_USE_TRACE_FACILITY) && defined(CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+            _connect_start_cpu = __task_cpu();
+#endif
+            __resolve_broker();
             break;
         default:
             break;
@@ -102,37 +679,850 @@ int mqtt_unsub(const char *topic)
 int mqtt_pub(const char *topic, const char *data, int qos, int retain)
 {
     if (MQTT_CONNECTED_FLAG){
+        uint32_t sent_ms = esp_timer_get_time() / 1000;
         int msg_id = esp_mqtt_client_publish(_client, topic, data, 0, qos, retain); //client, topic, data, len, qos, retain  
-        ESP_LOGW(TAG, "Publishing to: %.*s", strlen(topic), topic);
-        ESP_LOGW(TAG, " - Data: %.*s", strlen(data), data);
+        if (qos > 0 && msg_id > 0)
+        {
+            __atomic_fetch_add(&_inflight, 1, __ATOMIC_RELAXED);
+            portENTER_CRITICAL(&_stats_mux);
+            puback_sent(&_puback, msg_id, sent_ms);
+            portEXIT_CRITICAL(&_stats_mux);
+        }
+#ifdef CONFIG_MQTT_LOG_PUBLISH
+        DLOGW(TAG, "Publishing to: %.*s", strlen(topic), topic);
+        DLOGW(TAG, " - Data: %.*s", strlen(data), data);
+#endif
         return msg_id;
     }
     return -1;
 }
-esp_err_t mqtt_start(void)
+/**
+ * @brief messages queued apart from telemetry, on the diagnostics or the trace budget
+ */
+static bool __diag_topic(const char *topic)
+{
+    return !strcmp(topic, DIAG_TOPIC) || !strcmp(topic, SYS_TOPIC) || !strcmp(topic, TRACE_TOPIC) ||
+           !strcmp(topic, BOOT_TOPIC);
+}
+static budget_t __diag_budget(const char *topic)
 {
-    esp_mqtt_client_config_t mqtt_cfg = {
-        // .host = CONFIG_BROKER_HOST,
-        // .port = CONFIG_BROKER_PORT,
-        // .username = CONFIG_MQTT_USERNAME,
-        // .password = CONFIG_MQTT_PASSWORD,
-        .uri = MQTT_HOST,
-        .port = 8883,
-        .username = MQTT_USERNAME,
-        .password = MQTT_PASSWORD,
-        .lwt_topic = LWT_TOPIC,
-        .lwt_msg = "0",
-        .lwt_msg_len = 1,
-        .lwt_qos = 1,
-        .lwt_retain = 0,
-        .keepalive = 120,
-        .client_id = CONFIG_DEVICEID,
-        .cert_pem = (const char *)cert_pem_start,
+    return strcmp(topic, TRACE_TOPIC) ? BUDGET_DIAG : BUDGET_TRACE;
+}
+/**
+ * @brief copy a message into the outbox, never blocks nor logs (public)
+ */
+mqtt_pub_status_t mqtt_enqueue_len(const char *topic, size_t topic_len,
+                                   const char *data, size_t data_len, int qos, int retain)
+{
+    int64_t start_us = esp_timer_get_time();
+    TRACE_BEGIN(TRACE_MQTT_ENQUEUE, data_len);
+    if (_outbox == NULL || topic_len >= MQTT_TOPIC_MAX_LEN || data_len > MQTT_OUTBOX_MSG_LEN)
+    {
+        portENTER_CRITICAL(&_stats_mux);
+        _stats.dropped++;
+        portEXIT_CRITICAL(&_stats_mux);
+        TRACE_END(TRACE_MQTT_ENQUEUE, MQTT_PUB_DROPPED);
+        return MQTT_PUB_DROPPED;
+    }
 
+    outbox_msg_t msg = {
+        .enqueued_us = start_us,
+        .data_len = data_len,
+        .qos = qos,
+        .retain = retain,
     };
-    _client = esp_mqtt_client_init(&mqtt_cfg);
+    memcpy(msg.topic, topic, topic_len);
+    msg.topic[topic_len] = '\0';
+    memcpy(msg.data, data, data_len);
+    xQueueHandle queue = __diag_topic(msg.topic) ? _diag_outbox : _outbox;
+    mqtt_pub_status_t status = MQTT_PUB_DROPPED;
+    if (xQueueSend(queue, &msg, 0) == pdTRUE)
+    {
+        status = (uxQueueMessagesWaiting(_outbox) > OUTBOX_HIGH_WATER) ? MQTT_PUB_DEFERRED : MQTT_PUB_ACCEPTED;
+    }
+
+    uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start_us);
+    uint16_t depth = uxQueueMessagesWaiting(queue);
+    portENTER_CRITICAL(&_stats_mux);
+    if (status == MQTT_PUB_ACCEPTED)      _stats.accepted++;
+    else if (status == MQTT_PUB_DEFERRED) _stats.deferred++;
+    else                                  _stats.dropped++;
+    if (depth > _stats.depth_max)         _stats.depth_max = depth;
+    if (elapsed_us > _stats.enqueue_us_max) _stats.enqueue_us_max = elapsed_us;
+    _enqueue_us_sum += elapsed_us;
+    portEXIT_CRITICAL(&_stats_mux);
+    TRACE_END(TRACE_MQTT_ENQUEUE, status);
+    return status;
+}
+/**
+ * @brief null terminated variant of mqtt_enqueue_len() (public)
+ */
+mqtt_pub_status_t mqtt_enqueue(const char *topic, const char *data, int qos, int retain)
+{
+    return mqtt_enqueue_len(topic, strlen(topic), data, strlen(data), qos, retain);
+}
+/**
+ * @brief copy the outbox counters (public)
+ */
+void mqtt_outbox_stats(mqtt_outbox_stats_t *stats)
+{
+    portENTER_CRITICAL(&_stats_mux);
+    *stats = _stats;
+    uint32_t enqueued = _stats.accepted + _stats.deferred;
+    stats->enqueue_us_avg = enqueued ? (uint32_t)(_enqueue_us_sum / enqueued) : 0;
+    stats->wait_ms_avg = _stats.sent ? (uint32_t)(_wait_ms_sum / _stats.sent) : 0;
+    stats->publish_us_avg = _stats.sent ? (uint32_t)(_publish_us_sum / _stats.sent) : 0;
+    portEXIT_CRITICAL(&_stats_mux);
+    stats->depth = _outbox ? uxQueueMessagesWaiting(_outbox) + uxQueueMessagesWaiting(_diag_outbox) : 0;
+#ifdef CONFIG_MQTT_PERSISTENT_OUTBOX
+    stats->persist_us_avg = stats->persisted ? (uint32_t)(_persist_us_sum / stats->persisted) : 0;
+    stats->flash_pending = _ring.pending;
+    stats->flash_lost = _ring.lost;
+    stats->write_amp_pct = flash_ring_write_amp(&_ring);
+#endif
+}
+/**
+ * @brief reconnect through the new default interface, handled by the publisher task (public)
+ */
+void mqtt_rebind(void)
+{
+    __atomic_store_n(&_rebind_us, esp_timer_get_time(), __ATOMIC_RELEASE);
+}
+/**
+ * @brief copy the connection counters (public)
+ */
+void mqtt_connect_stats(mqtt_connect_stats_t *stats)
+{
+    *stats = _connect;
+}
+/**
+ * @brief copy the PUBACK counters and the latency percentiles of the current window (public)
+ */
+void mqtt_puback_stats(puback_stats_t *stats)
+{
+    portENTER_CRITICAL(&_stats_mux);
+    puback_stats(&_puback, stats, false);
+    portEXIT_CRITICAL(&_stats_mux);
+}
+/**
+ * @brief request a trace dump, the publisher task sends it (public)
+ */
+esp_err_t mqtt_trace_dump(void)
+{
+#ifdef CONFIG_TRACE_ENABLE
+    if (_outbox == NULL) return ESP_ERR_INVALID_STATE;
+    _trace_requested = true;
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+/**
+ * @brief log the wear of every flash area and save the erase counts, every checkpoint period
+ */
+static void __wear_checkpoint(uint32_t now_ms)
+{
+    if ((int32_t)(now_ms - _wear_due_ms) < 0) return;
+    _wear_due_ms = now_ms + WEAR_CHECKPOINT_MS;
+    for (uint8_t i = 0; i < WEAR_AREAS; i++)
+    {
+        const flash_wear_t *wear = flash_wear(i);
+        if (wear->sectors == 0) continue;
+        ESP_LOGW(TAG, "Flash %s: %llu bytes kept, %llu programmed (%u%%), %u erases, %u cycles left, %u days at this rate",
+                 wear->name, wear->logical_bytes, wear->programmed_bytes, flash_wear_amp(wear),
+                 wear->erases_before + wear->erases, flash_wear_remaining(wear),
+                 flash_wear_days_left(wear, now_ms / 1000));
+    }
+    config_wear_checkpoint();
+}
+/**
+ * @brief queue the boot timeline once, after the first publish closed it
+ */
+static void __boot_report(void)
+{
+    if (_boot_reported || !boot_done(BOOT_BIT(BOOT_PUBLISH))) return;
+    _boot_reported = true;
+
+    int len = boot_record(_report, BOOT_RECORD_LEN);
+    if (len >= BOOT_RECORD_LEN)
+    {
+        ESP_LOGE(TAG, "Boot record too long");
+        return;
+    }
+    mqtt_enqueue_len(BOOT_TOPIC, sizeof(BOOT_TOPIC) - 1, _report, len, 1, 0); //topic, data, qos, retain
+}
+/**
+ * @brief sample the tasks and the heap, log them and queue them on their own topic
+ * @note one message per group of tasks that fits in an outbox slot
+ */
+static void __sys_report(uint32_t now_ms)
+{
+    if (SYS_PERIOD_MS == 0 || (int32_t)(now_ms - _sys_due_ms) < 0) return;
+    _sys_due_ms = now_ms + SYS_PERIOD_MS;
+    if (sysmon_sample(&_sysmon) != ESP_OK) return;
+    sysmon_log(&_sysmon);
+
+    uint8_t next = 0;
+    do {
+        int len = sysmon_record(&_sysmon, &next, _report, MQTT_OUTBOX_MSG_LEN);
+        if (len == 0) break;
+        mqtt_enqueue_len(SYS_TOPIC, sizeof(SYS_TOPIC) - 1, _report, len, 0, 0); //topic, data, qos, retain
+    } while (next < _sysmon.count);
+}
+/**
+ * @brief queue the next lines of a requested trace dump, while the outbox is below half its high water mark
+ */
+static void __trace_report(void)
+{
+#ifdef CONFIG_TRACE_ENABLE
+    if (!_trace_dumping)
+    {
+        // a slow cycle may be dumping on the console, the request waits for it
+        if (!_trace_requested || !trace_dump_begin(&_trace_dump)) return;
+        _trace_requested = false;
+        _trace_dumping = true;
+    }
+    // half of the queue at most, the diagnostics and system reports keep the rest
+    while (uxQueueMessagesWaiting(_diag_outbox) < DIAG_OUTBOX_DEPTH / 2)
+    {
+        int len = trace_dump_line(&_trace_dump, _report, TRACE_LINE_LEN);
+        if (len == 0)
+        {
+            trace_dump_end(&_trace_dump);
+            _trace_dumping = false;
+            ESP_LOGW(TAG, "Trace dumped on %s", TRACE_TOPIC);
+            return;
+        }
+        mqtt_enqueue_len(TRACE_TOPIC, sizeof(TRACE_TOPIC) - 1, _report, len, 0, 0); //topic, data, qos, retain
+    }
+#endif
+}
+/**
+ * @brief expire unacknowledged publishes, and queue the periodic diagnostics message
+ * @note the percentile window restarts with every diagnostics message
+ */
+static void __diagnostics(void)
+{
+    uint32_t now_ms = esp_timer_get_time() / 1000;
+    portENTER_CRITICAL(&_stats_mux);
+    puback_expire(&_puback, now_ms, PUBACK_TIMEOUT_MS);
+    portEXIT_CRITICAL(&_stats_mux);
+    __wear_checkpoint(now_ms);
+    __sys_report(now_ms);
+    __trace_report();
+    if (DIAG_PERIOD_MS == 0) return;
+    __boot_report();
+    if ((int32_t)(now_ms - _diag_due_ms) < 0) return;
+    _diag_due_ms = now_ms + DIAG_PERIOD_MS;
+
+    puback_stats_t puback;
+    mqtt_outbox_stats_t outbox;
+    portENTER_CRITICAL(&_stats_mux);
+    puback_stats(&_puback, &puback, true);
+    portEXIT_CRITICAL(&_stats_mux);
+    mqtt_outbox_stats(&outbox);
+
+    char data[DIAG_MAX_LEN];
+    int len = snprintf(data, sizeof(data),
+                       "{depth:%u,dropped:%u,inflight:%u,p50:%u,p95:%u,p99:%u,max:%u,timeouts:%u,retx:%u,"
+                       "connects:%u,dns:%u,session:%u,boot:%u,broker:%u,throttled:%u}",
+                       outbox.depth, outbox.dropped, puback.inflight, puback.p50_ms, puback.p95_ms,
+                       puback.p99_ms, puback.max_ms, puback.timeouts, puback.retransmits,
+                       _connect.connects, _connect.dns_ms_last, _connect.session_ms_last,
+                       _connect.boot_publish_ms, _connect.endpoint, outbox.throttled);
+    // QoS 0 so the report does not measure itself
+    mqtt_enqueue_len(DIAG_TOPIC, sizeof(DIAG_TOPIC) - 1, data, len, 0, 0); //topic, data, qos, retain
+}
+/**
+ * @brief take a token from a budget, a message that has to wait is counted once
+ * @return false if the message must stay where it is for now
+ */
+static bool __budget_take(budget_t budget, bool *waiting)
+{
+#ifdef CONFIG_MQTT_RATE_LIMIT
+    if (!token_bucket_take(&_budgets[budget], esp_timer_get_time() / 1000))
+    {
+        if (!*waiting)
+        {
+            portENTER_CRITICAL(&_stats_mux);
+            _stats.throttled++;
+            portEXIT_CRITICAL(&_stats_mux);
+        }
+        *waiting = true;
+        return false;
+    }
+#endif
+    *waiting = false;
+    return true;
+}
+/**
+ * @brief the budget has a token, without taking it, a message that has to wait is counted once
+ */
+static bool __budget_ready(budget_t budget, bool *waiting)
+{
+#ifdef CONFIG_MQTT_RATE_LIMIT
+    if (token_bucket_wait_ms(&_budgets[budget], esp_timer_get_time() / 1000) > 0)
+    {
+        if (!*waiting)
+        {
+            portENTER_CRITICAL(&_stats_mux);
+            _stats.throttled++;
+            portEXIT_CRITICAL(&_stats_mux);
+        }
+        *waiting = true;
+        return false;
+    }
+#endif
+    return true;
+}
+/**
+ * @brief time until the budget has a token again, at most one poll period
+ */
+static TickType_t __budget_wait(budget_t budget)
+{
+    uint32_t wait_ms = DIAG_POLL_MS;
+#ifdef CONFIG_MQTT_RATE_LIMIT
+    uint32_t token_ms = token_bucket_wait_ms(&_budgets[budget], esp_timer_get_time() / 1000);
+    if (token_ms < wait_ms) wait_ms = token_ms;
+#endif
+    return wait_ms / portTICK_PERIOD_MS + 1;
+}
+#ifdef MQTT_V5
+/**
+ * @brief alias of a topic, the first topics published on a connection get one
+ * @note esp-mqtt sends the topic with a new alias once, then an empty topic
+ * @return alias, 0 for none
+ */
+static uint16_t __topic_alias(const char *topic, bool *known)
+{
+    *known = false;
+    if (__atomic_exchange_n(&_alias_reset, false, __ATOMIC_RELAXED))
+    {
+        // another broker may allow more
+        _alias_count = 0;
+        _alias_limit = TOPIC_ALIASES;
+    }
+    for (uint8_t alias = 1; alias <= _alias_count; alias++)
+    {
+        if (strcmp(_aliases[alias], topic) == 0)
+        {
+            *known = true;
+            return alias;
+        }
+    }
+    if (_alias_count >= _alias_limit) return 0;
+    strncpy(_aliases[++_alias_count], topic, sizeof(_aliases[0]) - 1);
+    return _alias_count;
+}
+/**
+ * @brief MQTT 5 properties of the next publish: topic alias, the expiry left and the
+ *        time spent queued as a user property instead of inside the payload
+ * @return user property list, deleted by the caller once published
+ * @note the client keeps them for its next publish from any task: __publish() clears them
+ *       right after its own and the connect handler before the LWT
+ */
+static esp_mqtt5_user_property_handle_t __v5_properties(const outbox_msg_t *msg, int64_t now_us, bool *aliased)
+{
+    int64_t waited_us = now_us - msg->enqueued_us;
+    esp_mqtt5_publish_property_config_t property = { 0 };
+    // the broker drops it once stale, as the outbox would have
+    if (EXPIRY_US) property.message_expiry_interval = (EXPIRY_US > waited_us) ? (EXPIRY_US - waited_us) / 1000000 + 1 : 1;
+    char queued[12];
+    snprintf(queued, sizeof(queued), "%u", (uint32_t)(waited_us / 1000));
+    esp_mqtt5_user_property_item_t item = { "queued_ms", queued };
+    esp_mqtt5_client_set_user_property(&property.user_property, &item, 1);
+
+    // the client resends an unacknowledged QoS 1 message after a reconnect, when the
+    // broker has forgotten the alias: only QoS 0 goes out once, on this connection
+    if (msg->qos == 0) property.topic_alias = __topic_alias(msg->topic, aliased);
+    if (esp_mqtt5_client_set_publish_property(_client, &property) != ESP_OK && property.topic_alias)
+    {
+        // over the topic alias maximum of the CONNACK, the client checks it
+        ESP_LOGW(TAG, "Broker refused topic alias %u, %u kept", property.topic_alias, property.topic_alias - 1);
+        _alias_limit = _alias_count = property.topic_alias - 1;
+        property.topic_alias = 0;
+        *aliased = false;
+        esp_mqtt5_client_set_publish_property(_client, &property);
+    }
+    return property.user_property;
+}
+#endif
+/**
+ * @brief size of the PUBLISH packet on the wire (MQTT 3.1.1)
+ * @note with MQTT 5 properties come on top, a known topic alias leaves the topic out
+ */
+static uint32_t __wire_len(uint32_t topic_len, uint32_t data_len, int qos)
+{
+    uint32_t remaining = 2 + topic_len + (qos > 0 ? 2 : 0) + data_len;  // topic length, topic, packet id, payload
+    uint32_t header = 2;                                               // type and flags, one length byte
+    for (uint32_t len = remaining; len > 127; len >>= 7) header++;
+    return header + remaining;
+}
+/**
+ * @brief hand one message to the MQTT client and account for it
+ * @return msg_id, negative if the client refused it
+ */
+static int __publish(const outbox_msg_t *msg)
+{
+    int64_t start_us = esp_timer_get_time();
+    TRACE_BEGIN(TRACE_MQTT_PUBLISH, msg->data_len);
+    bool aliased = false;
+#ifdef MQTT_V5
+    esp_mqtt5_user_property_handle_t user_property = __v5_properties(msg, start_us, &aliased);
+#endif
+    int msg_id;
+#ifdef CLIENT_ENQUEUE
+    // a QoS 1 message sits in the client outbox until its PUBACK either way, queued
+    // there the MQTT task writes it and this task never waits on the socket
+    if (msg->qos > 0)
+        msg_id = esp_mqtt_client_enqueue(_client, msg->topic, msg->data, msg->data_len, msg->qos, msg->retain, true); //client, topic, data, len, qos, retain, store
+    else
+#endif
+    // QoS 0 is written at once: queued, nothing would bound the client outbox
+    msg_id = esp_mqtt_client_publish(_client, msg->topic, msg->data, msg->data_len, msg->qos, msg->retain); //client, topic, data, len, qos, retain
+#ifdef MQTT_V5
+    esp_mqtt5_client_set_publish_property(_client, &(esp_mqtt5_publish_property_config_t){ 0 });
+    esp_mqtt5_client_delete_user_property(user_property);
+#endif
+    TRACE_END(TRACE_MQTT_PUBLISH, msg_id);
+#ifdef CONFIG_MQTT_LOG_PUBLISH
+    DLOGW(TAG, "Publishing to: %s", msg->topic);
+    DLOGW(TAG, " - Data: %.*s", msg->data_len, msg->data);
+#endif
+    uint32_t publish_us = (uint32_t)(esp_timer_get_time() - start_us);
+    if (msg_id < 0) return msg_id;
+    if (msg->qos > 0 && msg_id > 0) __atomic_fetch_add(&_inflight, 1, __ATOMIC_RELAXED);
+
+    uint32_t wait_ms = (uint32_t)((start_us - msg->enqueued_us) / 1000);
+    portENTER_CRITICAL(&_stats_mux);
+    if (msg->qos > 0 && msg_id > 0) puback_sent(&_puback, msg_id, start_us / 1000);
+    _stats.sent++;
+    _stats.payload_bytes += msg->data_len;
+    _stats.wire_bytes += __wire_len(aliased ? 0 : strlen(msg->topic), msg->data_len, msg->qos);
+    if (wait_ms > _stats.wait_ms_max) _stats.wait_ms_max = wait_ms;
+    _wait_ms_sum += wait_ms;
+    if (publish_us > _stats.publish_us_max) _stats.publish_us_max = publish_us;
+    _publish_us_sum += publish_us;
+    portEXIT_CRITICAL(&_stats_mux);
+    if (!_connect.boot_publish_ms)
+    {
+        _connect.boot_publish_ms = start_us / 1000;
+        boot_end(BOOT_PUBLISH);
+    }
+#ifdef CONFIG_MQTT_PUBLISH_BENCHMARK
+    if (_stats.sent % BENCHMARK_EVERY == 0)
+    {
+        ESP_LOGW(TAG, "Publish cost over %u messages: avg %u us, max %u us (logging %s)",
+                 _stats.sent, (uint32_t)(_publish_us_sum / _stats.sent), _stats.publish_us_max,
+#ifdef CONFIG_MQTT_LOG_PUBLISH
+                 "on");
+#else
+                 "off");
+#endif
+        ESP_LOGW(TAG, "Bytes per message: %u on the wire, %u of payload",
+                 _stats.wire_bytes / _stats.sent, _stats.payload_bytes / _stats.sent);
+#ifdef CONFIG_MQTT_PERSISTENT_OUTBOX
+        ESP_LOGW(TAG, "Flash outbox: append avg %u us, max %u us, write amplification %u%%, %u erases",
+                 _stats.persisted ? (uint32_t)(_persist_us_sum / _stats.persisted) : 0, _stats.persist_us_max,
+                 flash_ring_write_amp(&_ring), _ring.erases);
+#endif
+    }
+#endif
+    return msg_id;
+}
+#ifdef CONFIG_MQTT_PERSISTENT_OUTBOX
+static bool __flash_read(void *ctx, uint32_t addr, void *buf, uint32_t len)
+{
+    return esp_partition_read((const esp_partition_t *)ctx, addr, buf, len) == ESP_OK;
+}
+static bool __flash_write(void *ctx, uint32_t addr, const void *buf, uint32_t len)
+{
+    return esp_partition_write((const esp_partition_t *)ctx, addr, buf, len) == ESP_OK;
+}
+static bool __flash_erase(void *ctx, uint32_t addr)
+{
+    return esp_partition_erase_range((const esp_partition_t *)ctx, addr, SPI_FLASH_SEC_SIZE) == ESP_OK;
+}
+/**
+ * @brief mount the flash ring, the pending records of the last run are replayed once connected
+ */
+static void __persist_init(void)
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                                ESP_PARTITION_SUBTYPE_ANY, PERSIST_PARTITION);
+    if (partition == NULL)
+    {
+        ESP_LOGE(TAG, "No \"%s\" partition, QoS 1 messages are kept in RAM only", PERSIST_PARTITION);
+        return;
+    }
+    _ring_io.ctx = (void *)partition;
+    _ring_io.size = partition->size - partition->size % SPI_FLASH_SEC_SIZE;
+    flash_wear_setup(WEAR_OUTBOX, _ring_io.size / SPI_FLASH_SEC_SIZE, CONFIG_FLASH_ENDURANCE);
+    _ring_ok = flash_ring_mount(&_ring, flash_wear_wrap(WEAR_OUTBOX, &_ring_io));
+    if (!_ring_ok) ESP_LOGE(TAG, "Flash outbox mount failed");
+    else if (_ring.pending) ESP_LOGW(TAG, "%u unacknowledged messages recovered from flash", _ring.pending);
+}
+/**
+ * @brief move a QoS 1 message from the RAM outbox to flash
+ */
+static void __persist(const outbox_msg_t *msg)
+{
+    flash_ring_msg_t record = {
+        .flags = (msg->qos & FLASH_RING_QOS_MASK) | (msg->retain ? FLASH_RING_RETAIN : 0),
+        .topic = (char *)msg->topic,
+        .topic_len = strlen(msg->topic),
+        .data = (char *)msg->data,
+        .data_len = msg->data_len,
+    };
+    int64_t start_us = esp_timer_get_time();
+    TRACE_BEGIN(TRACE_MQTT_PERSIST, record.data_len);
+    bool ok = flash_ring_append(&_ring, &record);
+    TRACE_END(TRACE_MQTT_PERSIST, ok);
+    uint32_t persist_us = (uint32_t)(esp_timer_get_time() - start_us);
+    uint32_t wait_ms = (uint32_t)((start_us - msg->enqueued_us) / 1000);
+
+    portENTER_CRITICAL(&_stats_mux);
+    if (!ok)
+    {
+        _stats.dropped++;
+    }
+    else
+    {
+        _stats.persisted++;
+        if (persist_us > _stats.persist_us_max) _stats.persist_us_max = persist_us;
+        _persist_us_sum += persist_us;
+        if (wait_ms > _stats.wait_ms_max) _stats.wait_ms_max = wait_ms;
+    }
+    portEXIT_CRITICAL(&_stats_mux);
+    if (ok) flash_wear_logical(WEAR_OUTBOX, record.topic_len + record.data_len);
+    else ESP_LOGE(TAG, "Flash outbox write failed");
+}
+/**
+ * @brief write the PUBACKs collected by the event handler to flash, retry stale slots
+ * @note a slot whose PUBACK never comes is replayed again, its late PUBACK still counts
+ */
+static void __persist_acks(void)
+{
+    uint32_t now_ms = esp_timer_get_time() / 1000;
+    for (uint8_t i = 0; i < PERSIST_WINDOW; i++)
+    {
+        persist_slot_t *slot = &_slots[i];
+        if (slot->state == SLOT_ACKED)
+        {
+            flash_ring_ack(&_ring, slot->addr, slot->seq);
+            slot->state = SLOT_FREE;
+        }
+        else if (slot->state == SLOT_SENT && now_ms - slot->sent_ms >= PUBACK_TIMEOUT_MS)
+        {
+            portENTER_CRITICAL(&_stats_mux);
+            if (slot->state == SLOT_SENT) slot->state = SLOT_RETRY;
+            portEXIT_CRITICAL(&_stats_mux);
+        }
+    }
+}
+/**
+ * @brief take a PUBACK handled before its replay was recorded, caller holds _stats_mux
+ * @note msg_ids wrap, an entry older than the PUBACK timeout is not this publish
+ */
+static bool __early_ack(int msg_id, uint32_t now_ms)
+{
+    for (uint8_t i = 0; i < PERSIST_WINDOW; i++)
+    {
+        early_ack_t *ack = &_early_acks[i];
+        if (ack->msg_id == msg_id && now_ms - ack->ms < PUBACK_TIMEOUT_MS)
+        {
+            ack->msg_id = 0;
+            return true;
+        }
+    }
+    return false;
+}
+/**
+ * @brief publish the next record of the flash ring, in order
+ * @return true if one was sent and the caller should not wait
+ */
+static bool __replay(void)
+{
+    if (!MQTT_CONNECTED_FLAG)
+    {
+        _live = false;
+        return false;
+    }
+    if (!_live)
+    {
+        _live = true;
+        _live_seq = _ring.seq;
+    }
+    persist_slot_t *slot = NULL, *retry = NULL;
+    for (uint8_t i = 0; i < PERSIST_WINDOW; i++)
+    {
+        if (_slots[i].state == SLOT_FREE && slot == NULL) slot = &_slots[i];
+        if (_slots[i].state == SLOT_RETRY && retry == NULL) retry = &_slots[i];
+    }
+
+    flash_ring_msg_t record = {
+        .topic = _replay_msg.topic,
+        .topic_size = sizeof(_replay_msg.topic),
+        .data = _replay_msg.data,
+        .data_size = sizeof(_replay_msg.data),
+    };
+    if (retry)
+    {
+        // the cursor is past it already, read it again where it lives
+        if (!flash_ring_read(&_ring, retry->addr, retry->seq, &record))
+        {
+            // acknowledged meanwhile, or its sector was reused
+            portENTER_CRITICAL(&_stats_mux);
+            if (retry->state == SLOT_RETRY) retry->state = SLOT_FREE;
+            portEXIT_CRITICAL(&_stats_mux);
+            return true;
+        }
+        slot = retry;
+    }
+    else if (slot == NULL || !flash_ring_peek(&_ring, &record))
+    {
+        return false;
+    }
+    // the ring absorbs what is over budget, the record is read again on the next poll
+    budget_t budget = (retry || record.seq < _live_seq) ? BUDGET_BACKFILL : BUDGET_TELEMETRY;
+    if (_replay_attempts == 0 && !__budget_take(budget, &_replay_throttled)) return false;
+    _replay_msg.enqueued_us = esp_timer_get_time();
+    _replay_msg.data_len = record.data_len;
+    _replay_msg.qos = record.flags & FLASH_RING_QOS_MASK;
+    _replay_msg.retain = (record.flags & FLASH_RING_RETAIN) ? 1 : 0;
+
+    int msg_id = __publish(&_replay_msg);
+    if (msg_id < 0 && ++_replay_attempts < PUBLISH_RETRIES) return false;
+    if (!retry) flash_ring_advance(&_ring, &record);
+    _replay_attempts = 0;
+    uint32_t now_ms = esp_timer_get_time() / 1000;
+
+    portENTER_CRITICAL(&_stats_mux);
+    if (msg_id <= 0)
+    {
+        // refused: stays pending in flash until the next reset
+        if (slot->state == SLOT_RETRY) slot->state = SLOT_FREE;
+    }
+    else if (slot->state != SLOT_ACKED)  // a retry may have been acknowledged late meanwhile
+    {
+        slot->msg_id = msg_id;
+        slot->addr = record.addr;
+        slot->seq = record.seq;
+        slot->sent_ms = now_ms;
+        // the MQTT task runs first: the PUBACK may be in already
+        slot->state = __early_ack(msg_id, now_ms) ? SLOT_ACKED : SLOT_SENT;
+    }
+    portEXIT_CRITICAL(&_stats_mux);
+    return true;
+}
+/**
+ * @brief called by the event handler on PUBACK, the flash write is left to the publisher task
+ */
+static void __persist_puback(int msg_id)
+{
+    portENTER_CRITICAL(&_stats_mux);
+    for (uint8_t i = 0; i < PERSIST_WINDOW; i++)
+    {
+        if ((_slots[i].state == SLOT_SENT || _slots[i].state == SLOT_RETRY) && _slots[i].msg_id == msg_id)
+        {
+            _slots[i].state = SLOT_ACKED;
+            portEXIT_CRITICAL(&_stats_mux);
+            return;
+        }
+    }
+    // may be the replay that __replay() has not recorded yet, keep it for a while
+    _early_acks[_early_next].msg_id = msg_id;
+    _early_acks[_early_next].ms = esp_timer_get_time() / 1000;
+    _early_next = (_early_next + 1) % PERSIST_WINDOW;
+    portEXIT_CRITICAL(&_stats_mux);
+}
+/**
+ * @brief nothing left to replay and nothing waiting for a PUBACK
+ */
+static bool __persist_idle(void)
+{
+    if (!_ring_ok) return true;
+    for (uint8_t i = 0; i < PERSIST_WINDOW; i++)
+    {
+        if (_slots[i].state != SLOT_FREE) return false;
+    }
+    return _ring.cursor == _ring.head;
+}
+#endif
+/**
+ * @brief peek the next message, a diagnostics message first when its budget has a token
+ * @note a diagnostics head waiting for its token stays in its queue and telemetry goes on
+ * @return the queue of the message, NULL when nothing came within wait
+ */
+static xQueueHandle __peek(outbox_msg_t *msg, TickType_t wait)
+{
+    if (xQueuePeek(_diag_outbox, msg, 0) == pdTRUE)
+    {
+        budget_t budget = __diag_budget(msg->topic);
+        if (__budget_ready(budget, &_diag_throttled)) return _diag_outbox;
+        TickType_t diag_wait = __budget_wait(budget);
+        if (diag_wait < wait) wait = diag_wait;
+    }
+    return (xQueuePeek(_outbox, msg, wait) == pdTRUE) ? _outbox : NULL;
+}
+/**
+ * @brief drain the outbox into the MQTT client, the only place that blocks on the network
+ * @note a message stays at the head of its queue while the broker is unreachable.
+ *       With the persistent outbox, QoS 1 messages go to flash first and are replayed from there.
+ */
+static void __publisher_task(void *pvParameter)
+{
+    outbox_msg_t msg;
+    xQueueHandle queue = NULL;
+    uint8_t attempts = 0;
+    for (;;)
+    {
+        __diagnostics();
+        __rebind();
+        TickType_t wait = DIAG_POLL_MS / portTICK_PERIOD_MS;
+#ifdef CONFIG_MQTT_PERSISTENT_OUTBOX
+        if (_ring_ok)
+        {
+            __persist_acks();
+            if (__replay()) continue;
+            if (_ring.cursor != _ring.head) wait = WAIT_POLL_MS / portTICK_PERIOD_MS;
+        }
+#endif
+        // a message the client refused is retried before any other
+        if (attempts == 0) queue = __peek(&msg, wait);
+        else if (xQueuePeek(queue, &msg, 0) != pdTRUE) queue = NULL;
+        if (queue == NULL) continue;
+#ifdef CONFIG_MQTT_PERSISTENT_OUTBOX
+        if (_ring_ok && msg.qos > 0)
+        {
+            xQueueReceive(queue, &msg, 0);
+            __persist(&msg);
+            continue;
+        }
+#endif
+        if (EXPIRY_US && esp_timer_get_time() - msg.enqueued_us > EXPIRY_US)
+        {
+            xQueueReceive(queue, &msg, 0);
+            attempts = 0;
+            portENTER_CRITICAL(&_stats_mux);
+            _stats.expired++;
+            portEXIT_CRITICAL(&_stats_mux);
+            continue;
+        }
+        if (!MQTT_CONNECTED_FLAG)
+        {
+            vTaskDelay(WAIT_POLL_MS / portTICK_PERIOD_MS);
+            continue;
+        }
+        // over budget: the message stays in the outbox, producers see MQTT_PUB_DEFERRED as it fills
+        bool diag = (queue == _diag_outbox);
+        budget_t budget = diag ? __diag_budget(msg.topic) : BUDGET_TELEMETRY;
+        if (attempts == 0 && !__budget_take(budget, diag ? &_diag_throttled : &_head_throttled))
+        {
+            vTaskDelay(__budget_wait(budget));
+            continue;
+        }
+        int msg_id = __publish(&msg);
+        if (msg_id < 0 && ++attempts < PUBLISH_RETRIES)
+        {
+            vTaskDelay(WAIT_POLL_MS / portTICK_PERIOD_MS);
+            continue;
+        }
+        xQueueReceive(queue, &msg, 0);
+        attempts = 0;
+        if (msg_id < 0)
+        {
+            portENTER_CRITICAL(&_stats_mux);
+            _stats.dropped++;
+            portEXIT_CRITICAL(&_stats_mux);
+        }
+    }
+}
+static bool __delivered(void)
+{
+#ifdef CONFIG_MQTT_PERSISTENT_OUTBOX
+    if (!__persist_idle()) return false;
+#endif
+    return __atomic_load_n(&_inflight, __ATOMIC_RELAXED) == 0 &&
+           uxQueueMessagesWaiting(_outbox) == 0 && uxQueueMessagesWaiting(_diag_outbox) == 0;
+}
+bool mqtt_wait_connected(uint32_t timeout_ms)
+{
+    for (uint32_t waited = 0; !MQTT_CONNECTED_FLAG && waited < timeout_ms; waited += WAIT_POLL_MS)
+    {
+        vTaskDelay(WAIT_POLL_MS / portTICK_PERIOD_MS);
+    }
+    return MQTT_CONNECTED_FLAG;
+}
+bool mqtt_wait_delivered(uint32_t timeout_ms)
+{
+    for (uint32_t waited = 0; !__delivered() && waited < timeout_ms; waited += WAIT_POLL_MS)
+    {
+        vTaskDelay(WAIT_POLL_MS / portTICK_PERIOD_MS);
+    }
+    return __delivered();
+}
+/**
+ * @brief everything that does not need the network: the CA store, the outbox and its publisher
+ * @note messages queued from here on wait in the outbox until the client connects
+ */
+esp_err_t mqtt_prepare(void)
+{
+    if (_outbox != NULL) return ESP_OK;
+    ESP_ERROR_CHECK(esp_tls_set_global_ca_store(cert_der_start, cert_der_end - cert_der_start));
+#ifdef CONFIG_MQTT_RATE_LIMIT
+    uint32_t now_ms = esp_timer_get_time() / 1000;
+    token_bucket_init(&_budgets[BUDGET_TELEMETRY], CONFIG_MQTT_RATE_TELEMETRY, RATE_BURST, now_ms);
+    token_bucket_init(&_budgets[BUDGET_DIAG], CONFIG_MQTT_RATE_DIAG, 1, now_ms);
+    token_bucket_init(&_budgets[BUDGET_BACKFILL], CONFIG_MQTT_RATE_BACKFILL, RATE_BURST, now_ms);
+#ifdef CONFIG_TRACE_ENABLE
+    token_bucket_init(&_budgets[BUDGET_TRACE], CONFIG_MQTT_RATE_TRACE, RATE_BURST, now_ms);
+#endif
+#endif
+    puback_init(&_puback);
+#ifdef CONFIG_MQTT_PERSISTENT_OUTBOX
+    __persist_init();
+#endif
+    _diag_outbox = xQueueCreate(DIAG_OUTBOX_DEPTH, sizeof(outbox_msg_t));
+    if (_diag_outbox == NULL) return ESP_ERR_NO_MEM;
+    _outbox = xQueueCreate(OUTBOX_DEPTH, sizeof(outbox_msg_t));
+    if (_outbox == NULL) return ESP_ERR_NO_MEM;
+    xTaskCreate(
+        &__publisher_task,  /* Task Function */
+        "mqtt_pub_task",    /* Name of Task */
+        PUBLISHER_STACK,    /* Stack size of Task */
+        NULL,               /* Parameter of the task */
+        2,                  /* Priority of the task, vary from 0 to N, bigger means higher piority, need to be 0 to be lower than the watchdog*/
+        NULL);              /* Task handle to keep track of created task */
+    return ESP_OK;
+}
+esp_err_t mqtt_start(void)
+{
+    ESP_ERROR_CHECK(mqtt_prepare());
+    ESP_ERROR_CHECK(command_init());
+    boot_begin(BOOT_MQTT);
+    for (uint8_t i = 0; i < ENDPOINT_COUNT; i++)
+    {
+        if (_endpoints[i].host) continue;
+        __uri_host(_endpoints[i].uri, _primary_host, sizeof(_primary_host));
+        _endpoints[i].host = _primary_host;
+    }
+    __load_brokers();
+    __use_endpoint(0);
+    _mqtt_cfg.CFG_RECONNECT_MS = __backoff_ms(0);
+    _client = esp_mqtt_client_init(&_mqtt_cfg);
     esp_mqtt_client_register_event(_client, ESP_EVENT_ANY_ID, mqtt_event_handler, _client);
     esp_mqtt_client_start(_client);
+    if (ENDPOINT_COUNT > 1)
+    {
+        xTaskCreate(
+            &__probe_task,  /* Task Function */
+            "mqtt_probe_task", /* Name of Task */
+            PROBE_STACK,    /* Stack size of Task */
+            NULL,           /* Parameter of the task */
+            1,              /* Priority of the task, below the publisher: a probe is never urgent */
+            NULL);          /* Task handle to keep track of created task */
+    }
     return ESP_OK;
 }
 
@@ -18,6 +18,7 @@
 #include "freertos/event_groups.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_netif.h"
 
 #include "esp_wifi.h"
@@ -36,6 +37,7 @@
 #include "network.h"
 #include "storage.h"
 #include "mqtt.h"
+#include "gateway.h"
 #include "led.h"
 
 // ------ Private constants -----------------------------------
@@ -69,6 +71,7 @@
 #else
 #define NR_OF_IP_ADDRESSES_TO_WAIT_FOR (_activ_if)
 #endif
+#define ETH_ROUTE_PRIO  (128)  // above Wi-Fi station (100): wired is preferred when both are up
 // ------ Private function prototypes -------------------------
 #if CONFIG_CONNECT_WIFI
 static esp_netif_t* __wifi_start(void);
@@ -86,6 +89,13 @@ static xSemaphoreHandle _semph_got_ips;
 static esp_ip4_addr_t _ip_addr;
 #if CONFIG_CONNECT_WIFI
 static esp_netif_t *_sta_netif = NULL;
+static int64_t _wifi_start_us = 0;   // this connection attempt started at
+static int64_t _wifi_assoc_us = 0;
+static bool _wifi_had_ip = false;    // the last association got an address
+#ifdef CONFIG_WIFI_FAST_CONNECT
+static wifi_fast_t _fast;            // last good association, as stored in NVS
+static bool _fast_locked = false;    // the station is pinned to the cached BSSID and channel
+#endif
 #ifdef CONFIG_WIFI_EN_SMARTCONFIG
 uint8_t _wifi_retry_num = 0;
 /* FreeRTOS event group to signal when we are connected & ready to make a request */
@@ -100,6 +110,11 @@ static const int GOT_SSID_PWD_BIT = BIT0;
 #if CONFIG_CONNECT_ETHERNET
 static esp_netif_t *_eth_netif = NULL;
 #endif
+#ifdef CONFIG_NETWORK_DUAL_HOMED
+static bool _wifi_up = false;      // link up with an address, event loop task only
+static bool _eth_up = false;
+static esp_netif_t *_route = NULL; // default interface
+#endif
 
 #ifdef CONFIG_CONNECT_IPV6
 static esp_ip6_addr_t _ipv6_addr;
@@ -119,6 +134,124 @@ static const char *_ipv6_addr_types[] = {
 //--------------------------------------------------------------
 // FUNCTION DEFINITIONS
 //--------------------------------------------------------------
+#ifdef CONFIG_NETWORK_DUAL_HOMED
+/**
+ * @brief route through the best interface that is up, wired first, and move MQTT over when it changes
+ * @note esp-netif only picks the default interface when one starts or stops, not on link changes
+ */
+static void __select_route(void)
+{
+    esp_netif_t *best = _eth_up ? _eth_netif : (_wifi_up ? _sta_netif : NULL);
+    if (best == NULL || best == _route) return;
+    ESP_ERROR_CHECK(esp_netif_set_default_netif(best));
+    bool moved = (_route != NULL);
+    _route = best;
+    ESP_LOGW(TAG, "Default route through %s", esp_netif_get_desc(best));
+    if (moved) mqtt_rebind();
+}
+/**
+ * @brief keep track of which interfaces can carry traffic
+ */
+static void __link_changed(esp_netif_t *netif, bool up)
+{
+#if CONFIG_CONNECT_WIFI
+    if (netif == _sta_netif) _wifi_up = up;
+#endif
+#if CONFIG_CONNECT_ETHERNET
+    if (netif == _eth_netif) _eth_up = up;
+#endif
+    __select_route();
+}
+#endif // CONFIG_NETWORK_DUAL_HOMED
+#if CONFIG_CONNECT_WIFI
+#ifdef CONFIG_WIFI_FAST_CONNECT
+/**
+ * @brief pin the station to the cached access point, and reuse its lease if enabled
+ */
+static void __fast_apply(esp_netif_t *netif, wifi_config_t *wifi_config)
+{
+    _fast = config_get()->wifi_fast;
+    _fast_locked = _fast.channel &&
+                   strncmp(_fast.ssid, (const char *)wifi_config->sta.ssid, sizeof(wifi_config->sta.ssid)) == 0;
+    if (!_fast_locked) return;
+    wifi_config->sta.bssid_set = true;
+    memcpy(wifi_config->sta.bssid, _fast.bssid, sizeof(_fast.bssid));
+    wifi_config->sta.channel = _fast.channel;
+#ifdef CONFIG_WIFI_REUSE_LEASE
+    if (_fast.ip)
+    {
+        esp_netif_dhcpc_stop(netif);
+        esp_netif_ip_info_t ip_info = {
+            .ip.addr = _fast.ip,
+            .netmask.addr = _fast.netmask,
+            .gw.addr = _fast.gw,
+        };
+        esp_netif_set_ip_info(netif, &ip_info);
+        esp_netif_dns_info_t dns_info = { 0 };
+        dns_info.ip.u_addr.ip4.addr = _fast.dns;
+        esp_netif_set_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns_info);
+    }
+#endif
+    ESP_LOGW(TAG, "Fast connect to %02x:%02x:%02x:%02x:%02x:%02x on channel %u",
+             _fast.bssid[0], _fast.bssid[1], _fast.bssid[2], _fast.bssid[3], _fast.bssid[4], _fast.bssid[5],
+             _fast.channel);
+}
+/**
+ * @brief the cached access point did not answer: full scan and DHCP from now on
+ */
+static void __fast_fallback(esp_netif_t *netif)
+{
+    wifi_config_t wifi_config;
+    _fast_locked = false;
+    ESP_ERROR_CHECK(esp_wifi_get_config(ESP_IF_WIFI_STA, &wifi_config));
+    wifi_config.sta.bssid_set = false;
+    wifi_config.sta.channel = 0;
+    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
+#ifdef CONFIG_WIFI_REUSE_LEASE
+    esp_netif_dhcpc_start(netif);
+#endif
+    ESP_LOGW(TAG, "Fast connect failed, back to a full scan");
+}
+/**
+ * @brief remember a good association and its lease, NVS is only written when something changed
+ */
+static void __fast_store(esp_netif_t *netif, const esp_netif_ip_info_t *ip_info)
+{
+    wifi_fast_t fast = { 0 };
+    wifi_ap_record_t ap;
+    wifi_config_t wifi_config;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK || esp_wifi_get_config(ESP_IF_WIFI_STA, &wifi_config) != ESP_OK) return;
+    strncpy(fast.ssid, (const char *)wifi_config.sta.ssid, sizeof(fast.ssid) - 1);
+    memcpy(fast.bssid, ap.bssid, sizeof(fast.bssid));
+    fast.channel = ap.primary;
+    fast.ip = ip_info->ip.addr;
+    fast.netmask = ip_info->netmask.addr;
+    fast.gw = ip_info->gw.addr;
+    esp_netif_dns_info_t dns_info;
+    if (esp_netif_get_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns_info) == ESP_OK) fast.dns = dns_info.ip.u_addr.ip4.addr;
+    if (memcmp(&fast, &_fast, sizeof(fast)) == 0) return;
+    _fast = fast;
+    config_begin()->wifi_fast = fast;
+    config_commit();
+}
+#endif // CONFIG_WIFI_FAST_CONNECT
+/**
+ * @brief Wi-Fi got an address: log the connection time, keep the association for the next one
+ */
+static void __wifi_got_ip(esp_netif_t *netif, const esp_netif_ip_info_t *ip_info)
+{
+    int64_t now_us = esp_timer_get_time();
+    _wifi_had_ip = true;
+#ifdef CONFIG_WIFI_FAST_CONNECT
+    ESP_LOGW(TAG, "Wi-Fi (%s): associated in %u ms, IP in %u ms", _fast_locked ? "fast" : "scan",
+             (uint32_t)((_wifi_assoc_us - _wifi_start_us) / 1000), (uint32_t)((now_us - _wifi_start_us) / 1000));
+    __fast_store(netif, ip_info);
+#else
+    ESP_LOGW(TAG, "Wi-Fi: associated in %u ms, IP in %u ms",
+             (uint32_t)((_wifi_assoc_us - _wifi_start_us) / 1000), (uint32_t)((now_us - _wifi_start_us) / 1000));
+#endif
+}
+#endif // CONFIG_CONNECT_WIFI
 /**
  * @brief Event for getting ip
  */
@@ -131,6 +264,12 @@ static void __on_got_ip(void *arg, esp_event_base_t event_base,
     ESP_LOGW(TAG, "- IPv4 address: " IPSTR, IP2STR(&event->ip_info.ip));
     // ESP_LOGW(TAG, "%s Got IPv4: " IPSTR, esp_netif_get_desc(event->esp_netif), IP2STR(&event->ip_info.ip));
     memcpy(&_ip_addr, &event->ip_info.ip, sizeof(_ip_addr));
+#if CONFIG_CONNECT_WIFI
+    if (event->esp_netif == _sta_netif) __wifi_got_ip(event->esp_netif, &event->ip_info);
+#endif
+#ifdef CONFIG_NETWORK_DUAL_HOMED
+    __link_changed(event->esp_netif, true);
+#endif
     xSemaphoreGive(_semph_got_ips);
 }
 
@@ -182,8 +321,11 @@ static void __smartconfig_event_handler(void* arg, esp_event_base_t event_base,
         ESP_LOGW(TAG, "Got SSID and password");
         ESP_LOGW(TAG, "SSID:%s", ssid);
         ESP_LOGW(TAG, "PASSWORD:%s", password);
-        del_WifiCredentials();
-        store_WifiCredentials((char*)ssid, (char*)password);
+        config_store_t *config = config_begin();
+        config->wifi_valid = true;
+        strncpy(config->wifi_ssid, (char*)ssid, sizeof(config->wifi_ssid) - 1);
+        strncpy(config->wifi_pass, (char*)password, sizeof(config->wifi_pass) - 1);
+        config_commit(); // both keys and the flag in one NVS commit
         ESP_ERROR_CHECK(esp_wifi_disconnect());
         ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
         ESP_ERROR_CHECK(esp_wifi_connect());
@@ -254,34 +396,39 @@ static void __on_wifi_event(void *esp_netif, esp_event_base_t event_base,
         ESP_LOGW(TAG, "Starting wifi...");
 
 #ifdef CONFIG_WIFI_EN_SMARTCONFIG
-        char ssid[33] = {0};
-        read_WifiSSID(ssid);
-        ESP_LOGW(TAG, "Connecting to %s...", ssid);
+        ESP_LOGW(TAG, "Connecting to %s...", config_get()->wifi_ssid);
 #else
         ESP_LOGW(TAG, "Connecting to %s...", CONFIG_WIFI_SSID);
 #endif
         ESP_ERROR_CHECK(esp_wifi_connect());
         break;
     case WIFI_EVENT_STA_CONNECTED:
+        _wifi_assoc_us = esp_timer_get_time();
 #ifdef CONFIG_WIFI_EN_SMARTCONFIG
         _wifi_retry_num = 0;
 #endif
 #ifdef CONFIG_CONNECT_IPV6
         esp_netif_create_ip6_linklocal(esp_netif);
 #endif
-#if CONFIG_CONNECT_ETHERNET
+#if CONFIG_CONNECT_ETHERNET && !defined(CONFIG_NETWORK_DUAL_HOMED)
         __eth_stop();
         _activ_if--;
 #endif
         break;
     case WIFI_EVENT_STA_DISCONNECTED:
+#ifdef CONFIG_NETWORK_DUAL_HOMED
+        __link_changed(esp_netif, false);
+#endif
+#ifdef CONFIG_WIFI_FAST_CONNECT
+        // a drop after a good link retries the same access point, a failed attempt on it scans
+        if (_fast_locked && !_wifi_had_ip) __fast_fallback(esp_netif);
+#endif
+        _wifi_had_ip = false;
+        _wifi_start_us = esp_timer_get_time();
 #ifdef CONFIG_WIFI_EN_SMARTCONFIG
         if (_wifi_retry_num < CONFIG_WIFI_MAX_RETRY)
         {
-
-            char ssid[33] = {0};
-            read_WifiSSID(ssid);
-            ESP_LOGW(TAG, "Wi-Fi disconnected, reconnect to %s...", ssid);
+            ESP_LOGW(TAG, "Wi-Fi disconnected, reconnect to %s...", config_get()->wifi_ssid);
             esp_err_t err = esp_wifi_connect();
             if (err == ESP_ERR_WIFI_NOT_STARTED) return;
             ESP_ERROR_CHECK(err);
@@ -312,23 +459,35 @@ static void __on_wifi_event(void *esp_netif, esp_event_base_t event_base,
     }
 }
 
+#ifdef CONFIG_STATIC_IP
+/**
+ * @brief stop DHCP and set the address from the configuration
+ * @note set static ip - https://esp32.com/viewtopic.php?f=2&t=14689
+ */
+static void __static_ip(esp_netif_t *netif, const char *ip, const char *gw, const char *netmask)
+{
+    esp_netif_dhcpc_stop(netif);
+    esp_netif_ip_info_t ip_info = {
+        .ip.addr = esp_ip4addr_aton(ip),
+        .netmask.addr = esp_ip4addr_aton(netmask),
+        .gw.addr = esp_ip4addr_aton(gw),
+    };
+    ESP_ERROR_CHECK(esp_netif_set_ip_info(netif, &ip_info));
+    ESP_LOGW(TAG, "Static address %s, gateway %s", ip, gw);
+}
+#endif
 /**
  * @brief wifi start function with power saving mode
  */
 static esp_netif_t* __wifi_start(void)
 {
+    _wifi_start_us = esp_timer_get_time();
     esp_netif_t *sta_netif = esp_netif_create_default_wifi_sta();
     assert(sta_netif);
 
 #ifdef CONFIG_STATIC_IP
-    //set static ip - https://esp32.com/viewtopic.php?f=2&t=14689
-    //define of IP4_ADDR - https://github.com/espressif/esp-idf/blob/master/components/mdns/test_afl_fuzz_host/esp32_compat.h
-    esp_netif_dhcpc_stop(sta_netif);
-    esp_netif_ip_info_t ip_info;
-    IP4_ADDR(&ip_info.ip, 192, 168, 1, 174);
-   	IP4_ADDR(&ip_info.gw, 192, 168, 1, 1);
-   	IP4_ADDR(&ip_info.netmask, 255, 255, 255, 0);
-    esp_netif_set_ip_info(sta_netif, &ip_info);
+    // Kconfig keeps WIFI_REUSE_LEASE off with a static address
+    __static_ip(sta_netif, CONFIG_WIFI_STATIC_IP, CONFIG_WIFI_STATIC_GW, CONFIG_WIFI_STATIC_NETMASK);
 #endif
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
@@ -355,8 +514,9 @@ static esp_netif_t* __wifi_start(void)
 #ifdef CONFIG_WIFI_EN_SMARTCONFIG
     wifi_config_t wifi_config;
     bzero(&wifi_config, sizeof(wifi_config_t)); // The bzero() function copies n bytes, each with a value of zero, into string s
-    read_WifiSSID((char*)wifi_config.sta.ssid); //ssid
-    read_WifiPass((char*)wifi_config.sta.password); //pass
+    const config_store_t *config = config_get();
+    memcpy(wifi_config.sta.ssid, config->wifi_ssid, sizeof(wifi_config.sta.ssid)); //ssid
+    memcpy(wifi_config.sta.password, config->wifi_pass, sizeof(wifi_config.sta.password)); //pass
     wifi_config.sta.listen_interval = CONFIG_LISTEN_INTERVAL;
     /** @note Setting a password implies station will connect to all security modes including WEP/WPA.
     * However these modes are deprecated and not advisable to be used. Incase your Access point
@@ -374,6 +534,9 @@ static esp_netif_t* __wifi_start(void)
 	        .threshold.authmode = WIFI_AUTH_WPA2_PSK
         },
     };
+#endif
+#ifdef CONFIG_WIFI_FAST_CONNECT
+    __fast_apply(sta_netif, &wifi_config);
 #endif
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
@@ -473,13 +636,16 @@ static void __on_eth_event(void *esp_netif, esp_event_base_t event_base,
 #ifdef CONFIG_CONNECT_IPV6
         esp_netif_create_ip6_linklocal(esp_netif);
 #endif
-#if CONFIG_CONNECT_WIFI
+#if CONFIG_CONNECT_WIFI && !defined(CONFIG_NETWORK_DUAL_HOMED)
         __wifi_stop();
         _activ_if--;
 #endif
         break;
     case ETHERNET_EVENT_DISCONNECTED:
         ESP_LOGW(TAG, "Ethernet Down");
+#ifdef CONFIG_NETWORK_DUAL_HOMED
+        __link_changed(esp_netif, false);
+#endif
         break;
     default:
         break;
@@ -488,18 +654,14 @@ static void __on_eth_event(void *esp_netif, esp_event_base_t event_base,
 
 static esp_netif_t* __eth_start(void)
 {
+    esp_netif_inherent_config_t eth_base = ESP_NETIF_INHERENT_DEFAULT_ETH();
+    eth_base.route_prio = ETH_ROUTE_PRIO;
     esp_netif_config_t cfg = ESP_NETIF_DEFAULT_ETH();
+    cfg.base = &eth_base;
     esp_netif_t *eth_netif = esp_netif_new(&cfg);
 
 #ifdef CONFIG_STATIC_IP
-    //set static ip - https://esp32.com/viewtopic.php?f=2&t=14689
-    //define of IP4_ADDR - https://github.com/espressif/esp-idf/blob/master/components/mdns/test_afl_fuzz_host/esp32_compat.h
-    esp_netif_dhcpc_stop(eth_netif);
-    esp_netif_ip_info_t ip_info;
-    IP4_ADDR(&ip_info.ip, 172, 30, 41, 175);
-   	IP4_ADDR(&ip_info.gw, 172, 30, 41, 1);
-   	IP4_ADDR(&ip_info.netmask, 255, 255, 255, 0);
-    esp_netif_set_ip_info(eth_netif, &ip_info);
+    __static_ip(eth_netif, CONFIG_ETH_STATIC_IP, CONFIG_ETH_STATIC_GW, CONFIG_ETH_STATIC_NETMASK);
 #endif
 
     // Set default handlers to process TCP/IP stuffs
@@ -609,25 +771,29 @@ static void __eth_stop(void)
 
 #endif // CONFIG_CONNECT_ETHERNET
 
-static void __network_task(void* arg)
+/**
+ * @brief bring the interfaces up, blocks until an IP is obtained (public)
+ */
+esp_err_t network_connect(void)
 {
     ESP_ERROR_CHECK(network_init());
-    ESP_ERROR_CHECK(network_start()); //will not return if no connection is established.
-    ESP_ERROR_CHECK(mqtt_start());
-    vTaskSuspend(NULL); 
+#ifdef CONFIG_GATEWAY_CHILD
+    return gateway_start(); // no IP, no MQTT: readings go to the uplink board
+#else
+    return network_start(); //will not return if no connection is established.
+#endif
 }
-
-esp_err_t network_startTask(void)
+/**
+ * @brief start the MQTT client, and the ESP-NOW side of a gateway (public)
+ */
+esp_err_t network_uplink(void)
 {
-    //------------ blink task -----------------
-    xTaskCreate(
-        &__network_task,/* Task Function */
-        "network task", /* Name of Task */
-        5120,           /* Stack size of Task */
-        NULL,           /* Parameter of the task */
-        1,              /* Priority of the task, vary from 0 to N, bigger means higher piority, need to be 0 to be lower than the watchdog*/
-        NULL);         /* Task handle to keep track of created task */
-
+#ifndef CONFIG_GATEWAY_CHILD
+    ESP_ERROR_CHECK(mqtt_start());
+#ifdef CONFIG_GATEWAY_UPLINK
+    ESP_ERROR_CHECK(gateway_start());
+#endif
+#endif
     return ESP_OK;
 }
 /**
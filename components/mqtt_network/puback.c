@@ -0,0 +1,166 @@
+/*------------------------------------------------------------*-
+  PUBACK tracking - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Fixed size msg_id -> timestamp table for QoS 1 publishes,
+ * resolved on PUBACK, with a streaming latency histogram.
+ * Pure logic, the caller serialises access and gives the time.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __PUBACK_C
+#define __PUBACK_C
+#include <stddef.h>
+#include <string.h>
+
+#include "puback.h"
+
+// ------ Private constants -----------------------------------
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+/**
+ * @brief log scale bucket: octave from the top bit, sub bucket from the next two bits
+ */
+static uint16_t __bucket(uint32_t ms)
+{
+    if (ms < PUBACK_SUB_BUCKETS) return ms;
+    uint16_t octave = 31 - __builtin_clz(ms);
+    uint16_t sub = (ms >> (octave - 2)) & (PUBACK_SUB_BUCKETS - 1);
+    uint16_t bucket = (octave - 1) * PUBACK_SUB_BUCKETS + sub;
+    return (bucket < PUBACK_BUCKETS) ? bucket : PUBACK_BUCKETS - 1;
+}
+/**
+ * @brief largest latency that falls in a bucket, reported as the percentile
+ */
+static uint32_t __bucket_max(uint16_t bucket)
+{
+    if (bucket < PUBACK_SUB_BUCKETS) return bucket;
+    uint16_t octave = bucket / PUBACK_SUB_BUCKETS + 1;
+    uint16_t sub = bucket % PUBACK_SUB_BUCKETS;
+    return ((uint32_t)(PUBACK_SUB_BUCKETS + sub + 1) << (octave - 2)) - 1;
+}
+static void __record(puback_table_t *table, uint32_t latency_ms)
+{
+    uint16_t bucket = __bucket(latency_ms);
+    table->histogram[bucket]++;
+    if (latency_ms > table->window_max_ms) table->window_max_ms = latency_ms;
+    table->acked++;
+}
+static uint32_t __percentile(const puback_table_t *table, uint32_t samples, uint8_t percent)
+{
+    if (samples == 0) return 0;
+    uint32_t rank = (samples * percent + 99) / 100;  // nearest rank
+    uint32_t seen = 0;
+    for (uint16_t i = 0; i < PUBACK_BUCKETS; i++)
+    {
+        seen += table->histogram[i];
+        if (seen >= rank) return __bucket_max(i) < table->window_max_ms ? __bucket_max(i) : table->window_max_ms;
+    }
+    return table->window_max_ms;
+}
+
+void puback_init(puback_table_t *table)
+{
+    memset(table, 0, sizeof(*table));
+}
+
+void puback_sent(puback_table_t *table, int msg_id, uint32_t sent_ms)
+{
+    if (table->early_valid && table->early_id == msg_id)
+    {
+        // the PUBACK won the race against this call
+        table->early_valid = false;
+        __record(table, table->early_ms - sent_ms);
+        return;
+    }
+
+    puback_entry_t *slot = NULL;
+    for (uint16_t i = 0; i < PUBACK_TABLE_SIZE; i++)
+    {
+        puback_entry_t *entry = &table->entries[i];
+        if (!entry->used) { slot = entry; break; }
+        if (slot == NULL || (int32_t)(entry->sent_ms - slot->sent_ms) < 0) slot = entry;
+    }
+    if (slot->used) table->evicted++;
+    slot->msg_id = msg_id;
+    slot->sent_ms = sent_ms;
+    slot->used = true;
+    slot->timed_out = false;
+}
+
+bool puback_acked(puback_table_t *table, int msg_id, uint32_t now_ms)
+{
+    for (uint16_t i = 0; i < PUBACK_TABLE_SIZE; i++)
+    {
+        puback_entry_t *entry = &table->entries[i];
+        if (entry->used && entry->msg_id == msg_id)
+        {
+            entry->used = false;
+            __record(table, now_ms - entry->sent_ms);
+            return true;
+        }
+    }
+    if (table->early_valid) table->unmatched++;  // the previous one never got its publish
+    table->early_id = msg_id;
+    table->early_ms = now_ms;
+    table->early_valid = true;
+    return false;
+}
+
+void puback_expire(puback_table_t *table, uint32_t now_ms, uint32_t timeout_ms)
+{
+    for (uint16_t i = 0; i < PUBACK_TABLE_SIZE; i++)
+    {
+        puback_entry_t *entry = &table->entries[i];
+        if (entry->used && !entry->timed_out && now_ms - entry->sent_ms >= timeout_ms)
+        {
+            entry->timed_out = true;
+            table->timeouts++;
+        }
+    }
+    if (table->early_valid && now_ms - table->early_ms >= timeout_ms)
+    {
+        table->early_valid = false;
+        table->unmatched++;
+    }
+}
+
+void puback_reconnected(puback_table_t *table)
+{
+    for (uint16_t i = 0; i < PUBACK_TABLE_SIZE; i++)
+    {
+        if (table->entries[i].used) table->retransmits++;
+    }
+}
+
+void puback_stats(puback_table_t *table, puback_stats_t *stats, bool reset_window)
+{
+    uint32_t samples = 0;
+    for (uint16_t i = 0; i < PUBACK_BUCKETS; i++) samples += table->histogram[i];
+    stats->inflight = 0;
+    for (uint16_t i = 0; i < PUBACK_TABLE_SIZE; i++)
+    {
+        if (table->entries[i].used) stats->inflight++;
+    }
+    stats->acked = table->acked;
+    stats->timeouts = table->timeouts;
+    stats->retransmits = table->retransmits;
+    stats->evicted = table->evicted;
+    stats->unmatched = table->unmatched;
+    stats->samples = samples;
+    stats->p50_ms = __percentile(table, samples, 50);
+    stats->p95_ms = __percentile(table, samples, 95);
+    stats->p99_ms = __percentile(table, samples, 99);
+    stats->max_ms = table->window_max_ms;
+    if (reset_window)
+    {
+        memset(table->histogram, 0, sizeof(table->histogram));
+        table->window_max_ms = 0;
+    }
+}
+
+#endif
@@ -8,20 +8,59 @@
  * 
  --------------------------------------------------------------*/
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_err.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "nvs.h"
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
 #include "storage.h"
 
 
 // ------ Private constants -----------------------------------
 const char * nvs_errors[] = { "OTHER", "NOT_INITIALIZED", "NOT_FOUND", "TYPE_MISMATCH", "READ_ONLY", "NOT_ENOUGH_SPACE", "INVALID_NAME", "INVALID_HANDLE", "REMOVE_FAILED", "KEY_TOO_LONG", "PAGE_FULL", "INVALID_STATE", "INVALID_LENGHT"};
 #define nvs_error(e) (((e)>ESP_ERR_NVS_BASE)?nvs_errors[(e)&~(ESP_ERR_NVS_BASE)]:nvs_errors[0])
+#define STORE_NAMESPACE     "config"
+typedef enum {
+    FIELD_U8,
+    FIELD_U32,
+    FIELD_STR,
+    FIELD_BLOB
+} field_type_t;
+/**
+ * @brief one NVS key of the store
+ */
+typedef struct {
+    const char *key;
+    field_type_t type;
+    size_t offset;           // in config_store_t
+    size_t size;
+} field_t;
+#define FIELD(key, type, member) { key, type, offsetof(config_store_t, member), sizeof(((config_store_t *)0)->member) }
 // ------ Private function prototypes -------------------------
 // ------ Private variables -----------------------------------
 /** @brief tag used for ESP serial console messages */
 static const char *TAG = "STORAGE";
+static const field_t _fields[] = {
+    FIELD("valid",   FIELD_U8,   wifi_valid),
+    FIELD("ssid",    FIELD_STR,  wifi_ssid),
+    FIELD("pass",    FIELD_STR,  wifi_pass),
+    FIELD("fast",    FIELD_BLOB, wifi_fast),
+    FIELD("period",  FIELD_U32,  sample_period),
+    FIELD("res",     FIELD_U8,   resolution),
+    FIELD("roms",    FIELD_BLOB, roms),
+    FIELD("brokers", FIELD_BLOB, brokers),
+    FIELD("wear",    FIELD_BLOB, wear),
+};
+#define NUM_FIELDS          (sizeof(_fields) / sizeof(_fields[0]))
+static config_store_t _config;    // published copy, replaced under _config_mux
+static config_store_t _pending;   // transaction in progress, owned by the _txn_lock holder
+static portMUX_TYPE _config_mux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t _txn_lock = NULL;
 // ------ PUBLIC variable definitions -------------------------
 //--------------------------------------------------------------
 // FUNCTION DEFINITIONS
@@ -32,9 +71,8 @@ static esp_err_t __nvs_begin(nvs_handle_t *nvs_handle, const char *name, bool re
     if(err)
     {
         ESP_LOGE(TAG, "nvs_open failed: %s", nvs_error(err));
-        //return ESP_FAIL;
     }
-    return ESP_OK;
+    return err;
 }
 
 static esp_err_t __nvs_end(nvs_handle_t nvs_handle)
@@ -51,138 +89,203 @@ static esp_err_t __nvs_clear(nvs_handle_t nvs_handle)
         ESP_LOGE(TAG, "nvs_erase_all failed: %s", nvs_error(err));
         return ESP_FAIL;
     }
-    return ESP_OK;
-}
-
-static esp_err_t __nvs_putString(nvs_handle_t nvs_handle, const char* key, char* value)
-{
-    if(!key || !value)  
-    {
-        ESP_LOGE(TAG, "invalid argument");
-        return ESP_ERR_INVALID_ARG;
-    }
-    esp_err_t err = nvs_set_str(nvs_handle, key, value);
-    if(err){
-        ESP_LOGE(TAG, "nvs_set_str fail: %s %s", key, nvs_error(err));
-        return ESP_FAIL;
-    }
     err = nvs_commit(nvs_handle);
     if(err){
-        ESP_LOGE(TAG, "nvs_commit fail: %s %s", key, nvs_error(err));
+        ESP_LOGE(TAG, "nvs_commit fail: %s", nvs_error(err));
         return ESP_FAIL;
     }
     return ESP_OK;
 }
-
-static esp_err_t __nvs_putBool(nvs_handle_t nvs_handle, const char* key, const uint8_t value)
+/**
+ * @brief set one key, the caller commits
+ */
+static esp_err_t __nvs_putField(nvs_handle_t nvs_handle, const field_t* field, const void* value)
 {
-    if(!key)
+    esp_err_t err;
+    switch (field->type)
     {
-        ESP_LOGE(TAG, "invalid argument");
-        return ESP_ERR_INVALID_ARG;
+    case FIELD_U8:   err = nvs_set_u8(nvs_handle, field->key, *(const uint8_t*)value); break;
+    case FIELD_U32:  err = nvs_set_u32(nvs_handle, field->key, *(const uint32_t*)value); break;
+    case FIELD_STR:  err = nvs_set_str(nvs_handle, field->key, (const char*)value); break;
+    default:         err = nvs_set_blob(nvs_handle, field->key, value, field->size); break;
     }
-    esp_err_t err = nvs_set_u8(nvs_handle, key, (value?1:0));
     if(err){
-        ESP_LOGE(TAG, "nvs_set_u8 fail: %s %s", key, nvs_error(err));
-        return ESP_FAIL;
+        ESP_LOGE(TAG, "nvs_set fail: %s %s", field->key, nvs_error(err));
     }
-    err = nvs_commit(nvs_handle);
-    if(err){
-        ESP_LOGE(TAG, "nvs_commit fail: %s %s", key, nvs_error(err));
-        return ESP_FAIL;
-    }
-    return ESP_OK;
+    return err;
 }
-
-static esp_err_t __nvs_getString(nvs_handle_t nvs_handle, const char* key, char* value, const size_t maxLen)
+/**
+ * @brief read one key, a missing key or a blob of another size leaves the value untouched
+ */
+static bool __nvs_getField(nvs_handle_t nvs_handle, const field_t* field, void* value)
 {
-    if(!key || !value)  
+    esp_err_t err;
+    size_t len = field->size;
+    switch (field->type)
     {
-        ESP_LOGE(TAG, "invalid argument");
-        return ESP_ERR_INVALID_ARG;
-    }
-    size_t len = 0;
-    esp_err_t err = nvs_get_str(nvs_handle, key, NULL, &len);
-    if(err){
-        ESP_LOGE(TAG, "nvs_get_str len fail: %s %s", key, nvs_error(err));
-        //return ESP_FAIL;
+    case FIELD_U8:   err = nvs_get_u8(nvs_handle, field->key, (uint8_t*)value); break;
+    case FIELD_U32:  err = nvs_get_u32(nvs_handle, field->key, (uint32_t*)value); break;
+    case FIELD_STR:  err = nvs_get_str(nvs_handle, field->key, (char*)value, &len); break;
+    default:
+    {
+        uint8_t buf[len];  // a blob of another layout must not land in the struct
+        err = nvs_get_blob(nvs_handle, field->key, buf, &len);
+        if (!err && len != field->size) err = ESP_ERR_NVS_INVALID_LENGTH;
+        if (!err) memcpy(value, buf, len);
+        break;
     }
-    if(len > maxLen){
-        ESP_LOGE(TAG, "not enough space in value: %u < %u", maxLen, len);
-        return ESP_ERR_INVALID_SIZE;
     }
-    err = nvs_get_str(nvs_handle, key, value, &len);
     if(err){
-        ESP_LOGE(TAG, "nvs_get_str fail: %s %s", key, nvs_error(err));
-        return ESP_FAIL;
+        ESP_LOGI(TAG, "nvs_get fail: %s %s", field->key, nvs_error(err)); // not stored yet is normal
+        return false;
     }
-    return ESP_OK;
+    return true;
 }
-
-static esp_err_t __nvs_getBool(nvs_handle_t nvs_handle, const char* key, uint8_t* value, const uint8_t defaultValue)
+/**
+ * @brief true if the field differs between two copies of the store
+ */
+static bool __changed(const field_t* field, const config_store_t* a, const config_store_t* b)
 {
-    if(!key)
-    {
-        ESP_LOGE(TAG, "invalid argument");
-        return ESP_ERR_INVALID_ARG;
+    const void* va = (const uint8_t*)a + field->offset;
+    const void* vb = (const uint8_t*)b + field->offset;
+    if (field->type == FIELD_STR) return strncmp(va, vb, field->size) != 0;
+    return memcmp(va, vb, field->size) != 0;
+}
+/**
+ * @brief move the credentials and fast connect data of the older namespaces into the store
+ * @note each old namespace is erased once its content is committed
+ */
+static void __migrate(void)
+{
+    nvs_handle_t my_handle=0;
+    config_store_t* config = config_begin();
+    bool wifi = false;
+    bool fast = false;
+    if (nvs_open("WiFiInfo", NVS_READONLY, &my_handle) == ESP_OK) {
+        size_t len = sizeof(config->wifi_ssid);
+        bool valid = nvs_get_u8(my_handle, "valid", &config->wifi_valid) == ESP_OK && config->wifi_valid;
+        wifi = valid && nvs_get_str(my_handle, "WSSID", config->wifi_ssid, &len) == ESP_OK;
+        len = sizeof(config->wifi_pass);
+        wifi = wifi && nvs_get_str(my_handle, "WPASS", config->wifi_pass, &len) == ESP_OK;
+        __nvs_end(my_handle);
+        if (valid && !wifi) {
+            // half an SSID or password must not be stored, the old keys stay for the next boot
+            ESP_LOGE(TAG, "WiFiInfo unreadable, nothing moved");
+            config_abort();
+            return;
+        }
+        if (!wifi) config->wifi_valid = false;
     }
-    *value = defaultValue;
-    esp_err_t err = nvs_get_u8(nvs_handle, key, value);
-    if(err){
-        ESP_LOGE(TAG, "nvs_get_u8 fail: %s %s", key, nvs_error(err));
-        //return ESP_FAIL;
+    if (nvs_open("WiFiFast", NVS_READONLY, &my_handle) == ESP_OK) {
+        size_t len = sizeof(config->wifi_fast);
+        fast = nvs_get_blob(my_handle, "last", &config->wifi_fast, &len) == ESP_OK && len == sizeof(config->wifi_fast);
+        if (!fast) memset(&config->wifi_fast, 0, sizeof(config->wifi_fast));
+        __nvs_end(my_handle);
+    }
+    if (config_commit() != ESP_OK || !(wifi || fast)) return;
+    ESP_LOGW(TAG, "Moved%s%s into the config store", wifi ? " credentials" : "", fast ? " fast connect" : "");
+    if (wifi && __nvs_begin(&my_handle, "WiFiInfo", false) == ESP_OK) {
+        __nvs_clear(my_handle);
+        __nvs_end(my_handle);
+    }
+    if (fast && __nvs_begin(&my_handle, "WiFiFast", false) == ESP_OK) {
+        __nvs_clear(my_handle);
+        __nvs_end(my_handle);
     }
-    return ESP_OK;
 }
 
-void store_WifiCredentials(char* WSSID, char* WPASS) {
-    /**
-     * @param handle: distinguisher
-     * @param namespace: Namespace name is limited to 15 chars
-     * @param readonly: bool.
-     */
+esp_err_t config_load(void) {
+    if (_txn_lock != NULL) return ESP_OK;
+    _txn_lock = xSemaphoreCreateMutex();
+    if (_txn_lock == NULL) return ESP_ERR_NO_MEM;
+
     nvs_handle_t my_handle=0;
-    ESP_ERROR_CHECK(__nvs_begin(&my_handle, "WiFiInfo", false)); //handle, namespace, readonly
-    ESP_ERROR_CHECK(__nvs_putString(my_handle,"WSSID", WSSID));
-    ESP_ERROR_CHECK(__nvs_putString(my_handle,"WPASS", WPASS));
-    ESP_ERROR_CHECK(__nvs_putBool(my_handle,"valid", true));
-    ESP_ERROR_CHECK(__nvs_end(my_handle));
+    uint8_t loaded = 0;
+    esp_err_t err = nvs_open(STORE_NAMESPACE, NVS_READONLY, &my_handle);
+    if (err == ESP_OK) {
+        for (uint8_t i = 0; i < NUM_FIELDS; i++) {
+            if (__nvs_getField(my_handle, &_fields[i], (uint8_t*)&_config + _fields[i].offset)) loaded++;
+        }
+        __nvs_end(my_handle);
+    } else if (err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGE(TAG, "nvs_open failed: %s", nvs_error(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "Config store: %u of %u keys loaded", loaded, NUM_FIELDS);
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                                ESP_PARTITION_SUBTYPE_DATA_NVS, NULL);
+    if (partition) flash_wear_setup(WEAR_CONFIG, partition->size / SPI_FLASH_SEC_SIZE, CONFIG_FLASH_ENDURANCE);
+    for (uint8_t i = 0; i < WEAR_AREAS; i++) flash_wear(i)->erases_before = _config.wear[i];
+    if (!_config.wifi_valid && !_config.wifi_fast.channel) __migrate();
+    return ESP_OK;
 }
-void del_WifiCredentials() {
-    nvs_handle_t my_handle=0;
-    ESP_ERROR_CHECK(__nvs_begin(&my_handle, "WiFiInfo", false)); //handle, namespace, readonly
-    ESP_ERROR_CHECK(__nvs_clear(my_handle));
-	ESP_ERROR_CHECK(__nvs_end(my_handle));
+const config_store_t* config_get(void) {
+    return &_config;
 }
-//maxlength of ssid is 32 bytes
-bool read_WifiSSID(char* ssid) {
-    nvs_handle_t my_handle=0;
-    ESP_ERROR_CHECK(__nvs_begin(&my_handle, "WiFiInfo", true)); //handle, namespace, readonly
-    uint8_t valid_data = false;
-    ESP_ERROR_CHECK(__nvs_getBool(my_handle, "valid", &valid_data, false)); //handle, key, buffer, default value
-    if (valid_data) {
-        ESP_ERROR_CHECK(__nvs_getString(my_handle, "WSSID", ssid, 33)); //handle, key, pointer, maxlength 
-        ESP_ERROR_CHECK(__nvs_end(my_handle));
-        return true;
-    } else {
-		ESP_ERROR_CHECK(__nvs_end(my_handle));
-        snprintf(ssid, 4, "N/A");
-        return false;
+void config_read(config_store_t* config) {
+    portENTER_CRITICAL(&_config_mux);
+    *config = _config;
+    portEXIT_CRITICAL(&_config_mux);
+}
+esp_err_t config_init(void) {
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_LOGW(TAG, "NVS partition erased: %s", esp_err_to_name(err));
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    if (err != ESP_OK) return err;
+    return config_load();
+}
+config_store_t* config_begin(void) {
+    if (_txn_lock == NULL) {
+        // a lazy load here would race the boot steps reading config_get()
+        ESP_LOGE(TAG, "config_begin() before config_load()");
+        abort();
     }
+    xSemaphoreTake(_txn_lock, portMAX_DELAY);
+    _pending = _config;  // only transactions write _config
+    return &_pending;
 }
-//maxlength of password is 64 bytes
-bool read_WifiPass(char* pass) {
+esp_err_t config_commit(void) {
     nvs_handle_t my_handle=0;
-    ESP_ERROR_CHECK(__nvs_begin(&my_handle, "WiFiInfo", true)); //handle, namespace, readonly
-    uint8_t valid_data = false;
-    ESP_ERROR_CHECK(__nvs_getBool(my_handle, "valid", &valid_data, false)); //handle, key, buffer, default value
-    if (valid_data) {
-        ESP_ERROR_CHECK(__nvs_getString(my_handle, "WPASS", pass, 65)); //handle, key, pointer, maxlength 
-        ESP_ERROR_CHECK(__nvs_end(my_handle));
-        return true;
-    } else {
-		ESP_ERROR_CHECK(__nvs_end(my_handle));
-        snprintf(pass, 4, "N/A");
-        return false;
+    bool opened = false;
+    uint8_t written = 0;
+    esp_err_t err = ESP_OK;
+    for (uint8_t i = 0; i < NUM_FIELDS && err == ESP_OK; i++) {
+        if (!__changed(&_fields[i], &_pending, &_config)) continue;
+        if (!opened) {
+            err = __nvs_begin(&my_handle, STORE_NAMESPACE, false); //handle, namespace, readonly
+            if (err) break;
+            opened = true;
+        }
+        const void* value = (uint8_t*)&_pending + _fields[i].offset;
+        err = __nvs_putField(my_handle, &_fields[i], value);
+        written++;
+        bool variable = _fields[i].type == FIELD_STR || _fields[i].type == FIELD_BLOB;
+        flash_wear_nvs_write(WEAR_CONFIG, (_fields[i].type == FIELD_STR) ? strlen(value) + 1 : _fields[i].size, variable);
+    }
+    if (opened) {
+        if (err == ESP_OK) err = nvs_commit(my_handle); // one commit for the whole transaction
+        if (err) ESP_LOGE(TAG, "nvs_commit fail: %s", nvs_error(err));
+        __nvs_end(my_handle);
+    }
+    if (err == ESP_OK && written) {
+        portENTER_CRITICAL(&_config_mux);
+        _config = _pending;
+        portEXIT_CRITICAL(&_config_mux);
+        ESP_LOGI(TAG, "Config store: %u keys committed", written);
+    }
+    xSemaphoreGive(_txn_lock);
+    return err;
+}
+void config_abort(void) {
+    xSemaphoreGive(_txn_lock);
+}
+esp_err_t config_wear_checkpoint(void) {
+    config_store_t* config = config_begin();
+    for (uint8_t i = 0; i < WEAR_AREAS; i++) {
+        config->wear[i] = flash_wear(i)->erases_before + flash_wear(i)->erases;
     }
+    return config_commit();
 }
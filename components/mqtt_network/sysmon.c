@@ -0,0 +1,182 @@
+/*------------------------------------------------------------*-
+  System MONITOR - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * CPU share and stack headroom of every task, free heap and
+ * largest free block. Sampled at a low rate by the caller,
+ * nothing is measured on the sensor or publish paths.
+ *
+ --------------------------------------------------------------*/
+#ifndef __SYSMON_C
+#define __SYSMON_C
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "sysmon.h"
+
+// ------ Private constants -----------------------------------
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+/** @brief tag used for ESP serial console messages */
+static const char *TAG = "sysmon";
+static portMUX_TYPE _sysmon_mux = portMUX_INITIALIZER_UNLOCKED;
+static sysmon_t _latest;                  // guarded by _sysmon_mux
+static bool _sampled = false;
+static int64_t _sample_us = 0;
+#ifdef CONFIG_FREERTOS_USE_TRACE_FACILITY
+static TaskStatus_t _status[SYSMON_TASKS_MAX + 4];  // sampler only, too big for its stack
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+// run time counters of the previous sample, by task number
+static UBaseType_t _prev_number[SYSMON_TASKS_MAX];
+static uint32_t _prev_runtime[SYSMON_TASKS_MAX];
+static uint8_t _prev_count = 0;
+static uint32_t _prev_total = 0;
+#endif
+#endif
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+#if defined(CONFIG_FREERTOS_USE_TRACE_FACILITY) && defined(CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+/**
+ * @brief share of one core since the previous sample, the run time counter wraps with the total
+ */
+static uint16_t __cpu_pml(UBaseType_t number, uint32_t runtime, uint32_t total)
+{
+    uint32_t elapsed = total - _prev_total;
+    if (_prev_count == 0 || elapsed == 0) return SYSMON_NO_CPU;
+    for (uint8_t i = 0; i < _prev_count; i++)
+    {
+        if (_prev_number[i] != number) continue;
+        uint64_t pml = (uint64_t)(runtime - _prev_runtime[i]) * 1000 / elapsed;
+        return (pml > 1000) ? 1000 : (uint16_t)pml;
+    }
+    return SYSMON_NO_CPU;    // started since the previous sample
+}
+#endif
+/**
+ * @brief walk every task - the scheduler is suspended while FreeRTOS fills _status
+ */
+static void __sample_tasks(sysmon_t *sample)
+{
+    sample->count = 0;
+    sample->missed = 0;
+#ifdef CONFIG_FREERTOS_USE_TRACE_FACILITY
+    uint32_t total = 0;
+    UBaseType_t tasks = uxTaskGetSystemState(_status, sizeof(_status) / sizeof(_status[0]), &total);
+    if (tasks == 0)
+    {
+        // more tasks than _status can hold
+        sample->missed = uxTaskGetNumberOfTasks();
+        return;
+    }
+    for (UBaseType_t i = 0; i < tasks; i++)
+    {
+        if (sample->count >= SYSMON_TASKS_MAX)
+        {
+            sample->missed++;
+            continue;
+        }
+        sysmon_task_t *task = &sample->tasks[sample->count++];
+        snprintf(task->name, sizeof(task->name), "%s", _status[i].pcTaskName);
+        task->priority = _status[i].uxCurrentPriority;
+        task->core = (_status[i].xCoreID == tskNO_AFFINITY) ? -1 : _status[i].xCoreID;
+        task->stack_free = _status[i].usStackHighWaterMark;   // StackType_t is a byte on the ESP32
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        task->cpu_pml = __cpu_pml(_status[i].xTaskNumber, _status[i].ulRunTimeCounter, total);
+#else
+        task->cpu_pml = SYSMON_NO_CPU;
+#endif
+    }
+#ifdef CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    _prev_count = 0;
+    for (UBaseType_t i = 0; i < tasks && _prev_count < SYSMON_TASKS_MAX; i++, _prev_count++)
+    {
+        _prev_number[_prev_count] = _status[i].xTaskNumber;
+        _prev_runtime[_prev_count] = _status[i].ulRunTimeCounter;
+    }
+    _prev_total = total;
+#endif
+#endif
+}
+esp_err_t sysmon_sample(sysmon_t *sample)
+{
+    if (sample == NULL) return ESP_ERR_INVALID_ARG;
+    int64_t now_us = esp_timer_get_time();
+    sample->heap_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    sample->heap_min = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    sample->heap_largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    sample->interval_ms = _sampled ? (uint32_t)((now_us - _sample_us) / 1000) : 0;
+    _sample_us = now_us;
+    __sample_tasks(sample);
+
+    for (uint8_t i = 0; i < sample->count; i++)
+        if (sample->tasks[i].stack_free < SYSMON_STACK_LOW)
+            ESP_LOGW(TAG, "%s: %u bytes of stack left", sample->tasks[i].name, sample->tasks[i].stack_free);
+    if (sample->missed) ESP_LOGW(TAG, "%u tasks left out of the sample", sample->missed);
+
+    portENTER_CRITICAL(&_sysmon_mux);
+    _latest = *sample;
+    _sampled = true;
+    portEXIT_CRITICAL(&_sysmon_mux);
+    return ESP_OK;
+}
+esp_err_t sysmon_get(sysmon_t *sample)
+{
+    if (sample == NULL) return ESP_ERR_INVALID_ARG;
+    portENTER_CRITICAL(&_sysmon_mux);
+    bool sampled = _sampled;
+    if (sampled) *sample = _latest;
+    portEXIT_CRITICAL(&_sysmon_mux);
+    return sampled ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+void sysmon_log(const sysmon_t *sample)
+{
+    ESP_LOGI(TAG, "heap: %u free, %u min, %u largest block, over %u ms:",
+             sample->heap_free, sample->heap_min, sample->heap_largest, sample->interval_ms);
+    for (uint8_t i = 0; i < sample->count; i++)
+    {
+        const sysmon_task_t *task = &sample->tasks[i];
+        if (task->cpu_pml == SYSMON_NO_CPU)
+            ESP_LOGI(TAG, "  %-16s core %2d prio %2u cpu    -  stack %5u free", task->name, task->core,
+                     task->priority, task->stack_free);
+        else
+            ESP_LOGI(TAG, "  %-16s core %2d prio %2u cpu %3u.%u%% stack %5u free", task->name, task->core,
+                     task->priority, task->cpu_pml / 10, task->cpu_pml % 10, task->stack_free);
+    }
+}
+int sysmon_record(const sysmon_t *sample, uint8_t *next, char *buf, size_t len)
+{
+    int n = 0;
+    if (*next == 0)
+        n = snprintf(buf, len, "{heap:[%u,%u,%u],ms:%u,tasks:{", sample->heap_free, sample->heap_min,
+                     sample->heap_largest, sample->interval_ms);
+    else
+        n = snprintf(buf, len, "{tasks:{");
+    if ((size_t)n >= len) return 0;
+
+    uint8_t first = *next;
+    while (*next < sample->count)
+    {
+        const sysmon_task_t *task = &sample->tasks[*next];
+        // -1 for a task without a CPU figure
+        int cpu = (task->cpu_pml == SYSMON_NO_CPU) ? -1 : task->cpu_pml;
+        int added = snprintf(buf + n, len - n, "%s\"%s\":[%d,%u]", (*next > first) ? "," : "",
+                             task->name, cpu, task->stack_free);
+        if ((size_t)(n + added + 2) >= len) break;   // room for the closing braces
+        n += added;
+        (*next)++;
+    }
+    if (*next == first && first < sample->count) return 0;
+    buf[n++] = '}';
+    buf[n++] = '}';
+    buf[n] = '\0';
+    return n;
+}
+#endif
@@ -0,0 +1,64 @@
+/*------------------------------------------------------------*-
+  Token bucket - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Publish budget: tokens refill at a steady rate up to a burst,
+ * one message takes one token.
+ * Pure logic, the caller serialises access and gives the time.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __TOKEN_BUCKET_C
+#define __TOKEN_BUCKET_C
+#include <stddef.h>
+
+#include "token_bucket.h"
+
+// ------ Private constants -----------------------------------
+#define TOKEN               (60000)  // credit of one token: ms per minute, so rate x elapsed ms is exact
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+/**
+ * @brief add the credit earned since the last call, capped at the burst
+ */
+static void __refill(token_bucket_t *bucket, uint32_t now_ms)
+{
+    uint32_t full = bucket->burst * TOKEN;
+    uint64_t earned = (uint64_t)(now_ms - bucket->last_ms) * bucket->rate_per_min;
+    bucket->last_ms = now_ms;
+    bucket->credit = (earned >= full - bucket->credit) ? full : bucket->credit + (uint32_t)earned;
+}
+void token_bucket_init(token_bucket_t *bucket, uint32_t rate_per_min, uint32_t burst, uint32_t now_ms)
+{
+    bucket->rate_per_min = rate_per_min;
+    bucket->burst = burst ? burst : 1;
+    bucket->credit = bucket->burst * TOKEN;
+    bucket->last_ms = now_ms;
+    bucket->granted = 0;
+    bucket->throttled = 0;
+}
+bool token_bucket_take(token_bucket_t *bucket, uint32_t now_ms)
+{
+    __refill(bucket, now_ms);
+    if (bucket->credit < TOKEN)
+    {
+        bucket->throttled++;
+        return false;
+    }
+    bucket->credit -= TOKEN;
+    bucket->granted++;
+    return true;
+}
+uint32_t token_bucket_wait_ms(token_bucket_t *bucket, uint32_t now_ms)
+{
+    __refill(bucket, now_ms);
+    if (bucket->credit >= TOKEN) return 0;
+    if (bucket->rate_per_min == 0) return UINT32_MAX;
+    return (TOKEN - bucket->credit + bucket->rate_per_min - 1) / bucket->rate_per_min;
+}
+
+#endif
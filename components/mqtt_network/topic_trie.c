@@ -0,0 +1,135 @@
+/*------------------------------------------------------------*-
+  TOPIC TRIE - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Compact trie of MQTT topic filters, one node per topic level,
+ * with the '+' and '#' wildcards. Fixed node and name pools.
+ * Pure logic, the caller serialises insert and match.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __TOPIC_TRIE_C
+#define __TOPIC_TRIE_C
+#include <stddef.h>
+#include <string.h>
+
+#include "topic_trie.h"
+
+// ------ Private constants -----------------------------------
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+/**
+ * @brief length of the level starting at pos
+ */
+static int __level_len(const char *topic, int pos, int topic_len)
+{
+    int end = pos;
+    while (end < topic_len && topic[end] != '/') end++;
+    return end - pos;
+}
+static bool __is(const topic_trie_t *trie, const topic_node_t *node, const char *name, int len)
+{
+    return node->name_len == len && memcmp(&trie->pool[node->name], name, len) == 0;
+}
+/**
+ * @brief find or create a level under the list starting at *first
+ */
+static uint8_t __child(topic_trie_t *trie, uint8_t *first, const char *name, int len)
+{
+    for (uint8_t i = *first; i != TOPIC_TRIE_NONE; i = trie->nodes[i].sibling)
+    {
+        if (__is(trie, &trie->nodes[i], name, len)) return i;
+    }
+    if (trie->count >= TOPIC_TRIE_MAX_NODES || len > UINT8_MAX ||
+        trie->pool_used + len > TOPIC_TRIE_POOL_SIZE) return TOPIC_TRIE_NONE;
+
+    uint8_t index = trie->count++;
+    topic_node_t *node = &trie->nodes[index];
+    memcpy(&trie->pool[trie->pool_used], name, len);
+    node->name = trie->pool_used;
+    node->name_len = len;
+    node->child = TOPIC_TRIE_NONE;
+    node->route = TOPIC_TRIE_NONE;
+    node->sibling = *first;
+    *first = index;
+    trie->pool_used += len;
+    return index;
+}
+static void __add(uint8_t route, uint8_t *routes, uint8_t *count, uint8_t max_routes)
+{
+    if (route != TOPIC_TRIE_NONE && *count < max_routes) routes[(*count)++] = route;
+}
+/**
+ * @brief match the level at pos against the nodes of one list, then go down
+ * @note depth is the number of topic levels, bounded by the topic length
+ */
+static void __match(const topic_trie_t *trie, uint8_t first, const char *topic, int pos, int topic_len,
+                    uint8_t *routes, uint8_t *count, uint8_t max_routes)
+{
+    int len = __level_len(topic, pos, topic_len);
+    bool last = (pos + len >= topic_len);
+    for (uint8_t i = first; i != TOPIC_TRIE_NONE; i = trie->nodes[i].sibling)
+    {
+        const topic_node_t *node = &trie->nodes[i];
+        if (__is(trie, node, "#", 1))
+        {
+            // no wildcard match on $SYS style topics at the first level
+            if (pos > 0 || topic[0] != '$') __add(node->route, routes, count, max_routes);
+            continue;
+        }
+        bool plus = __is(trie, node, "+", 1) && (pos > 0 || topic[0] != '$');
+        if (!plus && !__is(trie, node, topic + pos, len)) continue;
+        if (last)
+        {
+            __add(node->route, routes, count, max_routes);
+            // "a/#" also matches "a"
+            for (uint8_t c = node->child; c != TOPIC_TRIE_NONE; c = trie->nodes[c].sibling)
+            {
+                if (__is(trie, &trie->nodes[c], "#", 1)) __add(trie->nodes[c].route, routes, count, max_routes);
+            }
+        }
+        else
+        {
+            __match(trie, node->child, topic, pos + len + 1, topic_len, routes, count, max_routes);
+        }
+    }
+}
+
+void topic_trie_init(topic_trie_t *trie)
+{
+    memset(trie, 0, sizeof(*trie));
+    trie->root = TOPIC_TRIE_NONE;
+}
+
+bool topic_trie_insert(topic_trie_t *trie, const char *filter, uint8_t route)
+{
+    int filter_len = strlen(filter);
+    uint8_t *first = &trie->root;
+    uint8_t node = TOPIC_TRIE_NONE;
+    for (int pos = 0; pos <= filter_len; )
+    {
+        int len = __level_len(filter, pos, filter_len);
+        node = __child(trie, first, filter + pos, len);
+        if (node == TOPIC_TRIE_NONE) return false;
+        first = &trie->nodes[node].child;
+        pos += len + 1;
+    }
+    if (trie->nodes[node].route != TOPIC_TRIE_NONE) return false;
+    trie->nodes[node].route = route;
+    return true;
+}
+
+uint8_t topic_trie_match(const topic_trie_t *trie, const char *topic, int topic_len,
+                         uint8_t *routes, uint8_t max_routes)
+{
+    uint8_t count = 0;
+    if (topic_len <= 0) return 0;
+    __match(trie, trie->root, topic, 0, topic_len, routes, &count, max_routes);
+    return count;
+}
+
+#endif
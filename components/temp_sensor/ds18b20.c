@@ -46,6 +46,8 @@
 
 #include "ds18b20.h"
 #include "owb.h"
+#include "trace.h"
+#include "dlog.h"
 
 static const char * TAG = "ds18b20";
 static const int T_CONV = 750;   // maximum conversion time at 12-bit resolution in milliseconds
@@ -238,7 +240,8 @@ static DS18B20_ERROR _read_scratchpad(const DS18B20_Info * ds18b20_info, Scratch
     }
     count = _min(sizeof(Scratchpad), count);   // avoid reading past end of scratchpad
 
-    ESP_LOGD(TAG, "scratchpad read: CRC %d, count %d", ds18b20_info->use_crc, count);
+    DLOGD(TAG, "scratchpad read: CRC %d, count %d", ds18b20_info->use_crc, count);
+    TRACE_BEGIN(TRACE_DS_SCRATCHPAD, count);
     if (_address_device(ds18b20_info))
     {
         // read scratchpad
@@ -252,7 +255,7 @@ static DS18B20_ERROR _read_scratchpad(const DS18B20_Info * ds18b20_info, Scratch
                 if (!ds18b20_info->use_crc)
                 {
                     // Without CRC, or partial read:
-                    ESP_LOGD(TAG, "No CRC check");
+                    DLOGD(TAG, "No CRC check");
                     bool is_present = false;
                     owb_reset(ds18b20_info->bus, &is_present);  // terminate early
                 }
@@ -261,12 +264,13 @@ static DS18B20_ERROR _read_scratchpad(const DS18B20_Info * ds18b20_info, Scratch
                     // With CRC:
                     if (owb_crc8_bytes(0, (uint8_t *)scratchpad, sizeof(*scratchpad)) != 0)
                     {
-                        ESP_LOGE(TAG, "CRC failed");
+                        TRACE_MARK(TRACE_DS_CRC, ds18b20_info->rom_code.fields.serial_number[0]);
+                        DLOGE(TAG, "CRC failed");
                         err = DS18B20_ERROR_CRC;
                     }
                     else
                     {
-                        ESP_LOGD(TAG, "CRC ok");
+                        DLOGD(TAG, "CRC ok");
                     }
                 }
             }
@@ -282,6 +286,7 @@ static DS18B20_ERROR _read_scratchpad(const DS18B20_Info * ds18b20_info, Scratch
             err = DS18B20_ERROR_OWB;
         }
     }
+    TRACE_END(TRACE_DS_SCRATCHPAD, err);
     return err;
 }
 
@@ -485,10 +490,12 @@ void ds18b20_convert_all(const OneWireBus * bus)
     if (bus)
     {
         bool is_present = false;
+        TRACE_BEGIN(TRACE_DS_CONVERT, 0);
         owb_reset(bus, &is_present);
         owb_write_byte(bus, OWB_ROM_SKIP);
         owb_write_byte(bus, DS18B20_FUNCTION_TEMP_CONVERT);
         owb_set_strong_pullup(bus, true);
+        TRACE_END(TRACE_DS_CONVERT, is_present);
     }
     else
     {
@@ -531,7 +538,7 @@ DS18B20_ERROR ds18b20_read_temp(const DS18B20_Info * ds18b20_info, float * value
         }
 
         float temp = _decode_temp(temp_LSB, temp_MSB, ds18b20_info->resolution);
-        ESP_LOGD(TAG, "temp_LSB 0x%02x, temp_MSB 0x%02x, temp %f", temp_LSB, temp_MSB, temp);
+        DLOGD(TAG, "temp_LSB 0x%02x, temp_MSB 0x%02x, temp %f", temp_LSB, temp_MSB, temp);
 
         if (value)
         {
@@ -61,6 +61,7 @@ sample code bearing this copyright.
 #include "driver/rmt.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "trace.h"
 
 #undef OW_DEBUG
 
@@ -110,6 +111,7 @@ static owb_status _reset(const OneWireBus * bus, bool * is_present)
     int res = OWB_STATUS_OK;
 
     owb_rmt_driver_info * i = info_of_driver(bus);
+    TRACE_BEGIN(TRACE_OWB_RESET, 0);
 
     tx_items[0].duration0 = OW_DURATION_RESET;
     tx_items[0].level0 = 0;
@@ -174,6 +176,7 @@ static owb_status _reset(const OneWireBus * bus, bool * is_present)
     rmt_set_rx_idle_thresh(i->rx_channel, old_rx_thresh);
 
     *is_present = _is_present;
+    TRACE_END(TRACE_OWB_RESET, _is_present);
 
     ESP_LOGD(TAG, "_is_present %d", _is_present);
 
@@ -226,6 +229,7 @@ static owb_status _write_bits(const OneWireBus * bus, uint8_t out, int number_of
 
     owb_status status = OWB_STATUS_NOT_SET;
 
+    TRACE_BEGIN(TRACE_OWB_WRITE, number_of_bits_to_write);
     if (rmt_write_items(info->tx_channel, tx_items, number_of_bits_to_write+1, true) == ESP_OK)
     {
         status = OWB_STATUS_OK;
@@ -235,6 +239,7 @@ static owb_status _write_bits(const OneWireBus * bus, uint8_t out, int number_of
         status = OWB_STATUS_HW_ERROR;
         ESP_LOGE(TAG, "rmt_write_items() failed");
     }
+    TRACE_END(TRACE_OWB_WRITE, status);
 
     return status;
 }
@@ -276,6 +281,7 @@ static owb_status _read_bits(const OneWireBus * bus, uint8_t *in, int number_of_
     tx_items[number_of_bits_to_read].level0 = 1;
     tx_items[number_of_bits_to_read].duration0 = 0;
 
+    TRACE_BEGIN(TRACE_OWB_READ, number_of_bits_to_read);
     onewire_flush_rmt_rx_buf(bus);
     rmt_rx_start(info->rx_channel, true);
     if (rmt_write_items(info->tx_channel, tx_items, number_of_bits_to_read+1, true) == ESP_OK)
@@ -328,6 +334,7 @@ static owb_status _read_bits(const OneWireBus * bus, uint8_t *in, int number_of_
     }
 
     rmt_rx_stop(info->rx_channel);
+    TRACE_END(TRACE_OWB_READ, res);
 
     *in = read_data;
     return res;
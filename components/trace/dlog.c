@@ -0,0 +1,290 @@
+/*------------------------------------------------------------*-
+  Deferred LOG - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Drop-in replacements of ESP_LOG* for the hot paths: the call
+ * only copies the format address and the raw arguments into a
+ * ring, a low priority task formats and prints them later, or
+ * prints them in hex for tools/dlog_decode.
+ *
+ --------------------------------------------------------------*/
+#ifndef __DLOG_C
+#define __DLOG_C
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/ringbuf.h"
+#include "esp_timer.h"
+#include "soc/soc_memory_layout.h"
+#include "sdkconfig.h"
+
+#include "dlog.h"
+
+// ------ Private constants -----------------------------------
+#define DLOG_TASK_STACK      (3072)
+#define DLOG_BENCHMARK_CALLS (32)     // a few records per slot of the default ring
+#ifdef CONFIG_DLOG_ENABLE
+#define DLOG_STR_MAX         (CONFIG_DLOG_STR_MAX)
+#define DLOG_CUT_MARK        "..."    // ends a string cut to DLOG_STR_MAX
+#define DLOG_RECORD_MAX      (DLOG_HEADER_LEN + DLOG_ARGS_MAX * (2 + DLOG_STR_MAX))
+#ifdef CONFIG_DLOG_BINARY
+#define DLOG_LINE_LEN        (sizeof(DLOG_LINE_PREFIX) + 2 * DLOG_RECORD_MAX)
+#else
+#define DLOG_LINE_LEN        (256)
+#endif
+#endif
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+/** @brief tag used for ESP serial console messages */
+static const char *TAG = "dlog";
+#ifdef CONFIG_DLOG_ENABLE
+static RingbufHandle_t _ring = NULL;
+static uint32_t _written = 0, _dropped = 0;   // atomic, any task
+static char _line[DLOG_LINE_LEN];              // log task only, too big for its stack
+#endif
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+#ifdef CONFIG_DLOG_ENABLE
+static const char *__resolve(uint32_t addr, void *ctx)
+{
+    return (const char *)(uintptr_t)addr;
+}
+/**
+ * @brief the argument is the string of a "%.*s", its precision is the argument before it
+ * @note only asked for a string in RAM after an integer, other calls never parse the format
+ */
+static bool __has_precision(const char *fmt, uint8_t index)
+{
+    uint8_t arg = 0;
+    while ((fmt = strchr(fmt, '%')) != NULL)
+    {
+        bool star = false;
+        for (fmt++; strchr(DLOG_CONVERSIONS, *fmt) == NULL; fmt++)
+        {
+            if (*fmt != '*') continue;
+            star = (fmt[-1] == '.');   // a width star is an argument too
+            arg++;
+        }
+        if (*fmt == '\0') return false;
+        if (*fmt++ == '%') continue;
+        if (arg == index) return star && fmt[-1] == 's';
+        if (++arg > index) return false;
+    }
+    return false;
+}
+/**
+ * @brief bytes of an argument in the ring, a string in flash is kept by address
+ * @param limit precision of the string, it may not be null terminated within it
+ */
+static size_t __arg_len(const dlog_arg_t *arg, size_t limit, uint8_t *type, size_t *str_len, bool *cut)
+{
+    *type = arg->type;
+    switch (arg->type)
+    {
+        case DLOG_ARG_U64:
+        case DLOG_ARG_DOUBLE:
+            return 8;
+        case DLOG_ARG_STR:
+            if (arg->str == NULL || esp_ptr_in_drom(arg->str))
+            {
+                *type = DLOG_ARG_STR_REF;
+                return 4;
+            }
+            // one byte more tells a string cut here from one that just fits
+            *str_len = strnlen(arg->str, (limit < DLOG_STR_MAX + 1) ? limit : DLOG_STR_MAX + 1);
+            *cut = (*str_len > DLOG_STR_MAX);
+            if (*cut) *str_len = DLOG_STR_MAX;
+            return *str_len + 1;
+        default:
+            return 4;
+    }
+}
+void dlog_write(uint8_t level, const char *tag, const char *fmt, const dlog_arg_t *args, uint8_t argc)
+{
+    uint8_t types[DLOG_ARGS_MAX];
+    size_t str_len[DLOG_ARGS_MAX];
+    bool cut[DLOG_ARGS_MAX] = { 0 };
+    if (argc > DLOG_ARGS_MAX) argc = DLOG_ARGS_MAX;
+    size_t len = DLOG_HEADER_LEN;
+    for (uint8_t i = 0; i < argc; i++)
+    {
+        size_t limit = SIZE_MAX;
+        // "%.*s" of a buffer that is not null terminated, like a payload
+        if (i > 0 && args[i].type == DLOG_ARG_STR && args[i - 1].type == DLOG_ARG_U32 &&
+            (int32_t)args[i - 1].u32 >= 0 && __has_precision(fmt, i))
+            limit = args[i - 1].u32;
+        len += 1 + __arg_len(&args[i], limit, &types[i], &str_len[i], &cut[i]);
+    }
+
+    void *item = NULL;
+    if (_ring == NULL || xRingbufferSendAcquire(_ring, &item, len, 0) != pdTRUE)
+    {
+        __atomic_fetch_add(&_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    // written in place, the record is only visible to the log task once complete
+    uint8_t *p = item;
+    uint32_t word = esp_log_timestamp();
+    memcpy(p, &word, 4);
+    word = (uint32_t)(uintptr_t)fmt;
+    memcpy(p + 4, &word, 4);
+    word = (uint32_t)(uintptr_t)tag;
+    memcpy(p + 8, &word, 4);
+    p[12] = level;
+    p[13] = argc;
+    p += DLOG_HEADER_LEN;
+    for (uint8_t i = 0; i < argc; i++)
+    {
+        *p++ = types[i];
+        switch (types[i])
+        {
+            case DLOG_ARG_U64:
+            case DLOG_ARG_DOUBLE:
+                memcpy(p, &args[i].u64, 8);
+                p += 8;
+                break;
+            case DLOG_ARG_STR:
+                memcpy(p, args[i].str, str_len[i]);
+                if (cut[i]) memcpy(p + str_len[i] - strlen(DLOG_CUT_MARK), DLOG_CUT_MARK, strlen(DLOG_CUT_MARK));
+                p[str_len[i]] = '\0';
+                p += str_len[i] + 1;
+                break;
+            case DLOG_ARG_STR_REF:
+                word = (uint32_t)(uintptr_t)args[i].str;
+                memcpy(p, &word, 4);
+                p += 4;
+                break;
+            default:
+                memcpy(p, &args[i].u32, 4);
+                p += 4;
+                break;
+        }
+    }
+    xRingbufferSendComplete(_ring, item);
+    __atomic_fetch_add(&_written, 1, __ATOMIC_RELAXED);
+}
+#ifdef CONFIG_DLOG_BINARY
+/**
+ * @brief one line per record, printed at once so that other logs do not cut it
+ */
+static void __print(const uint8_t *rec, size_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+    size_t n = strlen(DLOG_LINE_PREFIX);
+    memcpy(_line, DLOG_LINE_PREFIX, n);
+    for (size_t i = 0; i < len && n + 2 < sizeof(_line); i++)
+    {
+        _line[n++] = digits[rec[i] >> 4];
+        _line[n++] = digits[rec[i] & 0x0F];
+    }
+    _line[n] = '\0';
+    printf("%s\n", _line);
+}
+#else
+/**
+ * @brief same line as ESP_LOG* would have printed, with the time of the call
+ * @note the level set by esp_log_level_set() for the tag is applied here
+ */
+static void __print(const uint8_t *rec, size_t len)
+{
+    dlog_header_t header;
+    if (!dlog_header(rec, len, &header)) return;
+    const char *tag = (const char *)(uintptr_t)header.tag;
+    dlog_format(rec, len, __resolve, NULL, _line, sizeof(_line));
+    switch (header.level)
+    {
+        case ESP_LOG_ERROR:
+            esp_log_write(ESP_LOG_ERROR, tag, LOG_FORMAT(E, "%s"), header.ms, tag, _line);
+            break;
+        case ESP_LOG_WARN:
+            esp_log_write(ESP_LOG_WARN, tag, LOG_FORMAT(W, "%s"), header.ms, tag, _line);
+            break;
+        case ESP_LOG_INFO:
+            esp_log_write(ESP_LOG_INFO, tag, LOG_FORMAT(I, "%s"), header.ms, tag, _line);
+            break;
+        case ESP_LOG_DEBUG:
+            esp_log_write(ESP_LOG_DEBUG, tag, LOG_FORMAT(D, "%s"), header.ms, tag, _line);
+            break;
+        default:
+            esp_log_write(ESP_LOG_VERBOSE, tag, LOG_FORMAT(V, "%s"), header.ms, tag, _line);
+            break;
+    }
+}
+#endif
+/**
+ * @brief format and print records as they come, below every other task
+ */
+static void __dlog_task(void *pvParameters)
+{
+    uint32_t reported = 0;
+    while (1)
+    {
+        size_t len = 0;
+        uint8_t *rec = xRingbufferReceive(_ring, &len, portMAX_DELAY);
+        if (rec == NULL) continue;
+        __print(rec, len);
+        vRingbufferReturnItem(_ring, rec);
+
+        uint32_t dropped = __atomic_load_n(&_dropped, __ATOMIC_RELAXED);
+        if (dropped != reported)
+        {
+            ESP_LOGW(TAG, "%u messages dropped, the log ring was full", dropped - reported);
+            reported = dropped;
+        }
+    }
+}
+#endif
+esp_err_t dlog_init(void)
+{
+#ifdef CONFIG_DLOG_ENABLE
+    if (_ring) return ESP_OK;
+    _ring = xRingbufferCreate(CONFIG_DLOG_RING_SIZE, RINGBUF_TYPE_NOSPLIT);
+    if (_ring == NULL) return ESP_ERR_NO_MEM;
+    xTaskCreate(
+        &__dlog_task,   /* Task Function */
+        "dlog task",    /* Name of Task */
+        DLOG_TASK_STACK, /* Stack size of Task */
+        NULL,           /* Parameter of the task */
+        0,              /* Priority of the task, the lowest: formatting never delays sampling nor publishing */
+        NULL);          /* Task handle to keep track of created task */
+#endif
+    return ESP_OK;
+}
+void dlog_stats(dlog_stats_t *stats)
+{
+#ifdef CONFIG_DLOG_ENABLE
+    stats->written = __atomic_load_n(&_written, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&_dropped, __ATOMIC_RELAXED);
+#else
+    stats->written = 0;
+    stats->dropped = 0;
+#endif
+}
+void dlog_benchmark(void)
+{
+    // a reading as the sensor task logs it: an int, a float, a string in RAM and one in flash
+    char device[] = "28ff641e83160389";
+    float temp = 21.5f;
+    dlog_stats_t before, after;
+    dlog_stats(&before);
+
+    int64_t start_us = esp_timer_get_time();
+    for (int i = 0; i < DLOG_BENCHMARK_CALLS; i++)
+        DLOGW(TAG, "benchmark %d: %s %.2f C %s", i, device, temp, "deferred");
+    int64_t deferred_us = esp_timer_get_time() - start_us;
+    dlog_stats(&after);
+
+    start_us = esp_timer_get_time();
+    for (int i = 0; i < DLOG_BENCHMARK_CALLS; i++)
+        ESP_LOGW(TAG, "benchmark %d: %s %.2f C %s", i, device, temp, "direct");
+    int64_t direct_us = esp_timer_get_time() - start_us;
+
+    ESP_LOGW(TAG, "Cost per call over %u calls: DLOGW %u ns (%u dropped), ESP_LOGW %u ns",
+             DLOG_BENCHMARK_CALLS, (uint32_t)(deferred_us * 1000 / DLOG_BENCHMARK_CALLS),
+             after.dropped - before.dropped, (uint32_t)(direct_us * 1000 / DLOG_BENCHMARK_CALLS));
+}
+#endif
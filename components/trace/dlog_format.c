@@ -0,0 +1,197 @@
+/*------------------------------------------------------------*-
+  Deferred LOG records - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Turns a deferred log record back into text. Built into the
+ * firmware for the log task and into tools/dlog_decode, which
+ * reads the format strings from the ELF instead of the flash.
+ *
+ --------------------------------------------------------------*/
+#ifndef __DLOG_FORMAT_C
+#define __DLOG_FORMAT_C
+#include <stdio.h>
+#include <string.h>
+
+#include "dlog_format.h"
+
+// ------ Private constants -----------------------------------
+#define SPEC_LEN             (24)     // one conversion with its flags, width and precision
+#define LENGTH_MODIFIERS     "hljztLq"
+#define STAR_MAX             (1024)   // largest width or precision taken from an argument
+
+typedef struct {
+    const uint8_t *next;
+    const uint8_t *end;
+    uint8_t left;                     // arguments not read yet
+} cursor_t;
+
+typedef struct {
+    uint8_t type;                     // dlog_arg_type_t, DLOG_ARG_END when missing
+    uint64_t u64;
+    double d;
+    const char *str;
+} value_t;
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+static const char _letters[] = "NEWIDV";
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+static uint32_t __u32(const uint8_t *b)
+{
+    uint32_t word;
+    memcpy(&word, b, sizeof(word));   // the ESP32 and the host are both little endian
+    return word;
+}
+/**
+ * @brief read the next argument, a truncated record ends the arguments
+ */
+static void __next(cursor_t *cur, dlog_resolve_t resolve, void *ctx, value_t *value)
+{
+    memset(value, 0, sizeof(*value));
+    if (cur->left == 0 || cur->next >= cur->end) return;
+    uint8_t type = *cur->next;
+    const uint8_t *p = cur->next + 1;
+    size_t room = cur->end - p;
+    switch (type)
+    {
+        case DLOG_ARG_U32:
+        case DLOG_ARG_STR_REF:
+            if (room < 4) return;
+            value->u64 = __u32(p);
+            if (type == DLOG_ARG_STR_REF) value->str = resolve(value->u64, ctx);
+            p += 4;
+            break;
+        case DLOG_ARG_U64:
+        case DLOG_ARG_DOUBLE:
+            if (room < 8) return;
+            memcpy(&value->u64, p, 8);
+            memcpy(&value->d, p, 8);
+            p += 8;
+            break;
+        case DLOG_ARG_STR:
+        {
+            const uint8_t *nul = memchr(p, '\0', room);
+            if (nul == NULL) return;
+            value->str = (const char *)p;
+            p = nul + 1;
+            break;
+        }
+        default:
+            return;
+    }
+    value->type = type;
+    cur->next = p;
+    cur->left--;
+}
+static int __star(cursor_t *cur, dlog_resolve_t resolve, void *ctx)
+{
+    value_t value;
+    __next(cur, resolve, ctx, &value);
+    int star = (value.type == DLOG_ARG_U32 || value.type == DLOG_ARG_U64) ? (int)value.u64 : 0;
+    // a width of a damaged record would not fit a line anyway
+    return (star > STAR_MAX) ? STAR_MAX : (star < -STAR_MAX) ? -STAR_MAX : star;
+}
+bool dlog_header(const uint8_t *rec, size_t len, dlog_header_t *header)
+{
+    if (len < DLOG_HEADER_LEN) return false;
+    header->ms = __u32(rec);
+    header->fmt = __u32(rec + 4);
+    header->tag = __u32(rec + 8);
+    header->level = rec[12];
+    header->argc = rec[13];
+    return true;
+}
+int dlog_format(const uint8_t *rec, size_t len, dlog_resolve_t resolve, void *ctx, char *buf, size_t buf_len)
+{
+    dlog_header_t header;
+    if (buf_len == 0) return 0;
+    if (!dlog_header(rec, len, &header)) return snprintf(buf, buf_len, "?");
+    const char *fmt = resolve(header.fmt, ctx);
+    if (fmt == NULL) return snprintf(buf, buf_len, "? format at 0x%08x", header.fmt);
+
+    cursor_t cur = { .next = rec + DLOG_HEADER_LEN, .end = rec + len, .left = header.argc };
+    size_t n = 0;
+    while (*fmt && n + 1 < buf_len)
+    {
+        if (*fmt != '%')
+        {
+            buf[n++] = *fmt++;
+            continue;
+        }
+        // rebuild one conversion without its length modifier, the value brings its own
+        char spec[SPEC_LEN + 4];
+        size_t s = 0;
+        int star[2], stars = 0;
+        spec[s++] = *fmt++;
+        while (*fmt && strchr(DLOG_CONVERSIONS, *fmt) == NULL)
+        {
+            if (*fmt == '*' && stars < 2) star[stars++] = __star(&cur, resolve, ctx);
+            if (strchr(LENGTH_MODIFIERS, *fmt) == NULL && s < SPEC_LEN) spec[s++] = *fmt;
+            fmt++;
+        }
+        if (*fmt == '\0') break;
+        char conv = *fmt++;
+        if (conv == '%')
+        {
+            buf[n++] = '%';
+            continue;
+        }
+        if (conv == 'n') continue;
+
+        value_t value;
+        __next(&cur, resolve, ctx, &value);
+        char *out = buf + n;
+        size_t room = buf_len - n;
+        int added;
+#define PRINT(value)  ((stars == 0) ? snprintf(out, room, spec, value) :                    \
+                       (stars == 1) ? snprintf(out, room, spec, star[0], value) :           \
+                                      snprintf(out, room, spec, star[0], star[1], value))
+        if (value.type == DLOG_ARG_END || ((conv == 's') != (value.str != NULL)))
+        {
+            added = snprintf(out, room, "?");
+        }
+        else if (conv == 's')
+        {
+            spec[s++] = 's';
+            spec[s] = '\0';
+            added = PRINT(value.str);
+        }
+        else if (conv == 'p')
+        {
+            added = snprintf(out, room, "0x%08x", (uint32_t)value.u64);
+        }
+        else if (strchr("fFeEgGaA", conv))
+        {
+            spec[s++] = conv;
+            spec[s] = '\0';
+            added = PRINT((value.type == DLOG_ARG_DOUBLE) ? value.d : (double)value.u64);
+        }
+        else if (conv != 'c' && (value.type == DLOG_ARG_U64 || value.type == DLOG_ARG_DOUBLE))
+        {
+            spec[s++] = 'l';
+            spec[s++] = 'l';
+            spec[s++] = conv;
+            spec[s] = '\0';
+            added = PRINT((value.type == DLOG_ARG_DOUBLE) ? (long long)value.d : (long long)value.u64);
+        }
+        else
+        {
+            // %d of a negative int was recorded as its 32 bit pattern
+            spec[s++] = conv;
+            spec[s] = '\0';
+            added = PRINT((uint32_t)value.u64);
+        }
+#undef PRINT
+        if (added > 0) n += ((size_t)added < room) ? (size_t)added : room - 1;
+    }
+    buf[n] = '\0';
+    return n;
+}
+char dlog_level_letter(uint8_t level)
+{
+    return (level < sizeof(_letters) - 1) ? _letters[level] : '?';
+}
+#endif
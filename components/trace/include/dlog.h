@@ -0,0 +1,128 @@
+/*------------------------------------------------------------*-
+  Deferred LOG - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Drop-in replacements of ESP_LOG* for the hot paths: the call
+ * only copies the format address and the raw arguments into a
+ * ring, a low priority task formats and prints them later.
+ *
+ --------------------------------------------------------------*/
+#ifndef __DLOG_H
+#define __DLOG_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "dlog_format.h"
+
+// ------ Public constants ------------------------------------
+/**
+ * @brief one argument before it is written into the ring
+ */
+typedef struct {
+    uint8_t type;                     // dlog_arg_type_t
+    union {
+        uint32_t u32;
+        uint64_t u64;
+        double d;
+        const char *str;
+    };
+} dlog_arg_t;
+
+typedef struct {
+    uint32_t written;                 // records put in the ring
+    uint32_t dropped;                 // records lost, the ring was full or not created
+} dlog_stats_t;
+
+static inline dlog_arg_t dlog_arg_u32(uint32_t value)    { dlog_arg_t arg = { .type = DLOG_ARG_U32, .u32 = value }; return arg; }
+static inline dlog_arg_t dlog_arg_u64(uint64_t value)    { dlog_arg_t arg = { .type = DLOG_ARG_U64, .u64 = value }; return arg; }
+static inline dlog_arg_t dlog_arg_double(double value)   { dlog_arg_t arg = { .type = DLOG_ARG_DOUBLE, .d = value }; return arg; }
+static inline dlog_arg_t dlog_arg_str(const char *value) { dlog_arg_t arg = { .type = DLOG_ARG_STR, .str = value }; return arg; }
+static inline dlog_arg_t dlog_arg_ptr(const void *value) { dlog_arg_t arg = { .type = DLOG_ARG_U32, .u32 = (uint32_t)(uintptr_t)value }; return arg; }
+static inline dlog_arg_t dlog_arg_long(unsigned long value) { return (sizeof(value) > 4) ? dlog_arg_u64(value) : dlog_arg_u32(value); }
+
+/**
+ * @brief the type of an argument is picked at compile time, nothing parses the format on the caller
+ */
+#define DLOG_ARG(x)  _Generic((x),                                          \
+        float: dlog_arg_double,              double: dlog_arg_double,       \
+        long: dlog_arg_long,                 unsigned long: dlog_arg_long,  \
+        long long: dlog_arg_u64,             unsigned long long: dlog_arg_u64, \
+        char *: dlog_arg_str,                const char *: dlog_arg_str,    \
+        void *: dlog_arg_ptr,                const void *: dlog_arg_ptr,    \
+        unsigned char *: dlog_arg_ptr,       const unsigned char *: dlog_arg_ptr, \
+        default: dlog_arg_u32)(x),
+
+#define DLOG_CAT_(a, b)     a ## b
+#define DLOG_CAT(a, b)      DLOG_CAT_(a, b)
+#define DLOG_NARG_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...)  n
+#define DLOG_NARG(...)      DLOG_NARG_(_, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_ARGS_0()
+#define DLOG_ARGS_1(a)      DLOG_ARG(a)
+#define DLOG_ARGS_2(a, ...) DLOG_ARG(a) DLOG_ARGS_1(__VA_ARGS__)
+#define DLOG_ARGS_3(a, ...) DLOG_ARG(a) DLOG_ARGS_2(__VA_ARGS__)
+#define DLOG_ARGS_4(a, ...) DLOG_ARG(a) DLOG_ARGS_3(__VA_ARGS__)
+#define DLOG_ARGS_5(a, ...) DLOG_ARG(a) DLOG_ARGS_4(__VA_ARGS__)
+#define DLOG_ARGS_6(a, ...) DLOG_ARG(a) DLOG_ARGS_5(__VA_ARGS__)
+#define DLOG_ARGS_7(a, ...) DLOG_ARG(a) DLOG_ARGS_6(__VA_ARGS__)
+#define DLOG_ARGS_8(a, ...) DLOG_ARG(a) DLOG_ARGS_7(__VA_ARGS__)
+#define DLOG_ARGS(...)      DLOG_CAT(DLOG_ARGS_, DLOG_NARG(__VA_ARGS__))(__VA_ARGS__)
+
+#define DLOG_LEVEL(level, tag, fmt, ...)  do {                                                  \
+        if (LOG_LOCAL_LEVEL >= (level)) {                                                   \
+            const dlog_arg_t _dlog_args[] = { DLOG_ARGS(__VA_ARGS__) { .type = DLOG_ARG_END } }; \
+            dlog_write((level), (tag), (fmt), _dlog_args, sizeof(_dlog_args) / sizeof(_dlog_args[0]) - 1); \
+        } } while (0)
+// ------ Public function prototypes --------------------------
+/**
+ * @note same arguments as ESP_LOG*, at most DLOG_ARGS_MAX of them. The format and
+ *       the tag must be string literals, other strings are copied up to
+ *       CONFIG_DLOG_STR_MAX bytes, or the precision of a "%.*s". Without
+ *       CONFIG_DLOG_ENABLE they are ESP_LOG*
+ */
+#ifdef CONFIG_DLOG_ENABLE
+#define DLOGE(tag, fmt, ...)  DLOG_LEVEL(ESP_LOG_ERROR,   tag, fmt, ##__VA_ARGS__)
+#define DLOGW(tag, fmt, ...)  DLOG_LEVEL(ESP_LOG_WARN,    tag, fmt, ##__VA_ARGS__)
+#define DLOGI(tag, fmt, ...)  DLOG_LEVEL(ESP_LOG_INFO,    tag, fmt, ##__VA_ARGS__)
+#define DLOGD(tag, fmt, ...)  DLOG_LEVEL(ESP_LOG_DEBUG,   tag, fmt, ##__VA_ARGS__)
+#define DLOGV(tag, fmt, ...)  DLOG_LEVEL(ESP_LOG_VERBOSE, tag, fmt, ##__VA_ARGS__)
+#else
+#define DLOGE(tag, fmt, ...)  ESP_LOGE(tag, fmt, ##__VA_ARGS__)
+#define DLOGW(tag, fmt, ...)  ESP_LOGW(tag, fmt, ##__VA_ARGS__)
+#define DLOGI(tag, fmt, ...)  ESP_LOGI(tag, fmt, ##__VA_ARGS__)
+#define DLOGD(tag, fmt, ...)  ESP_LOGD(tag, fmt, ##__VA_ARGS__)
+#define DLOGV(tag, fmt, ...)  ESP_LOGV(tag, fmt, ##__VA_ARGS__)
+#endif
+/**
+ * @brief Create the ring and the log task, before anything logs with DLOG*
+ */
+esp_err_t dlog_init(void);
+/**
+ * @brief Copy one record into the ring, never blocks nor formats
+ * @note use the DLOG* macros. The record is dropped and counted when the ring is full
+ */
+void dlog_write(uint8_t level, const char *tag, const char *fmt, const dlog_arg_t *args, uint8_t argc);
+/**
+ * @brief Records written and dropped since boot
+ */
+void dlog_stats(dlog_stats_t *stats);
+/**
+ * @brief Time DLOGW against ESP_LOGW on the calling task and log the cost per call
+ */
+void dlog_benchmark(void);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
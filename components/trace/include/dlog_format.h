@@ -0,0 +1,83 @@
+/*------------------------------------------------------------*-
+  Deferred LOG records - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Layout of a deferred log record and the formatter that turns
+ * one back into text, on the device or on the host.
+ * This header is also built by the host tool.
+ *
+ --------------------------------------------------------------*/
+#ifndef __DLOG_FORMAT_H
+#define __DLOG_FORMAT_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// ------ Public constants ------------------------------------
+#define DLOG_LINE_PREFIX     "DLOG "
+#define DLOG_HEADER_LEN      (14)
+#define DLOG_ARGS_MAX        (8)      // arguments of one call
+#define DLOG_CONVERSIONS     "diouxXcspfFeEgGaAn%"
+
+/**
+ * @brief type byte in front of each argument of a record
+ */
+typedef enum {
+    DLOG_ARG_END = 0,
+    DLOG_ARG_U32,                     // 4 bytes: every integer up to 32 bits, pointers
+    DLOG_ARG_U64,                     // 8 bytes: long long
+    DLOG_ARG_DOUBLE,                  // 8 bytes: float and double
+    DLOG_ARG_STR_REF,                 // 4 bytes: address of a string in flash
+    DLOG_ARG_STR,                     // the bytes of a string copied from RAM and its terminator
+} dlog_arg_type_t;
+
+/**
+ * @brief header of a record, 14 bytes in little endian, followed by the arguments:
+ *        u32 ms, u32 format address, u32 tag address, u8 level, u8 argument count
+ * @note the format and the tag are string literals, their address is their id:
+ *       the host finds them in the string table of the ELF
+ */
+typedef struct {
+    uint32_t ms;                      // esp_log_timestamp() of the call
+    uint32_t fmt;
+    uint32_t tag;
+    uint8_t level;                    // esp_log_level_t
+    uint8_t argc;
+} dlog_header_t;
+
+/**
+ * @brief find the string at an address of the firmware, NULL if unknown
+ */
+typedef const char *(*dlog_resolve_t)(uint32_t addr, void *ctx);
+// ------ Public function prototypes --------------------------
+/**
+ * @brief Read the header of a record
+ * @return false if the record is shorter than a header
+ */
+bool dlog_header(const uint8_t *rec, size_t len, dlog_header_t *header);
+/**
+ * @brief Format the message of a record, without the level, time and tag prefix
+ * @note the printf conversions are rebuilt from the format one at a time, an
+ *       argument missing or of the wrong kind prints as "?"
+ * @return length of the message, truncated to len - 1
+ */
+int dlog_format(const uint8_t *rec, size_t len, dlog_resolve_t resolve, void *ctx, char *buf, size_t buf_len);
+/**
+ * @brief Letter of a level as printed by ESP_LOG*, 'E' to 'V'
+ */
+char dlog_level_letter(uint8_t level);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,130 @@
+/*------------------------------------------------------------*-
+  Event TRACE - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Begin, end and instant events of the hot paths, stamped with
+ * the CPU cycle counter into one ring per core, without locks.
+ * Dumped as text lines over UART or MQTT, tools/trace2json
+ * turns a dump into a Chrome / Perfetto trace.
+ * This header is also built by the host tool.
+ *
+ --------------------------------------------------------------*/
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// ------ Public constants ------------------------------------
+#define TRACE_LINE_PREFIX    "TRACE "
+#define TRACE_LINE_EVENTS    (7)      // events per dump line, a line fits a default outbox slot
+#define TRACE_LINE_LEN       (sizeof(TRACE_LINE_PREFIX) + TRACE_LINE_EVENTS * sizeof(trace_event_t) * 2)
+
+/**
+ * @brief event ids and their names, shared with the host tool
+ */
+#define TRACE_EVENT_LIST(X)                               \
+    X(TRACE_SYNC,           "sync")                       \
+    X(TRACE_OWB_RESET,      "owb reset")                  \
+    X(TRACE_OWB_WRITE,      "owb write")                  \
+    X(TRACE_OWB_READ,       "owb read")                   \
+    X(TRACE_DS_CONVERT,     "ds18b20 convert")            \
+    X(TRACE_DS_SCRATCHPAD,  "ds18b20 scratchpad")         \
+    X(TRACE_DS_CRC,         "ds18b20 crc error")          \
+    X(TRACE_SENSOR_START,   "sensor start")               \
+    X(TRACE_SENSOR_WAIT,    "sensor conversion wait")     \
+    X(TRACE_SENSOR_READ,    "sensor read")                \
+    X(TRACE_SENSOR_FORMAT,  "sensor format")              \
+    X(TRACE_MQTT_ENQUEUE,   "mqtt enqueue")               \
+    X(TRACE_MQTT_PUBLISH,   "mqtt publish")               \
+    X(TRACE_MQTT_PERSIST,   "mqtt persist")
+
+#define TRACE_ENUM(id, name)  id,
+typedef enum {
+    TRACE_EVENT_LIST(TRACE_ENUM)
+    TRACE_IDS
+} trace_id_t;
+#undef TRACE_ENUM
+
+typedef enum {
+    TRACE_PHASE_BEGIN = 'B',
+    TRACE_PHASE_END = 'E',
+    TRACE_PHASE_MARK = 'i',
+} trace_phase_t;
+
+/**
+ * @brief one event, 12 bytes, dumped as is in little endian
+ * @note TRACE_SYNC carries the low 32 bits of esp_timer_get_time() in arg,
+ *       the host places the events of a core from the sync before them
+ */
+typedef struct {
+    uint32_t ccount;         // CPU cycles of the core that wrote the event
+    uint32_t arg;
+    uint8_t id;              // trace_id_t
+    uint8_t phase;           // trace_phase_t
+    uint8_t mhz;             // CPU clock when the event was written, DFS changes it
+    uint8_t core;
+} trace_event_t;
+
+/**
+ * @brief dump cursor, recording is paused from trace_dump_begin() to trace_dump_end()
+ */
+typedef struct {
+    uint8_t core;
+    uint32_t next;           // next event of the core to dump
+    bool header;             // header line written
+} trace_dump_t;
+// ------ Public function prototypes --------------------------
+#ifdef CONFIG_TRACE_ENABLE
+#define TRACE_BEGIN(id, arg)  trace_event((id), TRACE_PHASE_BEGIN, (arg))
+#define TRACE_END(id, arg)    trace_event((id), TRACE_PHASE_END, (arg))
+#define TRACE_MARK(id, arg)   trace_event((id), TRACE_PHASE_MARK, (arg))
+#else
+#define TRACE_BEGIN(id, arg)  ((void)0)
+#define TRACE_END(id, arg)    ((void)0)
+#define TRACE_MARK(id, arg)   ((void)0)
+#endif
+/**
+ * @brief Record one event in the ring of the current core, the oldest event is overwritten
+ * @note task context only. Use the TRACE_* macros, they compile out without CONFIG_TRACE_ENABLE
+ */
+void trace_event(uint8_t id, uint8_t phase, uint32_t arg);
+/**
+ * @brief Name of an event id, "?" if unknown
+ */
+const char *trace_name(uint8_t id);
+/**
+ * @brief Pause recording and start a dump, oldest events first, one core after the other
+ * @note waits for the writers inside the rings, task context only
+ * @return false if another dump is in progress, its owner ends it
+ */
+bool trace_dump_begin(trace_dump_t *dump);
+/**
+ * @brief Format the next dump line, the first one is a header
+ * @return length of the line, 0 when the dump is over
+ */
+int trace_dump_line(trace_dump_t *dump, char *buf, size_t len);
+/**
+ * @brief Empty the rings and resume recording
+ */
+void trace_dump_end(trace_dump_t *dump);
+/**
+ * @brief Dump every ring on the console and empty them
+ * @return false, and nothing printed, while another dump is in progress
+ */
+bool trace_dump_uart(void);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,164 @@
+/*------------------------------------------------------------*-
+  Event TRACE - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Begin, end and instant events of the hot paths, stamped with
+ * the CPU cycle counter into one ring per core, without locks.
+ * Dumped as text lines over UART or MQTT, tools/trace2json
+ * turns a dump into a Chrome / Perfetto trace.
+ *
+ --------------------------------------------------------------*/
+#ifndef __TRACE_C
+#define __TRACE_C
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp32/rom/ets_sys.h"
+#include "xtensa/hal.h"
+#include "sdkconfig.h"
+
+#include "trace.h"
+
+// ------ Private constants -----------------------------------
+#ifdef CONFIG_TRACE_ENABLE
+#define TRACE_EVENTS         (CONFIG_TRACE_EVENTS)  // per core
+#else
+#define TRACE_EVENTS         (1)
+#endif
+#define TRACE_SYNC_TICKS     (1000 / portTICK_PERIOD_MS)  // far below the 17 s the cycle counter takes to wrap
+_Static_assert((TRACE_EVENTS & (TRACE_EVENTS - 1)) == 0, "TRACE_EVENTS must be a power of two");
+
+typedef struct {
+    uint32_t head;           // events ever reserved, free running
+    uint32_t writers;        // trace_event() calls inside the ring, a dump waits for 0
+    TickType_t sync_tick;
+    bool synced;
+    trace_event_t events[TRACE_EVENTS];
+} trace_ring_t;
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+#define TRACE_NAME(id, name)  name,
+static const char *_names[TRACE_IDS] = { TRACE_EVENT_LIST(TRACE_NAME) };
+#undef TRACE_NAME
+static trace_ring_t _rings[portNUM_PROCESSORS];
+static volatile bool _recording = true;
+static bool _dumping = false;  // one dump at a time, UART or MQTT
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+/**
+ * @brief reserve a slot and fill it
+ * @note called with interrupts masked on this core, so the ring is the one of the core
+ *       the cycle count comes from. The reservation stays atomic for the dump.
+ */
+static void __put(trace_ring_t *ring, uint32_t ccount, uint8_t id, uint8_t phase, uint32_t arg, uint8_t core)
+{
+    uint32_t slot = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+    trace_event_t *event = &ring->events[slot & (TRACE_EVENTS - 1)];
+    event->ccount = ccount;
+    event->arg = arg;
+    event->id = id;
+    event->phase = phase;
+    event->mhz = ets_get_cpu_frequency();
+    event->core = core;
+}
+void trace_event(uint8_t id, uint8_t phase, uint32_t arg)
+{
+    if (!_recording) return;
+    // no preemption nor migration between reading the core and stamping the event,
+    // the mask is restored as it was: the caller may already hold a critical section
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    uint8_t core = xPortGetCoreID();
+    trace_ring_t *ring = &_rings[core];
+    __atomic_fetch_add(&ring->writers, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&_recording, __ATOMIC_SEQ_CST))
+    {
+        TickType_t tick = xTaskGetTickCount();
+        // anchor the cycle counter of this core to esp_timer, at most once a second
+        if (!ring->synced || tick - ring->sync_tick >= TRACE_SYNC_TICKS)
+        {
+            ring->sync_tick = tick;
+            ring->synced = true;
+            uint32_t now_us = (uint32_t)esp_timer_get_time();
+            __put(ring, xthal_get_ccount(), TRACE_SYNC, TRACE_PHASE_MARK, now_us, core);
+        }
+        __put(ring, xthal_get_ccount(), id, phase, arg, core);
+    }
+    __atomic_fetch_sub(&ring->writers, 1, __ATOMIC_RELEASE);
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+const char *trace_name(uint8_t id)
+{
+    return (id < TRACE_IDS) ? _names[id] : "?";
+}
+bool trace_dump_begin(trace_dump_t *dump)
+{
+    if (__atomic_exchange_n(&_dumping, true, __ATOMIC_ACQUIRE)) return false;
+    __atomic_store_n(&_recording, false, __ATOMIC_SEQ_CST);
+    // a writer that saw _recording set finishes its slot. It cannot be preempted,
+    // so only one on the other core can be inside, for a few hundred cycles
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        while (__atomic_load_n(&_rings[core].writers, __ATOMIC_ACQUIRE)) {}
+    }
+    dump->core = 0;
+    dump->header = false;
+    dump->next = (_rings[0].head > TRACE_EVENTS) ? _rings[0].head - TRACE_EVENTS : 0;
+    return true;
+}
+int trace_dump_line(trace_dump_t *dump, char *buf, size_t len)
+{
+    while (dump->core < portNUM_PROCESSORS)
+    {
+        trace_ring_t *ring = &_rings[dump->core];
+        if (!dump->header)
+        {
+            dump->header = true;
+            uint32_t lost = (ring->head > TRACE_EVENTS) ? ring->head - TRACE_EVENTS : 0;
+            return snprintf(buf, len, TRACE_LINE_PREFIX "v1 core %u events %u lost %u",
+                            dump->core, ring->head - lost, lost);
+        }
+        if (dump->next == ring->head)
+        {
+            // next core, its first line is a header again
+            if (++dump->core >= portNUM_PROCESSORS) break;
+            dump->header = false;
+            uint32_t head = _rings[dump->core].head;
+            dump->next = (head > TRACE_EVENTS) ? head - TRACE_EVENTS : 0;
+            continue;
+        }
+        if (len < TRACE_LINE_LEN) return 0;
+        int n = snprintf(buf, len, TRACE_LINE_PREFIX);
+        for (uint8_t e = 0; e < TRACE_LINE_EVENTS && dump->next != ring->head; e++, dump->next++)
+        {
+            const uint8_t *bytes = (const uint8_t *)&ring->events[dump->next & (TRACE_EVENTS - 1)];
+            for (uint8_t b = 0; b < sizeof(trace_event_t); b++) n += sprintf(buf + n, "%02x", bytes[b]);
+        }
+        return n;
+    }
+    return 0;
+}
+void trace_dump_end(trace_dump_t *dump)
+{
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        _rings[core].head = 0;
+        _rings[core].synced = false;
+    }
+    _recording = true;
+    __atomic_store_n(&_dumping, false, __ATOMIC_RELEASE);
+}
+bool trace_dump_uart(void)
+{
+    trace_dump_t dump;
+    char line[TRACE_LINE_LEN];
+    if (!trace_dump_begin(&dump)) return false;  // the MQTT dump is running
+    while (trace_dump_line(&dump, line, sizeof(line)) > 0) printf("%s\n", line);
+    trace_dump_end(&dump);
+    return true;
+}
+#endif
@@ -0,0 +1,33 @@
+/*------------------------------------------------------------*-
+  LOW POWER mode - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Duty cycled operation: wake from deep sleep, take one 1-Wire
+ * sample into the RTC ring, bring the uplink up only when the
+ * plan asks for it, then go back to deep sleep.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __LOWPOWER_H
+#define __LOWPOWER_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ------ Public constants ------------------------------------
+// ------ Public function prototypes --------------------------
+/**
+ * @brief Run one wake cycle and enter deep sleep, never returns
+ * @note replaces the boot graph in app_main, the uplink steps only run on the wakes that flush
+ */
+void lowpower_run(void);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
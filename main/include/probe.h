@@ -0,0 +1,97 @@
+/*------------------------------------------------------------*-
+  Sensor PROBE - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Common interface for every sensor on every bus, and the
+ * earliest-deadline-first scheduler that drives them all
+ * from a single task, so slow conversions overlap each other.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __PROBE_H
+#define __PROBE_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// ------ Public constants ------------------------------------
+#define PROBE_MAX_VALUES     (10)     // values one probe can return per cycle
+
+typedef enum {
+    PROBE_IDLE,                       // waiting for its next release
+    PROBE_CONVERTING                  // conversion started, waiting for the result
+} probe_state_t;
+
+/**
+ * @brief One measured quantity, published as "key:value"
+ */
+typedef struct {
+    const char *key;
+    float value;
+} probe_value_t;
+
+typedef struct probe probe_t;
+
+/**
+ * @brief Driver function table, one per kind of sensor
+ */
+struct probe_driver
+{
+    const char* name;
+    /** start a conversion, false on bus error (the cycle is skipped) */
+    bool (*start)(probe_t *probe);
+    /** fetch the result of the conversion, return the number of values */
+    uint8_t (*read)(probe_t *probe, probe_value_t *values, uint8_t max_values);
+};
+
+/**
+ * @brief A sensor (or a group converting together) with its own timing
+ * @note all times are in ms from the same free running clock, wrap-around safe
+ */
+struct probe
+{
+    const struct probe_driver *driver;
+    void *info;                       // driver specific data
+    bool enabled;
+    uint32_t period_ms;               // time between two conversion starts
+    uint32_t latency_ms;              // time from start to result available
+    probe_state_t state;
+    uint32_t release_ms;              // next conversion start
+    uint32_t ready_ms;                // result available (PROBE_CONVERTING only)
+    uint32_t overruns;                // cycles that started later than their deadline
+};
+// ------ Public function prototypes --------------------------
+/**
+ * @brief Initialise a probe, it stays disabled until probe_schedule()
+ */
+void probe_init(probe_t *probe, const struct probe_driver *driver, void *info,
+                uint32_t period_ms, uint32_t latency_ms);
+/**
+ * @brief (Re)start a probe cycle at now_ms, dropping any conversion in flight
+ */
+void probe_schedule(probe_t *probe, uint32_t now_ms);
+/**
+ * @brief Earliest-deadline-first selection
+ * @return the due probe with the earliest deadline, or NULL if none is due,
+ *         in which case wait_ms is the time until the next event
+ *         (UINT32_MAX when no probe is enabled)
+ */
+probe_t* probe_next(probe_t *const *probes, uint8_t num_probes, uint32_t now_ms, uint32_t *wait_ms);
+/**
+ * @brief Run the due event of a probe: start a conversion or read its result
+ * @return the number of values written, 0 if a conversion was just started
+ */
+uint8_t probe_step(probe_t *probe, uint32_t now_ms, probe_value_t *values, uint8_t max_values);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
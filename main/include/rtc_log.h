@@ -0,0 +1,112 @@
+/*------------------------------------------------------------*-
+  RTC sample LOG - header file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Sample ring kept in RTC slow memory across deep sleep, with
+ * the uplink scheduling and energy accounting of the low power
+ * mode. Pure logic, no ESP-IDF dependency, so it builds on host.
+ * 
+ --------------------------------------------------------------*/
+#ifndef __RTC_LOG_H
+#define __RTC_LOG_H
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// ------ Public constants ------------------------------------
+#ifdef CONFIG_DEEP_SLEEP_RING_SIZE
+#define RTC_LOG_CAPACITY     (CONFIG_DEEP_SLEEP_RING_SIZE)
+#else
+#define RTC_LOG_CAPACITY     (128)
+#endif
+#define RTC_LOG_DEVICES      (10)     // reference values kept for threshold checks
+#define RTC_LOG_MIN_SLEEP_US (100000) // never ask for a shorter sleep than this
+
+/**
+ * @brief One reading, 8 bytes
+ */
+typedef struct {
+    uint32_t time_s;          // RTC time of the reading
+    int16_t centi;            // value in hundredths of a unit
+    uint8_t index;            // device index
+} rtc_record_t;
+
+/**
+ * @brief Uplink plan
+ */
+typedef struct {
+    uint32_t period_ms;       // wake period
+    uint16_t flush_every;     // wakes between two uplinks
+    uint16_t threshold_centi; // change from the last uplinked value that forces an uplink
+} rtc_plan_t;
+
+/**
+ * @brief Supply model used for the energy estimate
+ */
+typedef struct {
+    uint16_t supply_mv;
+    uint16_t active_ma;       // awake, radio off
+    uint16_t radio_ma;        // awake with Wi-Fi/MQTT up
+    uint16_t sleep_ua;        // deep sleep
+} rtc_power_t;
+
+/**
+ * @brief Everything that must survive deep sleep, place it in RTC_DATA_ATTR
+ * @note RTC_DATA_ATTR memory is zeroed on power-on, which is a valid empty log
+ */
+typedef struct {
+    uint16_t head;            // oldest record
+    uint16_t count;
+    uint32_t dropped;         // records overwritten before they were uplinked
+    uint16_t cycles;          // wakes since the last uplink
+    bool tripped;             // threshold crossed since the last uplink
+    uint16_t ref_valid;       // bit per device, reference[] holds an uplinked value
+    int16_t reference[RTC_LOG_DEVICES];
+    uint64_t awake_us;        // accumulated, radio off
+    uint64_t radio_us;        // accumulated, with an uplink
+    uint64_t sleep_us;        // accumulated
+    uint32_t samples;
+    rtc_record_t records[RTC_LOG_CAPACITY];
+} rtc_log_t;
+// ------ Public function prototypes --------------------------
+/**
+ * @brief Append a reading, overwrite the oldest one when full, check the threshold
+ */
+void rtc_log_add(rtc_log_t *log, const rtc_plan_t *plan, const rtc_record_t *record);
+/**
+ * @brief Read the n-th oldest record without removing it
+ */
+bool rtc_log_peek(const rtc_log_t *log, uint16_t n, rtc_record_t *record);
+/**
+ * @brief Remove the n oldest records once they are acknowledged,
+ *        they become the reference for the threshold
+ */
+void rtc_log_drop(rtc_log_t *log, uint16_t n);
+/**
+ * @brief Count one wake and tell whether this one must bring the uplink up
+ */
+bool rtc_log_wake(rtc_log_t *log, const rtc_plan_t *plan);
+/**
+ * @brief Record the cost of this wake and return how long to sleep,
+ *        so that wakes stay one period apart whatever the awake time
+ * @param[in] uplink true if the radio was up during this wake
+ */
+uint64_t rtc_log_sleep_us(rtc_log_t *log, const rtc_plan_t *plan, uint64_t awake_us, bool uplink);
+/**
+ * @brief Average energy per sample since power-on, in millijoules
+ */
+float rtc_log_energy_mj(const rtc_log_t *log, const rtc_power_t *power);
+// ------ Public variable -------------------------------------
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -15,9 +15,25 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
 #include "esp_err.h"
+#include "probe.h"
 
 // ------ Public constants ------------------------------------
+#define SENSOR_ALL_DEVICES   (0xFF)   // device index meaning "every device on the bus"
+
+/**
+ * @brief 1-Wire bus counters, since boot
+ * @note awake time is what the bus forces: APB clock held for a transaction,
+ *       and light sleep held off while parasitic devices convert
+ */
+typedef struct {
+    uint32_t cycles;         // conversions read back
+    uint32_t reads;          // device reads
+    uint32_t errors;         // device reads that failed, CRC errors included
+    uint32_t awake_us_avg;   // per cycle
+    uint32_t awake_us_max;
+} sensor_bus_stats_t;
 // ------ Public function prototypes --------------------------
 /**
  * @brief sensor init function (public)
@@ -28,6 +44,37 @@ esp_err_t sensor_init(void);
  * @brief sensor stop function (public)
  */
 esp_err_t sensor_stop(void);
+/**
+ * @brief Runtime control of the sampler (public)
+ * @note Commands are queued and applied by the sensor task at the next cycle
+ *       boundary, the bus and devices are kept. Never blocks the caller.
+ * @return ESP_OK if queued, ESP_ERR_INVALID_ARG on bad value, ESP_ERR_TIMEOUT if the queue is full
+ */
+esp_err_t sensor_pause(void);
+esp_err_t sensor_resume(void);
+/**
+ * @note with CONFIG_ADAPTIVE_SAMPLING a period pauses adaptation until 0 hands the period back to it
+ */
+esp_err_t sensor_set_period(uint32_t period_ms);
+esp_err_t sensor_set_resolution(uint8_t index, uint8_t bits);
+esp_err_t sensor_rediscover(void);
+/**
+ * @brief Parse a text command (e.g. from CMD_TOPIC) and queue it (public)
+ * @note "pause", "resume", "rediscover", "trace", "period:<ms>",
+ *       "resolution:<bits>", "resolution:<index>:<bits>"
+ * @return ESP_ERR_NOT_SUPPORTED if the command is unknown
+ */
+esp_err_t sensor_command(const char *data, int data_len);
+/**
+ * @brief Convert and read the 1-Wire devices once, without the sensor task (public)
+ * @note blocks for one conversion time, creates the bus on first call
+ * @return the number of values written
+ */
+uint8_t sensor_sample_once(probe_value_t *values, uint8_t max_values);
+/**
+ * @brief Copy the 1-Wire bus counters (public)
+ */
+void sensor_bus_stats(sensor_bus_stats_t *stats);
 // ------ Public variable -------------------------------------
 
 #ifdef __cplusplus
@@ -0,0 +1,150 @@
+/*------------------------------------------------------------*-
+  LOW POWER mode - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Duty cycled operation: wake from deep sleep, take one 1-Wire
+ * sample into the RTC ring, bring the uplink up only when the
+ * plan asks for it, then go back to deep sleep.
+ * 
+ --------------------------------------------------------------*/
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
+#include "esp_attr.h"
+
+#include "lowpower.h"
+#include "rtc_log.h"
+#include "sensor.h"
+#include "mqtt_network.h"
+
+#ifdef CONFIG_DEEP_SLEEP_MODE
+// ------ Private constants -----------------------------------
+#define CONNECT_TIMEOUT_MS   (CONFIG_DEEP_SLEEP_CONNECT_TIMEOUT)
+#define RECORD_MAX_LEN       (48)
+#define UPLINK_STACK         (4096)
+#define NETWORK_STACK        (5120)
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+/** @brief tag used for ESP serial console messages */
+static const char *TAG = "lowpower";
+/** @brief survives deep sleep, zeroed on power-on */
+RTC_DATA_ATTR static rtc_log_t _log;
+static const rtc_plan_t _plan = {
+    .period_ms       = CONFIG_SAMPLE_PERIOD,
+    .flush_every     = CONFIG_DEEP_SLEEP_FLUSH_EVERY,
+    .threshold_centi = CONFIG_DEEP_SLEEP_THRESHOLD,
+};
+static const rtc_power_t _power = {
+    .supply_mv = CONFIG_DEEP_SLEEP_SUPPLY_MV,
+    .active_ma = CONFIG_DEEP_SLEEP_ACTIVE_MA,
+    .radio_ma  = CONFIG_DEEP_SLEEP_RADIO_MA,
+    .sleep_ua  = CONFIG_DEEP_SLEEP_SLEEP_UA,
+};
+/**
+ * @brief the uplink part of the boot graph, only on the wakes that flush
+ * @note NVS is done on the main task before lowpower_run()
+ */
+static const boot_step_t _uplink_graph[] = {
+    // phase         after                                         step              stack          async
+    { BOOT_TLS,      0,                                            &mqtt_prepare,    UPLINK_STACK,  false },
+    { BOOT_NETWORK,  BOOT_BIT(BOOT_NVS),                           &network_connect, NETWORK_STACK, false },
+    { BOOT_MQTT,     BOOT_BIT(BOOT_NETWORK) | BOOT_BIT(BOOT_TLS),  &network_uplink,  UPLINK_STACK,  true  }, // ends on CONNACK
+};
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+/**
+ * @brief device index from the probe key, "temp" is 0, "tempN" is N
+ */
+static uint8_t __key_index(const char *key, uint8_t order)
+{
+    if (strncmp(key, "temp", 4) != 0) return order;
+    return (key[4] == '\0') ? 0 : (uint8_t)atoi(key + 4);
+}
+/**
+ * @brief sample the 1-Wire devices once into the RTC ring
+ */
+static void __sample(void)
+{
+    probe_value_t values[PROBE_MAX_VALUES];
+    uint8_t n = sensor_sample_once(values, PROBE_MAX_VALUES);
+    uint32_t now = (uint32_t)time(NULL);
+
+    for (uint8_t i = 0; i < n; i++)
+    {
+        rtc_record_t record = {
+            .time_s = now,
+            .centi  = (int16_t)lroundf(values[i].value * 100.0f),
+            .index  = __key_index(values[i].key, i),
+        };
+        rtc_log_add(&_log, &_plan, &record);
+    }
+}
+/**
+ * @brief publish the ring and drop what the broker acknowledged
+ * @note records stay in the ring until the broker acknowledged them
+ */
+static void __flush(void)
+{
+    // the network step blocks until an IP, the wait below bounds it
+    if (boot_run(_uplink_graph, sizeof(_uplink_graph) / sizeof(_uplink_graph[0])) != ESP_OK) return;
+    if (!mqtt_wait_connected(CONNECT_TIMEOUT_MS))
+    {
+        ESP_LOGW(TAG, "Broker unreachable, keeping %u records", _log.count);
+        return;
+    }
+
+    uint32_t now = (uint32_t)time(NULL);
+    uint16_t sent = 0;
+    rtc_record_t record;
+    char data[RECORD_MAX_LEN];
+    while (rtc_log_peek(&_log, sent, &record))
+    {
+        // same keys as the sensor task: temp, temp1, temp2...
+        if (record.index == 0) snprintf(data, sizeof(data), "{temp:%.2f,age:%u}",
+                                        record.centi / 100.0f, now - record.time_s);
+        else snprintf(data, sizeof(data), "{temp%u:%.2f,age:%u}",
+                      record.index, record.centi / 100.0f, now - record.time_s);
+        if (mqtt_enqueue(DATA_TOPIC, data, 1, 0) == MQTT_PUB_DROPPED) //topic, data, qos, retain
+        {
+            // outbox full: let it drain, then try once more
+            if (!mqtt_wait_delivered(CONNECT_TIMEOUT_MS) ||
+                mqtt_enqueue(DATA_TOPIC, data, 1, 0) == MQTT_PUB_DROPPED) break;
+        }
+        sent++;
+    }
+    if (!mqtt_wait_delivered(CONNECT_TIMEOUT_MS))
+    {
+        // keep everything, the broker may see duplicates on the next uplink
+        ESP_LOGW(TAG, "Uplink not acknowledged, keeping %u records", _log.count);
+        return;
+    }
+    rtc_log_drop(&_log, sent);
+}
+/**
+ * @brief one wake cycle (public)
+ */
+void lowpower_run(void)
+{
+    __sample();
+    // the radio costs the same whether or not the uplink succeeds
+    bool uplink = rtc_log_wake(&_log, &_plan);
+    if (uplink) __flush();
+
+    uint64_t sleep_us = rtc_log_sleep_us(&_log, &_plan, esp_timer_get_time(), uplink);
+    ESP_LOGW(TAG, "%u records, %u dropped, %.3f mJ/sample, sleeping %u ms",
+             _log.count, _log.dropped, rtc_log_energy_mj(&_log, &_power), (uint32_t)(sleep_us / 1000));
+    esp_sleep_enable_timer_wakeup(sleep_us);
+    esp_deep_sleep_start();
+}
+#endif
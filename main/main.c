@@ -10,65 +10,69 @@
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "nvs_flash.h"
 #include "esp_log.h"
 #include "esp_event.h"
 #include "esp_netif.h"
 
 #include "mqtt_network.h"
+#include "storage.h"
 #include "sensor.h"
+#include "lowpower.h"
+#include "dlog.h"
 // ------ Private constants -----------------------------------
 /**
  * @note config parameters via "idf.py menuconfig
  */
 #define DELAY_MS(...)     {vTaskDelay(__VA_ARGS__/portTICK_RATE_MS);}
+#define BOOT_STACK        (4096)
+#define NETWORK_STACK     (5120)
+#ifdef CONFIG_GATEWAY_CHILD
+#define SENSORS_AFTER     (BOOT_BIT(BOOT_NVS) | BOOT_BIT(BOOT_NETWORK))  // readings are forwarded over the ESP-NOW link
+#else
+#define SENSORS_AFTER     (BOOT_BIT(BOOT_NVS) | BOOT_BIT(BOOT_TLS))      // the first readings go into the outbox
+#endif
 
 // ------ Private function prototypes -------------------------
 
 // ------ Private variables -----------------------------------
 /** @brief tag used for ESP serial console messages */
 // static const char *TAG = "main";
+#ifndef CONFIG_DEEP_SLEEP_MODE
+/**
+ * @brief boot dependency graph: NVS, TLS setup and the network run side by side, discovery
+ *        waits for the settings and the outbox, MQTT starts once both the IP and the CA store are ready
+ */
+static const boot_step_t _boot_graph[] = {
+    // phase         after                                         step              stack          async
+    { BOOT_NVS,      0,                                            &config_init,     BOOT_STACK,    false },
+    { BOOT_SENSORS,  SENSORS_AFTER,                                &sensor_init,     BOOT_STACK,    false },
+    { BOOT_NETWORK,  BOOT_BIT(BOOT_NVS),                           &network_connect, NETWORK_STACK, false },
+#ifndef CONFIG_GATEWAY_CHILD
+    { BOOT_TLS,      0,                                            &mqtt_prepare,    BOOT_STACK,    false },
+    { BOOT_MQTT,     BOOT_BIT(BOOT_NETWORK) | BOOT_BIT(BOOT_TLS),  &network_uplink,  BOOT_STACK,    true  }, // ends on CONNACK
+#endif
+};
+#endif
 
 // ------ PUBLIC variable definitions -------------------------
 
 //--------------------------------------------------------------
 // FUNCTION DEFINITIONS
 //--------------------------------------------------------------
-/**
- * @brief RTOS task that periodically prints the heap memory available.
- * @note Pure debug information, should not be ever started on production code! This is an example on how you can integrate your code with wifi-manager
- */
-// void monitoring_task(void *arg)
-// {
-// 	for(;;){
-// 		ESP_LOGI(TAG, "free heap: %d\n",esp_get_free_heap_size());
-// 		DELAY_MS(1000);
-// 	}
-// }
-
 void app_main(void)
 {
-    // --------Initialize NVS - must have on main task -------
-    esp_err_t ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
-    }
-    ESP_ERROR_CHECK(ret);
-    
-    //------------ monitoring task -----------------
-    //A task on core 2 that monitors free heap memory - should be removed on production
-    // xTaskCreatePinnedToCore(
-    //     &monitoring_task,    /* Task Function */
-    //     "monitoring_task",   /* Name of Task */
-    //     2048,                /* Stack size of Task */
-    //     NULL,                /* Parameter of the task */
-    //     1,                   /* Priority of the task, vary from 0 to N, bigger means higher piority, need to be 0 to be lower than the watchdog*/
-    //     NULL,                /* Task handle to keep track of created task */
-    //     1);                  /* CoreID */
-    
-    ESP_ERROR_CHECK(network_startTask());
-    sensor_init();
+    ESP_ERROR_CHECK(dlog_init());   // before any task logs with DLOG*
+#ifdef CONFIG_DEEP_SLEEP_MODE
+    // one sample per wake, nothing to overlap with the settings
+    boot_begin(BOOT_NVS);
+    ESP_ERROR_CHECK(config_init()); // every stored setting, read from RAM from now on
+    boot_end(BOOT_NVS);
+    lowpower_run();
+#else
+    ESP_ERROR_CHECK(boot_run(_boot_graph, sizeof(_boot_graph) / sizeof(_boot_graph[0])));
+#endif
+    // heap and task stacks: see sysmon, reported on SYS_TOPIC every CONFIG_MQTT_SYS_PERIOD
+
     // for (;;) {
     //     DELAY_MS(1000);
     // }
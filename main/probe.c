@@ -0,0 +1,116 @@
+/*------------------------------------------------------------*-
+  Sensor PROBE - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Common interface for every sensor on every bus, and the
+ * earliest-deadline-first scheduler that drives them all
+ * from a single task, so slow conversions overlap each other.
+ * 
+ * Each probe cycle is a job released at release_ms with an
+ * implicit deadline one period later. A job has two events:
+ * start (at release_ms) and read (at ready_ms). Among the
+ * events that are due, the one whose job has the earliest
+ * deadline runs first. Pure logic, no RTOS dependency.
+ --------------------------------------------------------------*/
+#include <stddef.h>
+
+#include "probe.h"
+
+// ------ Private constants -----------------------------------
+#define TIME_BEFORE(a, b)    ((int32_t)((a) - (b)) < 0)   // wrap-around safe a < b
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+static uint32_t __event_time(const probe_t *probe)
+{
+    return (probe->state == PROBE_CONVERTING) ? probe->ready_ms : probe->release_ms;
+}
+
+static uint32_t __deadline(const probe_t *probe)
+{
+    return probe->release_ms + probe->period_ms;
+}
+
+void probe_init(probe_t *probe, const struct probe_driver *driver, void *info,
+                uint32_t period_ms, uint32_t latency_ms)
+{
+    probe->driver = driver;
+    probe->info = info;
+    probe->enabled = false;
+    probe->period_ms = period_ms;
+    probe->latency_ms = latency_ms;
+    probe->state = PROBE_IDLE;
+    probe->release_ms = 0;
+    probe->ready_ms = 0;
+    probe->overruns = 0;
+}
+
+void probe_schedule(probe_t *probe, uint32_t now_ms)
+{
+    probe->enabled = true;
+    probe->state = PROBE_IDLE;
+    probe->release_ms = now_ms;
+}
+
+probe_t* probe_next(probe_t *const *probes, uint8_t num_probes, uint32_t now_ms, uint32_t *wait_ms)
+{
+    probe_t *next = NULL;
+    bool any = false;
+    uint32_t earliest = 0;
+    for (uint8_t i = 0; i < num_probes; ++i)
+    {
+        probe_t *probe = probes[i];
+        if (probe == NULL || !probe->enabled) continue;
+        uint32_t event = __event_time(probe);
+        if (!TIME_BEFORE(now_ms, event))
+        {
+            // due: keep the earliest deadline
+            if (next == NULL || TIME_BEFORE(__deadline(probe), __deadline(next))) next = probe;
+        }
+        else if (!any || TIME_BEFORE(event, earliest))
+        {
+            earliest = event;
+            any = true;
+        }
+    }
+    if (wait_ms) *wait_ms = next ? 0 : (any ? earliest - now_ms : UINT32_MAX);
+    return next;
+}
+
+/**
+ * @brief move the release to the next period, skip the ones already missed
+ */
+static void __advance(probe_t *probe, uint32_t now_ms)
+{
+    probe->state = PROBE_IDLE;
+    probe->release_ms += probe->period_ms;
+    if (TIME_BEFORE(probe->release_ms, now_ms))
+    {
+        probe->overruns++;
+        probe->release_ms = now_ms;
+    }
+}
+
+uint8_t probe_step(probe_t *probe, uint32_t now_ms, probe_value_t *values, uint8_t max_values)
+{
+    if (probe->state == PROBE_IDLE)
+    {
+        if (probe->driver->start(probe))
+        {
+            probe->state = PROBE_CONVERTING;
+            probe->ready_ms = now_ms + probe->latency_ms;
+        }
+        else
+        {
+            __advance(probe, now_ms);  // bus error, try again next period
+        }
+        return 0;
+    }
+    uint8_t count = probe->driver->read(probe, values, max_values);
+    __advance(probe, now_ms);
+    return count;
+}
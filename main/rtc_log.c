@@ -0,0 +1,100 @@
+/*------------------------------------------------------------*-
+  RTC sample LOG - source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Sample ring kept in RTC slow memory across deep sleep, with
+ * the uplink scheduling and energy accounting of the low power
+ * mode. Pure logic, no ESP-IDF dependency, so it builds on host.
+ * 
+ --------------------------------------------------------------*/
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "rtc_log.h"
+
+// ------ Private constants -----------------------------------
+#define FLUSH_MARGIN         (RTC_LOG_CAPACITY / 8)  // uplink before the ring starts overwriting
+// ------ Private function prototypes -------------------------
+// ------ Private variables -----------------------------------
+// ------ PUBLIC variable definitions -------------------------
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+void rtc_log_add(rtc_log_t *log, const rtc_plan_t *plan, const rtc_record_t *record)
+{
+    if (log->count == RTC_LOG_CAPACITY)
+    {
+        // full: the oldest reading is lost
+        log->head = (log->head + 1) % RTC_LOG_CAPACITY;
+        log->count--;
+        log->dropped++;
+    }
+    log->records[(log->head + log->count) % RTC_LOG_CAPACITY] = *record;
+    log->count++;
+    log->samples++;
+
+    if (record->index < RTC_LOG_DEVICES && (log->ref_valid & (1 << record->index)))
+    {
+        if (abs(record->centi - log->reference[record->index]) >= plan->threshold_centi) log->tripped = true;
+    }
+}
+
+bool rtc_log_peek(const rtc_log_t *log, uint16_t n, rtc_record_t *record)
+{
+    if (n >= log->count) return false;
+    *record = log->records[(log->head + n) % RTC_LOG_CAPACITY];
+    return true;
+}
+
+void rtc_log_drop(rtc_log_t *log, uint16_t n)
+{
+    if (n > log->count) n = log->count;
+    for (uint16_t i = 0; i < n; ++i)
+    {
+        const rtc_record_t *record = &log->records[log->head];
+        if (record->index < RTC_LOG_DEVICES)
+        {
+            log->reference[record->index] = record->centi;
+            log->ref_valid |= (1 << record->index);
+        }
+        log->head = (log->head + 1) % RTC_LOG_CAPACITY;
+    }
+    log->count -= n;
+    if (log->count == 0)
+    {
+        // everything is uplinked, restart the uplink period
+        log->cycles = 0;
+        log->tripped = false;
+    }
+}
+
+bool rtc_log_wake(rtc_log_t *log, const rtc_plan_t *plan)
+{
+    if (log->cycles < UINT16_MAX) log->cycles++;
+    return log->tripped ||
+           log->cycles >= plan->flush_every ||
+           log->count >= RTC_LOG_CAPACITY - FLUSH_MARGIN;
+}
+
+uint64_t rtc_log_sleep_us(rtc_log_t *log, const rtc_plan_t *plan, uint64_t awake_us, bool uplink)
+{
+    if (uplink) log->radio_us += awake_us;
+    else        log->awake_us += awake_us;
+
+    uint64_t period_us = (uint64_t)plan->period_ms * 1000;
+    uint64_t sleep_us = (awake_us + RTC_LOG_MIN_SLEEP_US < period_us) ? period_us - awake_us : RTC_LOG_MIN_SLEEP_US;
+    log->sleep_us += sleep_us;
+    return sleep_us;
+}
+
+float rtc_log_energy_mj(const rtc_log_t *log, const rtc_power_t *power)
+{
+    if (log->samples == 0) return 0;
+    // mA * us = nC, uA * us = pC
+    double charge_uc = (power->active_ma * (double)log->awake_us +
+                        power->radio_ma * (double)log->radio_us) / 1000.0 +
+                       power->sleep_ua * (double)log->sleep_us / 1000000.0;
+    double energy_mj = charge_uc * power->supply_mv / 1000000.0;  // uC * mV = nJ
+    return energy_mj / log->samples;
+}
@@ -9,25 +9,156 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include <stdio.h>
 #include <string.h>
+#include <math.h>
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
 
 #include "sensor.h"
+#include "probe.h"
 #include "temp_sensor.h"
+#include "i2c_sensor.h"
 #include "mqtt_network.h"
+#include "storage.h"
+#include "trace.h"
+#include "dlog.h"
 
 // ------ Private constants -----------------------------------
-#define SECRET_STOPKEY       (74)
 #define ONE_WIRE_GPIO        (CONFIG_ONE_WIRE_GPIO)
 #define MAX_TEMP_SENSORS     (CONFIG_MAX_TEMP_SENSORS)
 #define TEMP_RESOLUTION      (DS18B20_RESOLUTION_12_BIT)
 #define SAMPLE_PERIOD        (CONFIG_SAMPLE_PERIOD)   // ms
+#define MIN_SAMPLE_PERIOD    (1000)                   // ms, same range as menuconfig
+#define MAX_SAMPLE_PERIOD    (10000000)               // ms
+#define DS18B20_T_CONV       (750)                    // ms, conversion time at 12-bit resolution
+#define I2C_PORT             (I2C_NUM_0)
+#define PAYLOAD_MAX_LEN      (PROBE_MAX_VALUES * 16 + 2)
+#define SENSOR_TASK_STACK    (3072 + MQTT_OUTBOX_MSG_LEN)  // mqtt_enqueue() builds an outbox slot on it
+#ifdef CONFIG_ADAPTIVE_SAMPLING
+#define ADAPT_MIN_PERIOD     (CONFIG_ADAPTIVE_MIN_PERIOD)  // ms
+#define ADAPT_MAX_PERIOD     (CONFIG_ADAPTIVE_MAX_PERIOD)  // ms
+#define ADAPT_RATE_FAST      (CONFIG_ADAPTIVE_RATE_THRESHOLD / 100.0f)  // degC/min
+#define ADAPT_RATE_FLAT      (ADAPT_RATE_FAST / 4)         // hysteresis, below this readings are flat
+_Static_assert(ADAPT_MIN_PERIOD >= MIN_SAMPLE_PERIOD, "ADAPTIVE_MIN_PERIOD below the sensor_set_period() floor");
+_Static_assert(ADAPT_MIN_PERIOD <= ADAPT_MAX_PERIOD, "ADAPTIVE_MIN_PERIOD above ADAPTIVE_MAX_PERIOD");
+typedef enum {
+    ADAPT_SLOW,              // flat readings, at the longest period
+    ADAPT_RELAX,             // flat readings, period growing back
+    ADAPT_FAST               // fast change, shortest period and reduced resolution
+} adapt_mode_t;
+#endif
+#define POWER_REPORT_EVERY   (100)    // 1-Wire cycles per power report
+#if CONFIG_POWER_SAVE_MAX
+#define POWER_SAVE_NAME      "max"
+#elif CONFIG_POWER_SAVE_MIN
+#define POWER_SAVE_NAME      "min"
+#else
+#define POWER_SAVE_NAME      "none"
+#endif
+#define CMD_QUEUE_LEN        (8)
+#define CMD_MAX_LEN          (32)
+typedef enum {
+    SENSOR_CMD_STOP,
+    SENSOR_CMD_PAUSE,
+    SENSOR_CMD_RESUME,
+    SENSOR_CMD_PERIOD,
+    SENSOR_CMD_RESOLUTION,
+    SENSOR_CMD_REDISCOVER
+} sensor_cmd_type_t;
+typedef struct {
+    sensor_cmd_type_t type;
+    uint8_t index;           // device index, SENSOR_ALL_DEVICES for every device
+    uint32_t value;          // period in ms or resolution in bits
+} sensor_cmd_t;
 // ------ Private function prototypes -------------------------
+static bool __ds18b20_start(probe_t *probe);
+static uint8_t __ds18b20_read(probe_t *probe, probe_value_t *values, uint8_t max_values);
+#ifdef CONFIG_ENABLE_SHT3X
+static bool __sht3x_start(probe_t *probe);
+static uint8_t __sht3x_read(probe_t *probe, probe_value_t *values, uint8_t max_values);
+#endif
+#ifdef CONFIG_ENABLE_SCD4X
+static bool __scd4x_start(probe_t *probe);
+static uint8_t __scd4x_read(probe_t *probe, probe_value_t *values, uint8_t max_values);
+#endif
+#ifdef CONFIG_ADAPTIVE_SAMPLING
+static void __adapt_pin(probe_t *probe, uint32_t period_ms);
+#endif
 // ------ Private variables -----------------------------------
 /** @brief tag used for ESP serial console messages */
 static const char *TAG = "SENSOR";
-xQueueHandle _sensor_stop_queue;
+xQueueHandle _sensor_cmd_queue;
+/** @note owned by the sensor task, only touched at cycle boundaries */
+static owb_rmt_driver_info _rmt_driver_info;
+static OneWireBus* _owb = NULL;
+static DS18B20_Info* _sensors[MAX_TEMP_SENSORS] = {0};
+static uint8_t _num_devices = 0;
+static DS18B20_RESOLUTION _resolution = TEMP_RESOLUTION;
+static DS18B20_RESOLUTION _target_res[MAX_TEMP_SENSORS];  // applied when the next conversion starts
+static bool _rediscover = false;
+static bool _paused = false;
+static mqtt_pub_status_t _pub_status = MQTT_PUB_ACCEPTED;  // last backpressure signal from the outbox
+#ifdef CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t _apb_lock = NULL;   // RMT timeslots are counted in APB cycles, DFS would stretch them
+static esp_pm_lock_handle_t _feed_lock = NULL;  // the strong pull-up feeds parasitic devices until the read
+#endif
+static sensor_bus_stats_t _bus_stats;
+static uint64_t _awake_us_sum = 0;
+static uint32_t _cycle_awake_us = 0;  // bus time of the cycle in progress
+static int64_t _bus_since_us = 0;
+static int64_t _feed_since_us = 0;    // 0 if the strong pull-up is not held
+/** @brief payload keys, device 0 keeps the historical "temp" */
+static const char* _temp_keys[] = {"temp", "temp1", "temp2", "temp3", "temp4",
+                                   "temp5", "temp6", "temp7", "temp8", "temp9"};
+_Static_assert(sizeof(_temp_keys) / sizeof(_temp_keys[0]) == STORE_ROMS_MAX, "one payload key per cached ROM code");
+static uint8_t _slot_keys[MAX_TEMP_SENSORS];  // payload key of each device slot, its place in the ROM cache
+
+static const struct probe_driver _ds18b20_driver = {
+    .name = "ds18b20",
+    .start = __ds18b20_start,
+    .read = __ds18b20_read,
+};
+static probe_t _ds18b20_probe;
+#ifdef CONFIG_ENABLE_SHT3X
+static const struct probe_driver _sht3x_driver = {
+    .name = "sht3x",
+    .start = __sht3x_start,
+    .read = __sht3x_read,
+};
+static SHT3X_Info _sht3x_info;
+static probe_t _sht3x_probe;
+#endif
+#ifdef CONFIG_ENABLE_SCD4X
+static const struct probe_driver _scd4x_driver = {
+    .name = "scd4x",
+    .start = __scd4x_start,
+    .read = __scd4x_read,
+};
+static SCD4X_Info _scd4x_info;
+static probe_t _scd4x_probe;
+#endif
+/** @brief every probe driven by the sensor task, whatever its bus */
+static probe_t* const _probes[] = {
+    &_ds18b20_probe,
+#ifdef CONFIG_ENABLE_SHT3X
+    &_sht3x_probe,
+#endif
+#ifdef CONFIG_ENABLE_SCD4X
+    &_scd4x_probe,
+#endif
+};
+#define NUM_PROBES           (sizeof(_probes) / sizeof(_probes[0]))
+#ifdef CONFIG_ADAPTIVE_SAMPLING
+static adapt_mode_t _adapt_mode = ADAPT_RELAX;
+static const char* _adapt_names[] = {"slow", "relax", "fast"};
+static float _adapt_last[MAX_TEMP_SENSORS];
+static bool _adapt_valid[MAX_TEMP_SENSORS] = {0};
+static uint32_t _adapt_last_ms = 0;
+static bool _adapt_pinned = false;   // a period was set by hand, adaptation holds off
+#endif
 // ------ PUBLIC variable definitions -------------------------
 //--------------------------------------------------------------
 // FUNCTION DEFINITIONS
@@ -35,211 +166,772 @@ xQueueHandle _sensor_stop_queue;
 /**
  * @brief internal sensor stop function
  */
-static void __stop(OneWireBus* _owb, DS18B20_Info** _sensors, uint8_t num_devices)
+static void __stop(void)
 {
     // clean up dynamically allocated data
-    for (int i = 0; i < num_devices; ++i) ds18b20_free(_sensors+i);
+    for (int i = 0; i < MAX_TEMP_SENSORS; ++i) ds18b20_free(_sensors+i);
     owb_uninitialize(_owb);
+    _num_devices = 0;
     ESP_LOGI(TAG, "Sensor stopped.");
 }
 /**
- * @brief sensor main task
+ * @brief payload key of every device found: its place in the ROM cache, new devices go after the cache
+ * @note a missing device leaves a hole, the devices after it keep their keys.
+ *       The cache is only written when a new device shows up
  */
-static void __sensor_task(void* arg)
+static void __key_by_cache(OneWireBus_ROMCode *found, uint8_t count, uint8_t *keys)
 {
-    while (1)
+    const store_roms_t *cache = &config_get()->roms;
+    uint8_t known = 0;
+    uint8_t next = cache->count;  // first key after the cache
+    bool taken[STORE_ROMS_MAX] = { 0 };
+    for (uint8_t i = 0; i < count; i++)
     {
-        // Create a 1-Wire bus, using the RMT timeslot driver
-        OneWireBus * _owb;
-        owb_rmt_driver_info rmt_driver_info;
-        _owb = owb_rmt_initialize(&rmt_driver_info, ONE_WIRE_GPIO, RMT_CHANNEL_1, RMT_CHANNEL_0);
-        owb_use_crc(_owb, true);  // enable CRC check for ROM code
-
-        /** @warning Stable readings require a brief period before communication */
-        // vTaskDelay(2000.0 / portTICK_PERIOD_MS);
-        // To debug, use 'make menuconfig' to set default Log level to DEBUG, then uncomment:
-        //esp_log_level_set("owb", ESP_LOG_DEBUG);
-        //esp_log_level_set("ds18b20", ESP_LOG_DEBUG);
-        
-        // Find all connected devices
-        ESP_LOGI(TAG, "Finding sensors:");
-        OneWireBus_ROMCode device_rom_codes[MAX_TEMP_SENSORS] = {0};
-        uint8_t num_devices = 0;
-        OneWireBus_SearchState search_state = {0};
-        bool found = false;
-        owb_search_first(_owb, &search_state, &found);
-        while (found)
-        {
-            char rom_code_s[17];
-            owb_string_from_rom_code(search_state.rom_code, rom_code_s, sizeof(rom_code_s));
-            ESP_LOGI(TAG, "  %d : %s", num_devices, rom_code_s);
-            device_rom_codes[num_devices] = search_state.rom_code;
-            ++num_devices;
-            owb_search_next(_owb, &search_state, &found);
-        }
-        ESP_LOGI(TAG, " - Found %d device%s", num_devices, num_devices == 1 ? "" : "s");
-
-        // If a single device is present, then the ROM code is probably
-        // not very interesting, so just print it out. If there are multiple devices,
-        // then it may be useful to check that a specific device is present.
-
-        if (num_devices == 1)
+        keys[i] = STORE_ROMS_MAX;
+        for (uint8_t c = 0; c < cache->count && c < STORE_ROMS_MAX; c++)
         {
-            // For a single device only:
-            OneWireBus_ROMCode rom_code;
-            owb_status status = owb_read_rom(_owb, &rom_code);
-            if (status == OWB_STATUS_OK)
-            {
-                char rom_code_s[OWB_ROM_CODE_STRING_LENGTH];
-                owb_string_from_rom_code(rom_code, rom_code_s, sizeof(rom_code_s));
-                ESP_LOGI(TAG, "Single device %s present", rom_code_s);
-            }
-            else
-            {
-                ESP_LOGE(TAG, "An error occurred reading ROM code: %d", status);
-            }
+            if (taken[c] || memcmp(found[i].bytes, cache->codes[c], sizeof(found[i].bytes)) != 0) continue;
+            keys[i] = c;
+            taken[c] = true;
+            known++;
+            break;
+        }
+    }
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (keys[i] != STORE_ROMS_MAX) continue;
+        if (next < STORE_ROMS_MAX)
+        {
+            keys[i] = next++;
         }
         else
         {
-            // Search for a known ROM code (LSB first):
-            // For example: 0x1502162ca5b2ee28
-            OneWireBus_ROMCode known_device = {
-                .fields.family = { 0x28 },
-                .fields.serial_number = { 0xee, 0xb2, 0xa5, 0x2c, 0x16, 0x02 },
-                .fields.crc = { 0x15 },
-            };
+            // cache full: borrow the key of a missing device, without remembering it
+            uint8_t hole = 0;
+            while (taken[hole]) hole++;
+            keys[i] = hole;
+        }
+        taken[keys[i]] = true;
+    }
+    // slots in key order, so the payload keys come out sorted
+    for (uint8_t i = 1; i < count; i++)
+    {
+        for (uint8_t j = i; j > 0 && keys[j - 1] > keys[j]; j--)
+        {
+            OneWireBus_ROMCode code = found[j];
+            found[j] = found[j - 1];
+            found[j - 1] = code;
+            uint8_t key = keys[j];
+            keys[j] = keys[j - 1];
+            keys[j - 1] = key;
+        }
+    }
+    if (known == count && known == cache->count) return;
+    ESP_LOGW(TAG, "ROM cache: %u known, %u new, %u missing", known, count - known, cache->count - known);
+    if (next == cache->count) return;
+
+    config_store_t *config = config_begin();
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (keys[i] < config->roms.count || keys[i] >= next) continue;
+        memcpy(config->roms.codes[keys[i]], found[i].bytes, sizeof(found[i].bytes));
+    }
+    config->roms.count = next;
+    config_commit();
+}
+/**
+ * @brief search the bus and (re)initialise the device slots in place
+ * @note the bus and the DS18B20_Info allocations are kept, only their content changes
+ */
+static void __discover(void)
+{
+    // Find all connected devices
+    ESP_LOGI(TAG, "Finding sensors:");
+    OneWireBus_ROMCode device_rom_codes[MAX_TEMP_SENSORS] = {0};
+    uint8_t num_devices = 0;
+    OneWireBus_SearchState search_state = {0};
+    bool found = false;
+    owb_search_first(_owb, &search_state, &found);
+    while (found && num_devices < MAX_TEMP_SENSORS)
+    {
+        char rom_code_s[17];
+        owb_string_from_rom_code(search_state.rom_code, rom_code_s, sizeof(rom_code_s));
+        ESP_LOGI(TAG, "  %d : %s", num_devices, rom_code_s);
+        device_rom_codes[num_devices] = search_state.rom_code;
+        ++num_devices;
+        owb_search_next(_owb, &search_state, &found);
+    }
+    ESP_LOGI(TAG, " - Found %d device%s", num_devices, num_devices == 1 ? "" : "s");
+    uint8_t keys[MAX_TEMP_SENSORS];
+    __key_by_cache(device_rom_codes, num_devices, keys);
+
+    // If a single device is present, then the ROM code is probably
+    // not very interesting, so just print it out. If there are multiple devices,
+    // then it may be useful to check that a specific device is present.
+
+    if (num_devices == 1)
+    {
+        // For a single device only:
+        OneWireBus_ROMCode rom_code;
+        owb_status status = owb_read_rom(_owb, &rom_code);
+        if (status == OWB_STATUS_OK)
+        {
             char rom_code_s[OWB_ROM_CODE_STRING_LENGTH];
-            owb_string_from_rom_code(known_device, rom_code_s, sizeof(rom_code_s));
-            bool is_present = false;
-
-            owb_status search_status = owb_verify_rom(_owb, known_device, &is_present);
-            if (search_status == OWB_STATUS_OK)
-            {
-                ESP_LOGI(TAG, "Device %s is %s", rom_code_s, is_present ? "present" : "not present");
-            }
-            else
-            {
-                ESP_LOGE(TAG, "An error occurred searching for known device: %d", search_status);
-            }
-        }
-
-        // Create DS18B20 devices on the 1-Wire bus
-        DS18B20_Info* _sensors[MAX_TEMP_SENSORS] = {0};
-        for (int i = 0; i < num_devices; ++i)
-        {
-            DS18B20_Info* buf_device = ds18b20_malloc();  // heap allocation
-            _sensors[i] = buf_device;
-
-            if (num_devices == 1)
-            {
-                ESP_LOGI(TAG, "Single device optimisations enabled");
-                ds18b20_init_solo(buf_device, _owb);          // only one device on bus
-            }
-            else
-            {
-                ds18b20_init(buf_device, _owb, device_rom_codes[i]); // associate with bus and device
-            }
-            ds18b20_use_crc(buf_device, true);           // enable CRC check on all reads
-            ds18b20_set_resolution(buf_device, TEMP_RESOLUTION);
-        }
-
-        // Check for parasitic-powered devices
-        bool parasitic_power = false;
-        ds18b20_check_for_parasite_power(_owb, &parasitic_power);
-        if (parasitic_power) {
-            ESP_LOGI(TAG, "Parasitic-powered devices detected");
-        }
-        // In parasitic-power mode, devices cannot indicate when conversions are complete,
-        // so waiting for a temperature conversion must be done by waiting a prescribed duration
-        owb_use_parasitic_power(_owb, parasitic_power);
+            owb_string_from_rom_code(rom_code, rom_code_s, sizeof(rom_code_s));
+            ESP_LOGI(TAG, "Single device %s present", rom_code_s);
+        }
+        else
+        {
+            ESP_LOGE(TAG, "An error occurred reading ROM code: %d", status);
+        }
+    }
+    else
+    {
+        // Search for a known ROM code (LSB first):
+        // For example: 0x1502162ca5b2ee28
+        OneWireBus_ROMCode known_device = {
+            .fields.family = { 0x28 },
+            .fields.serial_number = { 0xee, 0xb2, 0xa5, 0x2c, 0x16, 0x02 },
+            .fields.crc = { 0x15 },
+        };
+        char rom_code_s[OWB_ROM_CODE_STRING_LENGTH];
+        owb_string_from_rom_code(known_device, rom_code_s, sizeof(rom_code_s));
+        bool is_present = false;
 
-#ifdef CONFIG_ENABLE_STRONG_PULLUP_GPIO
-        // An external pull-up circuit is used to supply extra current to OneWireBus devices
-        // during temperature conversions.
-        owb_use_strong_pullup_gpio(_owb, CONFIG_STRONG_PULLUP_GPIO);
-#endif
-
-        // Read temperatures more efficiently by starting conversions on all devices at the same time
-        // int errors_count[MAX_TEMP_SENSORS] = {0};
-        if (num_devices > 0)
-        {
-            TickType_t last_wake_time = xTaskGetTickCount();
-            uint8_t stop_signal;
-            while (1)
-            {
-                /** @note signal to delete the task */
-                if(xQueueReceive(_sensor_stop_queue, &stop_signal, 0)) //no waiting, just checking for any news
-                {
-                    if (stop_signal == SECRET_STOPKEY) //if stop signal is the secret code
-                    {
-                        __stop(_owb, _sensors, num_devices);
-                        vTaskDelete(NULL); //delete itself
-                    }
-                }
-                last_wake_time = xTaskGetTickCount();
-
-                ds18b20_convert_all(_owb);
-
-                // In this application all devices use the same resolution,
-                // so use the first device to determine the delay
-                ds18b20_wait_for_conversion(_sensors[0]);
-
-                // Read the results immediately after conversion otherwise it may fail
-                // (using printf before reading may take too long)
-                float readings[MAX_TEMP_SENSORS] = { 0 };
-                DS18B20_ERROR sensor_event[MAX_TEMP_SENSORS] = { 0 };
-
-                for (int i = 0; i < num_devices; ++i) sensor_event[i] = ds18b20_read_temp(_sensors[i], &readings[i]);
-
-                // Print results in a separate loop, after all have been read
-                for (int i = 0; i < num_devices; ++i)
-                {
-                    if (sensor_event[i] == DS18B20_OK)
-                    {
-                        char temp_data[13];
-                        snprintf(temp_data, 13,"{temp:%.2f}", readings[i]);
-                        ESP_LOGI(TAG, "%s", temp_data);
-                        // ESP_LOGI(TAG, " - Temperature %d: %.2f (oC)", i+1, readings[i]);
-                        mqtt_pub(DATA_TOPIC,temp_data,1,0); //topic, data, qos, retain
-                    }
-                }
-
-                vTaskDelayUntil(&last_wake_time, SAMPLE_PERIOD / portTICK_PERIOD_MS);
-            }
+        owb_status search_status = owb_verify_rom(_owb, known_device, &is_present);
+        if (search_status == OWB_STATUS_OK)
+        {
+            ESP_LOGI(TAG, "Device %s is %s", rom_code_s, is_present ? "present" : "not present");
+        }
+        else
+        {
+            ESP_LOGE(TAG, "An error occurred searching for known device: %d", search_status);
+        }
+    }
+
+    // Associate the DS18B20 slots with the devices found on the 1-Wire bus
+    for (int i = 0; i < num_devices; ++i)
+    {
+        if (num_devices == 1)
+        {
+            ESP_LOGI(TAG, "Single device optimisations enabled");
+            ds18b20_init_solo(_sensors[i], _owb);          // only one device on bus
         }
         else
         {
-            ESP_LOGE(TAG, "No DS18B20 devices detected!");
-            __stop(_owb, _sensors, num_devices);
-            vTaskDelay(2000/portTICK_RATE_MS);
+            ds18b20_init(_sensors[i], _owb, device_rom_codes[i]); // associate with bus and device
+        }
+        ds18b20_use_crc(_sensors[i], true);           // enable CRC check on all reads
+        ds18b20_set_resolution(_sensors[i], _resolution);
+        _target_res[i] = _resolution;
+        _slot_keys[i] = keys[i];
+    }
+    _num_devices = num_devices;
+
+    // Check for parasitic-powered devices
+    bool parasitic_power = false;
+    ds18b20_check_for_parasite_power(_owb, &parasitic_power);
+    if (parasitic_power) {
+        ESP_LOGI(TAG, "Parasitic-powered devices detected");
+    }
+    // In parasitic-power mode, devices cannot indicate when conversions are complete,
+    // so waiting for a temperature conversion must be done by waiting a prescribed duration
+    owb_use_parasitic_power(_owb, parasitic_power);
+}
+/**
+ * @brief hold the APB clock for a 1-Wire transaction, the time is charged to the current cycle
+ */
+static void __bus_acquire(void)
+{
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_lock_acquire(_apb_lock);
+#endif
+    _bus_since_us = esp_timer_get_time();
+}
+static void __bus_release(void)
+{
+    _cycle_awake_us += esp_timer_get_time() - _bus_since_us;
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_lock_release(_apb_lock);
+#endif
+}
+/**
+ * @brief keep the chip out of light sleep while parasitic devices convert
+ * @note without parasitic power the bus is idle during a conversion and light sleep is allowed
+ */
+static void __feed_acquire(void)
+{
+    if (!_owb->use_parasitic_power || _feed_since_us) return;
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_lock_acquire(_feed_lock);
+#endif
+    _feed_since_us = esp_timer_get_time();
+}
+static void __feed_release(void)
+{
+    if (!_feed_since_us) return;
+    _cycle_awake_us += esp_timer_get_time() - _feed_since_us;
+    _feed_since_us = 0;
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_lock_release(_feed_lock);
+#endif
+}
+/**
+ * @brief close the accounting of one 1-Wire cycle, report every POWER_REPORT_EVERY cycles
+ */
+static void __cycle_done(uint8_t reads, uint8_t errors)
+{
+    _bus_stats.cycles++;
+    _bus_stats.reads += reads;
+    _bus_stats.errors += errors;
+    _awake_us_sum += _cycle_awake_us;
+    _bus_stats.awake_us_avg = _awake_us_sum / _bus_stats.cycles;
+    if (_cycle_awake_us > _bus_stats.awake_us_max) _bus_stats.awake_us_max = _cycle_awake_us;
+#if defined(CONFIG_TRACE_ENABLE) && CONFIG_TRACE_SLOW_CYCLE
+    if (_cycle_awake_us > CONFIG_TRACE_SLOW_CYCLE)
+    {
+        ESP_LOGW(TAG, "Slow 1-Wire cycle: %u us on the bus, trace follows", _cycle_awake_us);
+        if (!trace_dump_uart()) ESP_LOGW(TAG, "Trace dump already in progress, skipped");
+    }
+#endif
+    _cycle_awake_us = 0;
+    if (_bus_stats.cycles % POWER_REPORT_EVERY) return;
+
+    ESP_LOGW(TAG, "1-Wire, power save %s: awake %u us avg, %u us max per cycle, %u/%u reads failed",
+             POWER_SAVE_NAME, _bus_stats.awake_us_avg, _bus_stats.awake_us_max, _bus_stats.errors, _bus_stats.reads);
+#ifdef CONFIG_PM_PROFILING
+    esp_pm_dump_locks(stdout);  // time spent in each power mode, light sleep included
+#endif
+}
+/**
+ * @brief current time for the probe scheduler
+ */
+static uint32_t __now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+/**
+ * @brief apply one control command - called by the sensor task between two events
+ * @note bus operations are deferred to the start of the next 1-Wire conversion
+ */
+static void __apply_cmd(const sensor_cmd_t* cmd)
+{
+    switch (cmd->type)
+    {
+    case SENSOR_CMD_STOP:
+        __stop();
+        vTaskDelete(NULL); //delete itself
+        break;
+    case SENSOR_CMD_PAUSE:
+        _paused = true;
+        __feed_release(); // the conversion in flight is dropped
+        ESP_LOGW(TAG, "Sampling paused");
+        break;
+    case SENSOR_CMD_RESUME:
+        _paused = false;
+        // restart every live probe from now, conversions in flight are dropped
+        for (int i = 0; i < NUM_PROBES; ++i)
+        {
+            if (_probes[i]->enabled) probe_schedule(_probes[i], __now_ms());
         }
+        ESP_LOGW(TAG, "Sampling resumed");
+        break;
+    case SENSOR_CMD_PERIOD:
+        config_begin()->sample_period = cmd->value;
+        config_commit();
+#ifdef CONFIG_ADAPTIVE_SAMPLING
+        __adapt_pin(&_ds18b20_probe, cmd->value);
+#else
+        _ds18b20_probe.period_ms = cmd->value;
+        ESP_LOGW(TAG, "Sample period set to %u ms", cmd->value);
+#endif
+        break;
+    case SENSOR_CMD_RESOLUTION:
+        if (cmd->index == SENSOR_ALL_DEVICES)
+        {
+            _resolution = cmd->value; // also used after rediscovery, and after a reset
+            config_begin()->resolution = cmd->value;
+            config_commit();
+        }
+        for (int i = 0; i < MAX_TEMP_SENSORS; ++i)
+        {
+            if (cmd->index == SENSOR_ALL_DEVICES || cmd->index == i) _target_res[i] = cmd->value;
+        }
+        ESP_LOGW(TAG, "Resolution of device %d set to %u bits", cmd->index, cmd->value);
+        break;
+    case SENSOR_CMD_REDISCOVER:
+        _rediscover = true;
+        break;
+    default:
+        break;
+    }
+}
+/**
+ * @brief index of the device with the longest conversion time (highest resolution)
+ */
+static uint8_t __slowest_device(void)
+{
+    uint8_t slowest = 0;
+    for (int i = 1; i < _num_devices; ++i)
+    {
+        if (_sensors[i]->resolution > _sensors[slowest]->resolution) slowest = i;
+    }
+    return slowest;
+}
+/**
+ * @brief conversion time at a given resolution
+ */
+static uint32_t __conversion_ms(DS18B20_RESOLUTION res)
+{
+    if (res < DS18B20_RESOLUTION_9_BIT || res > DS18B20_RESOLUTION_12_BIT) res = DS18B20_RESOLUTION_12_BIT;
+    // halved for every bit less, with the same 10% margin as ds18b20_wait_for_conversion()
+    return (DS18B20_T_CONV >> (DS18B20_RESOLUTION_12_BIT - res)) * 11 / 10;
+}
+/**
+ * @brief worst case conversion time of the 1-Wire devices
+ */
+static uint32_t __ds18b20_latency(void)
+{
+    return __conversion_ms(_num_devices ? _sensors[__slowest_device()]->resolution : _resolution);
+}
+#ifdef CONFIG_ADAPTIVE_SAMPLING
+/**
+ * @brief highest resolution whose conversion fits in half of the shortest period
+ */
+static DS18B20_RESOLUTION __fast_resolution(void)
+{
+    DS18B20_RESOLUTION res = DS18B20_RESOLUTION_12_BIT;
+    while (res > DS18B20_RESOLUTION_9_BIT && __conversion_ms(res) > ADAPT_MIN_PERIOD / 2) res--;
+    return res;
+}
+static void __adapt_set_mode(adapt_mode_t mode, uint32_t period_ms)
+{
+    if (mode != _adapt_mode)
+    {
+        ESP_LOGW(TAG, "Adaptive sampling: %s -> %s, period %u ms",
+                 _adapt_names[_adapt_mode], _adapt_names[mode], period_ms);
+        _adapt_mode = mode;
     }
 }
+/**
+ * @brief adapt the 1-Wire period to the fastest rate of change on the bus
+ * @note a change smaller than one LSB of the device resolution is treated as
+ *       quantisation noise, so 9-bit readings in fast mode do not look like a trend
+ */
+static void __adapt(probe_t *probe, const float *readings, const bool *valid)
+{
+    uint32_t now = __now_ms();
+    float dt_min = (now - _adapt_last_ms) / 60000.0f;
+    float rate = 0;  // degC per minute
+    for (int i = 0; i < _num_devices; ++i)
+    {
+        if (valid[i] && _adapt_valid[i] && dt_min > 0)
+        {
+            int bits = (_sensors[i]->resolution < DS18B20_RESOLUTION_9_BIT) ? 9 : _sensors[i]->resolution;
+            float lsb = 1.0f / (1 << (bits - 8));  // 0.0625 at 12 bits
+            float delta = fabsf(readings[i] - _adapt_last[i]) - lsb;
+            if (delta > 0 && delta / dt_min > rate) rate = delta / dt_min;
+        }
+        _adapt_valid[i] = valid[i];
+        if (valid[i]) _adapt_last[i] = readings[i];
+    }
+    _adapt_last_ms = now;
+    if (_adapt_pinned) return;  // readings are still tracked, the rate is fresh when unpinned
+
+    if (rate > ADAPT_RATE_FAST)
+    {
+        probe->period_ms = ADAPT_MIN_PERIOD;
+        __adapt_set_mode(ADAPT_FAST, probe->period_ms);
+    }
+    else if (rate < ADAPT_RATE_FLAT)
+    {
+        // relax by 50% per flat cycle
+        uint32_t period = probe->period_ms + probe->period_ms / 2;
+        probe->period_ms = (period > ADAPT_MAX_PERIOD) ? ADAPT_MAX_PERIOD : period;
+        __adapt_set_mode((probe->period_ms == ADAPT_MAX_PERIOD) ? ADAPT_SLOW : ADAPT_RELAX, probe->period_ms);
+    }
+    // in between, hold the current period
+}
+/**
+ * @brief pin the period set by hand, or hand it back to adaptation with 0
+ */
+static void __adapt_pin(probe_t *probe, uint32_t period_ms)
+{
+    _adapt_pinned = (period_ms != 0);
+    if (_adapt_pinned)
+    {
+        probe->period_ms = period_ms;
+        __adapt_set_mode(ADAPT_RELAX, period_ms);  // back to the configured resolution
+        ESP_LOGW(TAG, "Adaptive sampling paused, period pinned to %u ms", period_ms);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Adaptive sampling resumed from %u ms", probe->period_ms);
+    }
+}
+#endif
+/**
+ * @brief 1-Wire probe: one conversion for every device on the bus
+ * @note this is the cycle boundary of the bus, pending rediscovery and
+ *       resolution changes are applied here
+ */
+static bool __ds18b20_start(probe_t *probe)
+{
+    TRACE_BEGIN(TRACE_SENSOR_START, 0);
+    __feed_release(); // left over from a conversion that was never read
+    __bus_acquire();
+    if (_rediscover || _num_devices == 0)
+    {
+        _rediscover = false;
+        __discover();
+    }
+    if (_num_devices == 0)
+    {
+        __bus_release();
+        _cycle_awake_us = 0;
+        TRACE_END(TRACE_SENSOR_START, 0);
+        ESP_LOGE(TAG, "No DS18B20 devices detected!");
+        return false;
+    }
+    for (int i = 0; i < _num_devices; ++i)
+    {
+        DS18B20_RESOLUTION res = _target_res[i];
+#ifdef CONFIG_ADAPTIVE_SAMPLING
+        // trade resolution for speed while the temperature moves fast
+        if (_adapt_mode == ADAPT_FAST && res > __fast_resolution()) res = __fast_resolution();
+#endif
+        if (_sensors[i]->resolution != res) ds18b20_set_resolution(_sensors[i], res);
+    }
+    probe->latency_ms = __ds18b20_latency();
+    // Read temperatures more efficiently by starting conversions on all devices at the same time
+    ds18b20_convert_all(_owb);
+    __bus_release();
+    __feed_acquire();
+    TRACE_END(TRACE_SENSOR_START, _num_devices);
+    TRACE_BEGIN(TRACE_SENSOR_WAIT, probe->latency_ms);
+    return true;
+}
+static uint8_t __ds18b20_read(probe_t *probe, probe_value_t *values, uint8_t max_values)
+{
+    TRACE_END(TRACE_SENSOR_WAIT, 0);
+    TRACE_BEGIN(TRACE_SENSOR_READ, _num_devices);
+    __bus_acquire();
+    owb_set_strong_pullup(_owb, false);  // conversion is over, stop feeding parasitic devices
+    __feed_release();
+    uint8_t count = 0;
+    uint8_t reads = 0;
+    float readings[MAX_TEMP_SENSORS] = { 0 };
+    bool valid[MAX_TEMP_SENSORS] = { 0 };
+    for (int i = 0; i < _num_devices && count < max_values; ++i)
+    {
+        valid[i] = (ds18b20_read_temp(_sensors[i], &readings[i]) == DS18B20_OK);
+        reads++;
+        if (valid[i])
+        {
+            values[count].key = _temp_keys[_slot_keys[i]];
+            values[count].value = readings[i];
+            ++count;
+        }
+    }
+    __bus_release();
+    TRACE_END(TRACE_SENSOR_READ, reads - count);
+    __cycle_done(reads, reads - count);
+#ifdef CONFIG_ADAPTIVE_SAMPLING
+    __adapt(probe, readings, valid);
+#endif
+    return count;
+}
+#ifdef CONFIG_ENABLE_SHT3X
+/**
+ * @brief I2C humidity probe
+ */
+static bool __sht3x_start(probe_t *probe)
+{
+    return sht3x_start_measurement(probe->info) == ESP_OK;
+}
+static uint8_t __sht3x_read(probe_t *probe, probe_value_t *values, uint8_t max_values)
+{
+    float humidity = 0;
+    if (max_values < 1 || sht3x_read_measurement(probe->info, NULL, &humidity) != ESP_OK) return 0;
+    values[0].key = "hum";
+    values[0].value = humidity;
+    return 1;
+}
+#endif
+#ifdef CONFIG_ENABLE_SCD4X
+/**
+ * @brief I2C NDIR CO2 probe, the bus stays free during its 5 s conversion
+ */
+static bool __scd4x_start(probe_t *probe)
+{
+    return scd4x_start_measurement(probe->info) == ESP_OK;
+}
+static uint8_t __scd4x_read(probe_t *probe, probe_value_t *values, uint8_t max_values)
+{
+    uint16_t co2 = 0;
+    if (max_values < 1 || scd4x_read_measurement(probe->info, &co2, NULL, NULL) != ESP_OK) return 0;
+    values[0].key = "co2";
+    values[0].value = co2;
+    return 1;
+}
+#endif
+/**
+ * @brief publish the values of one probe as a single {key:value,...} message
+ * @note the DS18B20 bus used to send one {temp:..} message per device, it now sends one
+ *       {temp:..,temp1:..} message per cycle: readers must split it on the keys
+ */
+static void __publish(const probe_value_t *values, uint8_t count)
+{
+    char data[PAYLOAD_MAX_LEN];
+    int len = 0;
+    TRACE_BEGIN(TRACE_SENSOR_FORMAT, count);
+    for (int i = 0; i < count; ++i)
+    {
+        len += snprintf(data + len, sizeof(data) - len, "%c%s:%.2f", i ? ',' : '{', values[i].key, values[i].value);
+        if (len >= sizeof(data) - 1)
+        {
+            TRACE_END(TRACE_SENSOR_FORMAT, 0);
+            ESP_LOGE(TAG, "payload too long");
+            return;
+        }
+    }
+    data[len++] = '}';
+    data[len] = '\0';
+    TRACE_END(TRACE_SENSOR_FORMAT, len);
+    DLOGI(TAG, "%s", data);
+#ifdef CONFIG_GATEWAY_CHILD
+    mqtt_pub_status_t status = gateway_forward(data, len);
+#else
+    mqtt_pub_status_t status = mqtt_enqueue_len(DATA_TOPIC, sizeof(DATA_TOPIC) - 1, data, len, 1, 0); //topic, data, qos, retain
+#endif
+    if (status != _pub_status)
+    {
+        if (status == MQTT_PUB_ACCEPTED)      DLOGW(TAG, "Outbox drained");
+        else if (status == MQTT_PUB_DEFERRED) DLOGW(TAG, "Outbox filling up, uplink slower than sampling");
+        else                                  DLOGE(TAG, "Outbox full, dropping samples");
+        _pub_status = status;
+    }
+}
+/**
+ * @brief create the 1-Wire bus and its devices, kept for the lifetime of the firmware
+ */
+static void __bus_init(void)
+{
+    if (config_get()->resolution) _resolution = config_get()->resolution;  // set by a command before the reset
+    // Create a 1-Wire bus, using the RMT timeslot driver
+    _owb = owb_rmt_initialize(&_rmt_driver_info, ONE_WIRE_GPIO, RMT_CHANNEL_1, RMT_CHANNEL_0);
+    owb_use_crc(_owb, true);  // enable CRC check for ROM code
+
+    /** @warning Stable readings require a brief period before communication */
+    // vTaskDelay(2000.0 / portTICK_PERIOD_MS);
+    // To debug, use 'make menuconfig' to set default Log level to DEBUG, then uncomment:
+    //esp_log_level_set("owb", ESP_LOG_DEBUG);
+    //esp_log_level_set("ds18b20", ESP_LOG_DEBUG);
+
+#ifdef CONFIG_PM_ENABLE
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "1-wire", &_apb_lock));
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "1-wire feed", &_feed_lock));
+#endif
+    // Device slots live for the whole task, rediscovery only re-initialises them
+    for (int i = 0; i < MAX_TEMP_SENSORS; ++i) _sensors[i] = ds18b20_malloc();  // heap allocation
+    __bus_acquire();
+    __discover();
+    __bus_release();
+    _cycle_awake_us = 0;  // boot time, not a sampling cycle
+
+#ifdef CONFIG_ENABLE_STRONG_PULLUP_GPIO
+    // An external pull-up circuit is used to supply extra current to OneWireBus devices
+    // during temperature conversions.
+    owb_use_strong_pullup_gpio(_owb, CONFIG_STRONG_PULLUP_GPIO);
+#endif
+    uint32_t period = config_get()->sample_period;
+#ifdef CONFIG_ADAPTIVE_SAMPLING
+    _adapt_pinned = (period != 0);  // a period set by hand before the reset still holds
+#endif
+    probe_init(&_ds18b20_probe, &_ds18b20_driver, NULL, period ? period : SAMPLE_PERIOD, __ds18b20_latency());
+}
+/**
+ * @brief sensor main task
+ * @note every probe, on every bus, is driven from here: the earliest deadline
+ *       runs first and the task sleeps on the command queue in between, so
+ *       a slow conversion never delays the others
+ */
+static void __sensor_task(void* arg)
+{
+    sensor_cmd_t cmd;
+    probe_value_t values[PROBE_MAX_VALUES];
+#ifdef CONFIG_DLOG_BENCHMARK
+    dlog_benchmark();   // on the task whose cost it is
+#endif
+    while (1)
+    {
+        uint32_t wait_ms = UINT32_MAX;
+        uint32_t now = __now_ms();
+        probe_t *probe = _paused ? NULL : probe_next(_probes, NUM_PROBES, now, &wait_ms);
+        if (probe)
+        {
+            // Read the results immediately after conversion otherwise it may fail
+            // (using printf before reading may take too long)
+            uint8_t count = probe_step(probe, now, values, PROBE_MAX_VALUES);
+            if (count) __publish(values, count);
+            continue;
+        }
+        /** @note nothing due - sleep until the next event or a command, whichever comes first */
+        TickType_t wait = (wait_ms == UINT32_MAX) ? portMAX_DELAY :
+                          (wait_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+        if (xQueueReceive(_sensor_cmd_queue, &cmd, wait)) __apply_cmd(&cmd);
+    }
+}
+/**
+ * @brief queue a command for the sensor task, never blocks the caller
+ */
+static esp_err_t __send_cmd(sensor_cmd_type_t type, uint8_t index, uint32_t value)
+{
+    if (_sensor_cmd_queue == NULL) return ESP_ERR_INVALID_STATE;
+    sensor_cmd_t cmd = {
+        .type = type,
+        .index = index,
+        .value = value,
+    };
+    return xQueueSend(_sensor_cmd_queue, &cmd, 0) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+/**
+ * @brief cloud-to-device command handler, runs on the command dispatcher task
+ */
+static void __on_mqtt_cmd(const char *topic, int topic_len, const char *data, int data_len)
+{
+    esp_err_t err = sensor_command(data, data_len);
+    if (err != ESP_OK) ESP_LOGW(TAG, "Command rejected: %.*s", data_len, data);
+}
 /**
  * @brief sensor init function (public)
  * will automatically send data through mqtt protocol
+ * @note bus setup and discovery run on the caller, so the boot graph can time them
+ *       and overlap them with the network. Samples taken before the uplink is up
+ *       wait in the outbox.
  */
 esp_err_t sensor_init(void)
 {
-    _sensor_stop_queue = xQueueCreate(1, sizeof(uint8_t));
+    _sensor_cmd_queue = xQueueCreate(CMD_QUEUE_LEN, sizeof(sensor_cmd_t));
+    command_register(CMD_TOPIC, &__on_mqtt_cmd);
+
+    __bus_init();
+    probe_schedule(&_ds18b20_probe, __now_ms());
+#ifdef CONFIG_ENABLE_I2C_SENSORS
+    i2c_sensor_bus_init(I2C_PORT, CONFIG_I2C_SDA_GPIO, CONFIG_I2C_SCL_GPIO, CONFIG_I2C_CLOCK_HZ);
+#endif
+#ifdef CONFIG_ENABLE_SHT3X
+    probe_init(&_sht3x_probe, &_sht3x_driver, &_sht3x_info, CONFIG_SHT3X_SAMPLE_PERIOD, SHT3X_MEASUREMENT_MS);
+    if (sht3x_init(&_sht3x_info, I2C_PORT, CONFIG_SHT3X_ADDRESS) == ESP_OK) probe_schedule(&_sht3x_probe, __now_ms());
+#endif
+#ifdef CONFIG_ENABLE_SCD4X
+    probe_init(&_scd4x_probe, &_scd4x_driver, &_scd4x_info, CONFIG_SCD4X_SAMPLE_PERIOD, SCD4X_MEASUREMENT_MS);
+    if (scd4x_init(&_scd4x_info, I2C_PORT, SCD4X_I2C_ADDRESS) == ESP_OK) probe_schedule(&_scd4x_probe, __now_ms());
+#endif
     //------------ sensor task -----------------
     xTaskCreate(
         &__sensor_task, /* Task Function */
         "sensor task",  /* Name of Task */
-        2046,           /* Stack size of Task */
+        SENSOR_TASK_STACK, /* Stack size of Task */
         NULL,           /* Parameter of the task */
         1,              /* Priority of the task, vary from 0 to N, bigger means higher piority, need to be 0 to be lower than the watchdog*/
         NULL);          /* Task handle to keep track of created task */
 
     return ESP_OK;
 }
+/**
+ * @brief one blocking 1-Wire conversion without the sensor task (public)
+ * @note used by the deep sleep mode, where every wake takes a single sample
+ */
+uint8_t sensor_sample_once(probe_value_t *values, uint8_t max_values)
+{
+    if (_owb == NULL) __bus_init();
+    if (!__ds18b20_start(&_ds18b20_probe)) return 0;
+    vTaskDelay(_ds18b20_probe.latency_ms / portTICK_PERIOD_MS + 1);
+    return __ds18b20_read(&_ds18b20_probe, values, max_values);
+}
+/**
+ * @brief 1-Wire bus counters (public)
+ * @note written by the sensor task, a copy taken mid-cycle may mix two cycles
+ */
+void sensor_bus_stats(sensor_bus_stats_t *stats)
+{
+    *stats = _bus_stats;
+}
 /**
  * @brief sensor stop function (public)
  */
 esp_err_t sensor_stop(void)
 {
     // send signal for the task to delete itself
-    uint8_t stop_signal = SECRET_STOPKEY;
-    xQueueSend(_sensor_stop_queue, &stop_signal,  portMAX_DELAY);
+    sensor_cmd_t cmd = { .type = SENSOR_CMD_STOP };
+    xQueueSend(_sensor_cmd_queue, &cmd,  portMAX_DELAY);
     return ESP_OK;
 }
+/**
+ * @brief pause sampling at the next cycle boundary (public)
+ */
+esp_err_t sensor_pause(void)
+{
+    return __send_cmd(SENSOR_CMD_PAUSE, SENSOR_ALL_DEVICES, 0);
+}
+/**
+ * @brief resume sampling (public)
+ */
+esp_err_t sensor_resume(void)
+{
+    return __send_cmd(SENSOR_CMD_RESUME, SENSOR_ALL_DEVICES, 0);
+}
+/**
+ * @brief change the sample period (public)
+ */
+esp_err_t sensor_set_period(uint32_t period_ms)
+{
+#ifdef CONFIG_ADAPTIVE_SAMPLING
+    if (period_ms == 0) return __send_cmd(SENSOR_CMD_PERIOD, SENSOR_ALL_DEVICES, 0);  // back to adaptive
+#endif
+    if (period_ms < MIN_SAMPLE_PERIOD || period_ms > MAX_SAMPLE_PERIOD) return ESP_ERR_INVALID_ARG;
+    return __send_cmd(SENSOR_CMD_PERIOD, SENSOR_ALL_DEVICES, period_ms);
+}
+/**
+ * @brief change the resolution of one or all devices (public)
+ */
+esp_err_t sensor_set_resolution(uint8_t index, uint8_t bits)
+{
+    if (bits < DS18B20_RESOLUTION_9_BIT || bits > DS18B20_RESOLUTION_12_BIT) return ESP_ERR_INVALID_ARG;
+    if (index != SENSOR_ALL_DEVICES && index >= MAX_TEMP_SENSORS) return ESP_ERR_INVALID_ARG;
+    return __send_cmd(SENSOR_CMD_RESOLUTION, index, bits);
+}
+/**
+ * @brief search the bus again at the next cycle boundary (public)
+ */
+esp_err_t sensor_rediscover(void)
+{
+    return __send_cmd(SENSOR_CMD_REDISCOVER, SENSOR_ALL_DEVICES, 0);
+}
+/**
+ * @brief parse a text command and forward it to the sensor task (public)
+ * @note accepted: "pause", "resume", "rediscover", "trace", "period:<ms>",
+ *       "resolution:<bits>" and "resolution:<index>:<bits>"
+ */
+esp_err_t sensor_command(const char *data, int data_len)
+{
+    char cmd[CMD_MAX_LEN];
+    if (data == NULL || data_len <= 0 || data_len >= CMD_MAX_LEN) return ESP_ERR_INVALID_ARG;
+    memcpy(cmd, data, data_len);  // mqtt data is not null terminated
+    cmd[data_len] = '\0';
+
+    unsigned int a = 0, b = 0;
+    if (strcmp(cmd, "pause") == 0)            return sensor_pause();
+    if (strcmp(cmd, "resume") == 0)           return sensor_resume();
+    if (strcmp(cmd, "rediscover") == 0)       return sensor_rediscover();
+    if (strcmp(cmd, "trace") == 0)            return mqtt_trace_dump();
+    if (sscanf(cmd, "period:%u", &a) == 1)    return sensor_set_period(a);
+    switch (sscanf(cmd, "resolution:%u:%u", &a, &b))
+    {
+    // range checked before the values are narrowed to uint8_t, 265 must not become 9
+    case 1:  return (a <= UINT8_MAX) ? sensor_set_resolution(SENSOR_ALL_DEVICES, a) : ESP_ERR_INVALID_ARG;
+    case 2:  return (a < SENSOR_ALL_DEVICES && b <= UINT8_MAX) ? sensor_set_resolution(a, b) : ESP_ERR_INVALID_ARG;
+    default: return ESP_ERR_NOT_SUPPORTED;
+    }
+}
@@ -0,0 +1,156 @@
+/*------------------------------------------------------------*-
+  Deferred LOG decoder - host source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Formats the "DLOG" hex lines printed with CONFIG_DLOG_BINARY,
+ * reading the format strings and tags from the ELF of the same
+ * build. Other lines are copied as they are.
+ *
+ * build (host):
+ *   gcc -O2 -I../../components/trace/include dlog_decode.c ../../components/trace/dlog_format.c -o dlog_decode
+ * run:
+ *   ./dlog_decode build/envIoT.elf [console.txt] > console.log
+ *
+ * The ELF must be the one flashed: a record holds the address of
+ * its format, another build moves the strings.
+ *
+ --------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+
+#include "dlog_format.h"
+
+// ------ Private constants -----------------------------------
+#define LINE_MAX_LEN        (8192)
+#define MESSAGE_LEN         (1024)
+
+typedef struct {
+    uint32_t addr;
+    uint32_t size;
+    const char *data;
+} section_t;
+// ------ Private variables -----------------------------------
+static char *_elf = NULL;
+static section_t *_sections = NULL;
+static size_t _section_count = 0;
+static unsigned _decoded = 0, _bad = 0;
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+static int __hex(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+/**
+ * @brief keep every section loaded in the address space of the ESP32
+ */
+static int __load_elf(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    _elf = malloc(size);
+    if (_elf == NULL || fread(_elf, 1, size, f) != (size_t)size)
+    {
+        fprintf(stderr, "%s: cannot read\n", path);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    const Elf32_Ehdr *ehdr = (const Elf32_Ehdr *)_elf;
+    if (size < (long)sizeof(*ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+        ehdr->e_ident[EI_CLASS] != ELFCLASS32 || ehdr->e_ident[EI_DATA] != ELFDATA2LSB)
+    {
+        fprintf(stderr, "%s: not a 32 bit little endian ELF\n", path);
+        return -1;
+    }
+    if (ehdr->e_shoff + (long)ehdr->e_shnum * sizeof(Elf32_Shdr) > (unsigned long)size)
+    {
+        fprintf(stderr, "%s: truncated\n", path);
+        return -1;
+    }
+    const Elf32_Shdr *shdr = (const Elf32_Shdr *)(_elf + ehdr->e_shoff);
+    _sections = calloc(ehdr->e_shnum, sizeof(section_t));
+    for (int i = 0; i < ehdr->e_shnum; i++)
+    {
+        // strings live in flash (.flash.rodata) or in DRAM (.dram0.data)
+        if (shdr[i].sh_type != SHT_PROGBITS || !(shdr[i].sh_flags & SHF_ALLOC)) continue;
+        if (shdr[i].sh_offset + shdr[i].sh_size > (unsigned long)size) continue;
+        section_t *section = &_sections[_section_count++];
+        section->addr = shdr[i].sh_addr;
+        section->size = shdr[i].sh_size;
+        section->data = _elf + shdr[i].sh_offset;
+    }
+    return 0;
+}
+static const char *__resolve(uint32_t addr, void *ctx)
+{
+    (void)ctx;
+    for (size_t i = 0; i < _section_count; i++)
+    {
+        const section_t *section = &_sections[i];
+        if (addr < section->addr || addr - section->addr >= section->size) continue;
+        uint32_t offset = addr - section->addr;
+        // a string cut by the end of its section is not one
+        if (memchr(section->data + offset, '\0', section->size - offset) == NULL) return NULL;
+        return section->data + offset;
+    }
+    return NULL;
+}
+static void __read_line(const char *line)
+{
+    const char *p = strstr(line, DLOG_LINE_PREFIX);
+    if (p == NULL)
+    {
+        fputs(line, stdout);
+        return;
+    }
+    p += strlen(DLOG_LINE_PREFIX);
+    static uint8_t rec[LINE_MAX_LEN / 2];
+    size_t len = 0;
+    for (; __hex(p[0]) >= 0 && __hex(p[1]) >= 0; p += 2) rec[len++] = (uint8_t)(__hex(p[0]) << 4 | __hex(p[1]));
+
+    dlog_header_t header;
+    if (!dlog_header(rec, len, &header))
+    {
+        _bad++;
+        return;
+    }
+    char message[MESSAGE_LEN];
+    dlog_format(rec, len, __resolve, NULL, message, sizeof(message));
+    const char *tag = __resolve(header.tag, NULL);
+    printf("%c (%u) %s: %s\n", dlog_level_letter(header.level), header.ms, tag ? tag : "?", message);
+    _decoded++;
+}
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s firmware.elf [console.txt]\n", argv[0]);
+        return 1;
+    }
+    if (__load_elf(argv[1]) != 0) return 1;
+    FILE *in = stdin;
+    if (argc > 2 && (in = fopen(argv[2], "r")) == NULL)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+    static char line[LINE_MAX_LEN];
+    while (fgets(line, sizeof(line), in)) __read_line(line);
+    if (in != stdin) fclose(in);
+    fprintf(stderr, "%u records decoded, %u too short\n", _decoded, _bad);
+    return 0;
+}
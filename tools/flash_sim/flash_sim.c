@@ -0,0 +1,181 @@
+/*------------------------------------------------------------*-
+  FLASH emulator - host source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Runs the outbox flash ring and the config store write model
+ * of the firmware against a RAM NOR flash, to see the write
+ * amplification and the flash lifetime of a duty cycle in
+ * seconds instead of months.
+ *
+ * build (host):
+ *   gcc -O2 -I../../components/mqtt_network/include flash_sim.c \
+ *       ../../components/mqtt_network/flash_ring.c \
+ *       ../../components/mqtt_network/flash_wear.c -o flash_sim
+ * run:
+ *   ./flash_sim [days] [period_s] [payload] [outage_%] [reconnects/day]
+ *
+ --------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "flash_ring.h"
+#include "flash_wear.h"
+
+// ------ Private constants -----------------------------------
+#define SECTOR_SIZE         (4096)
+#define OUTBOX_SIZE         (64 * 1024)          // "outbox" in partitions.csv
+#define NVS_SECTORS         (0x6000 / SECTOR_SIZE) // "nvs" in partitions.csv
+#define ENDURANCE           (100000)             // CONFIG_FLASH_ENDURANCE
+#define SECONDS_PER_DAY     (86400)
+#define TOPIC               "devices/envIoT/messages/events/"
+#define FAST_CACHE_LEN      (56)                 // sizeof(wifi_fast_t), blob
+#define WEAR_RECORD_LEN     (WEAR_AREAS * 4)     // config_store_t.wear, blob
+#define DATA_MAX            (512)
+// ------ Private variables -----------------------------------
+static uint8_t _flash[OUTBOX_SIZE];
+static uint32_t _sector_erases[OUTBOX_SIZE / SECTOR_SIZE];
+static uint32_t _bit_errors = 0;   // writes that tried to set a bit, a ring bug on real NOR
+static uint32_t _reread_errors = 0;// a replayed record that could not be read again for a retry
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+static bool __read(void *ctx, uint32_t addr, void *buf, uint32_t len)
+{
+    (void)ctx;
+    if (addr + len > OUTBOX_SIZE) return false;
+    memcpy(buf, _flash + addr, len);
+    return true;
+}
+/**
+ * @brief NOR semantics: programming only clears bits
+ */
+static bool __write(void *ctx, uint32_t addr, const void *buf, uint32_t len)
+{
+    (void)ctx;
+    const uint8_t *src = (const uint8_t *)buf;
+    if (addr + len > OUTBOX_SIZE) return false;
+    for (uint32_t i = 0; i < len; i++)
+    {
+        if (src[i] & ~_flash[addr + i]) _bit_errors++;
+        _flash[addr + i] &= src[i];
+    }
+    return true;
+}
+static bool __erase(void *ctx, uint32_t addr)
+{
+    (void)ctx;
+    if (addr % SECTOR_SIZE || addr >= OUTBOX_SIZE) return false;
+    memset(_flash + addr, 0xFF, SECTOR_SIZE);
+    _sector_erases[addr / SECTOR_SIZE]++;
+    return true;
+}
+static const flash_ring_io_t _nor_io = {
+    .read = __read,
+    .write = __write,
+    .erase = __erase,
+    .ctx = NULL,
+    .size = OUTBOX_SIZE,
+    .sector_size = SECTOR_SIZE,
+};
+/**
+ * @brief replay what is pending and acknowledge it, as the publisher does once connected
+ */
+static void __drain(flash_ring_t *ring)
+{
+    static char topic[64], data[DATA_MAX];
+    flash_ring_msg_t msg = {
+        .topic = topic, .topic_size = sizeof(topic),
+        .data = data, .data_size = sizeof(data),
+    };
+    while (flash_ring_peek(ring, &msg))
+    {
+        flash_ring_advance(ring, &msg);
+        // a PUBACK timeout reads the record again past the cursor
+        if (!flash_ring_read(ring, msg.addr, msg.seq, &msg)) _reread_errors++;
+        flash_ring_ack(ring, msg.addr, msg.seq);
+        if (flash_ring_read(ring, msg.addr, msg.seq, &msg)) _reread_errors++;
+    }
+}
+static void __report(const flash_wear_t *wear, uint32_t uptime_s)
+{
+    uint32_t days = flash_wear_days_left(wear, uptime_s);
+    printf("%-7s logical %10llu B, programmed %10llu B, amp x%u.%02u, erases %8u",
+           wear->name, (unsigned long long)wear->logical_bytes,
+           (unsigned long long)wear->programmed_bytes,
+           flash_wear_amp(wear) / 100, flash_wear_amp(wear) % 100, wear->erases);
+    if (days == UINT32_MAX) printf(", lifetime unbounded\n");
+    else printf(", lifetime %.1f years\n", days / 365.0);
+}
+int main(int argc, char *argv[])
+{
+    uint32_t days       = (argc > 1) ? strtoul(argv[1], NULL, 0) : 30;
+    uint32_t period_s   = (argc > 2) ? strtoul(argv[2], NULL, 0) : 10;
+    uint32_t payload    = (argc > 3) ? strtoul(argv[3], NULL, 0) : 120;
+    uint32_t outage_pct = (argc > 4) ? strtoul(argv[4], NULL, 0) : 5;
+    uint32_t reconnects = (argc > 5) ? strtoul(argv[5], NULL, 0) : 4;
+    if (period_s == 0 || payload > DATA_MAX || outage_pct > 100)
+    {
+        fprintf(stderr, "usage: %s [days] [period_s >0] [payload <=%u] [outage_%% <=100] [reconnects/day]\n",
+                argv[0], DATA_MAX);
+        return 1;
+    }
+
+    static char data[DATA_MAX];
+    memset(data, '7', payload);
+    memset(_flash, 0xFF, sizeof(_flash));
+    flash_wear_setup(WEAR_OUTBOX, OUTBOX_SIZE / SECTOR_SIZE, ENDURANCE);
+    flash_wear_setup(WEAR_CONFIG, NVS_SECTORS, ENDURANCE);
+    flash_ring_t ring;
+    if (!flash_ring_mount(&ring, flash_wear_wrap(WEAR_OUTBOX, &_nor_io)))
+    {
+        fprintf(stderr, "mount failed\n");
+        return 1;
+    }
+
+    clock_t started = clock();
+    uint32_t outage_s = SECONDS_PER_DAY / 100 * outage_pct;
+    uint32_t reconnect_every = reconnects ? SECONDS_PER_DAY / reconnects : 0;
+    uint64_t end_s = (uint64_t)days * SECONDS_PER_DAY;
+    for (uint64_t t = 0; t < end_s; t += period_s)
+    {
+        uint32_t of_day = t % SECONDS_PER_DAY;
+        // one outage per day, at its start
+        bool online = of_day >= outage_s;
+
+        flash_ring_msg_t msg = {
+            .flags = 1,
+            .topic = TOPIC, .topic_len = sizeof(TOPIC) - 1,
+            .data = data, .data_len = payload,
+        };
+        if (flash_ring_append(&ring, &msg))
+            flash_wear_logical(WEAR_OUTBOX, msg.topic_len + msg.data_len);
+        if (online) __drain(&ring);
+
+        // a reconnect refreshes the fast connect cache, once a day the wear checkpoint
+        if (reconnect_every && of_day % reconnect_every < period_s)
+            flash_wear_nvs_write(WEAR_CONFIG, FAST_CACHE_LEN, true);
+        if (of_day < period_s)
+            flash_wear_nvs_write(WEAR_CONFIG, WEAR_RECORD_LEN, true);
+    }
+    double took = (double)(clock() - started) / CLOCKS_PER_SEC;
+
+    uint32_t max_erases = 0;
+    uint64_t sum_erases = 0;
+    for (uint32_t i = 0; i < OUTBOX_SIZE / SECTOR_SIZE; i++)
+    {
+        if (_sector_erases[i] > max_erases) max_erases = _sector_erases[i];
+        sum_erases += _sector_erases[i];
+    }
+    uint32_t uptime_s = (end_s > UINT32_MAX) ? UINT32_MAX : (uint32_t)end_s;
+    printf("%u days, a %u B record every %u s, %u%% offline, %u reconnects/day: simulated in %.2f s\n",
+           days, payload, period_s, outage_pct, reconnects, took);
+    printf("ring: %u appended, %u acked, %u lost, %u corrupt, %u bit errors, %u re-read errors\n",
+           ring.appended, ring.acked, ring.lost, ring.corrupt, _bit_errors, _reread_errors);
+    printf("outbox sectors: max %u erases, avg %.1f\n", max_erases,
+           (double)sum_erases / (OUTBOX_SIZE / SECTOR_SIZE));
+    for (uint8_t area = 0; area < WEAR_AREAS; area++) __report(flash_wear(area), uptime_s);
+    return (_bit_errors || _reread_errors) ? 2 : 0;
+}
@@ -0,0 +1,178 @@
+/*------------------------------------------------------------*-
+  Probe scheduler simulator - host source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Drives the earliest-deadline-first scheduler of probe.c the
+ * way the sensor task does, with random periods, latencies,
+ * bus errors and late wake-ups, on a clock that starts just
+ * before the 32 bit wrap. A 64 bit shadow of every probe checks
+ * the deadline order, the wait times and the overrun count.
+ *
+ * build (host):
+ *   gcc -O2 -I../../main/include probe_sim.c ../../main/probe.c -o probe_sim
+ * run:
+ *   ./probe_sim [steps] [probes] [error_%] [late_%]
+ *
+ --------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "probe.h"
+
+// ------ Private constants -----------------------------------
+#define MAX_PROBES          (8)
+#define CLOCK_START_MS      (0xFFFFFFFFu - 60000u)   // wraps a minute into the run
+#define PERIOD_MIN_MS       (1000)
+#define PERIOD_SPAN_MS      (9000)
+#define LATENCY_MAX_MS      (800)
+#define LATE_MAX_MS         (20000)                  // a late wake-up, past any period
+// ------ Private variables -----------------------------------
+/** @brief what probe.c should hold, on a clock that does not wrap */
+typedef struct {
+    uint64_t release_ms;
+    uint64_t ready_ms;
+    uint32_t overruns;
+    uint32_t reads;
+} shadow_t;
+
+static probe_t _probes[MAX_PROBES];
+static probe_t *_table[MAX_PROBES];
+static shadow_t _shadow[MAX_PROBES];
+static unsigned _error_pct = 0;
+static unsigned _errors = 0;
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+static void __check(int ok, unsigned step, const char *what)
+{
+    if (ok) return;
+    if (_errors++ < 10) fprintf(stderr, "step %u: %s\n", step, what);
+}
+static bool __start(probe_t *probe)
+{
+    (void)probe;
+    return (unsigned)(rand() % 100) >= _error_pct;
+}
+static uint8_t __read(probe_t *probe, probe_value_t *values, uint8_t max_values)
+{
+    (void)probe;
+    if (max_values < 1) return 0;
+    values[0].key = "sim";
+    values[0].value = 1.0f;
+    return 1;
+}
+static const struct probe_driver _sim_driver = {
+    .name = "sim",
+    .start = __start,
+    .read = __read,
+};
+static uint64_t __event(unsigned i)
+{
+    return (_probes[i].state == PROBE_CONVERTING) ? _shadow[i].ready_ms : _shadow[i].release_ms;
+}
+static uint64_t __deadline(unsigned i)
+{
+    return _shadow[i].release_ms + _probes[i].period_ms;
+}
+/**
+ * @brief the shadow of probe.c's __advance(), in 64 bit
+ */
+static void __advance(unsigned i, uint64_t now_ms)
+{
+    _shadow[i].release_ms += _probes[i].period_ms;
+    if (_shadow[i].release_ms < now_ms)
+    {
+        _shadow[i].overruns++;
+        _shadow[i].release_ms = now_ms;
+    }
+}
+int main(int argc, char *argv[])
+{
+    unsigned steps    = (argc > 1) ? strtoul(argv[1], NULL, 0) : 200000;
+    unsigned count    = (argc > 2) ? strtoul(argv[2], NULL, 0) : 4;
+    _error_pct        = (argc > 3) ? strtoul(argv[3], NULL, 0) : 5;
+    unsigned late_pct = (argc > 4) ? strtoul(argv[4], NULL, 0) : 2;
+    if (count == 0 || count > MAX_PROBES || _error_pct > 100 || late_pct > 100)
+    {
+        fprintf(stderr, "usage: %s [steps] [probes 1..%u] [error_%% <=100] [late_%% <=100]\n", argv[0], MAX_PROBES);
+        return 1;
+    }
+
+    srand(1);
+    uint64_t now_ms = CLOCK_START_MS;
+    for (unsigned i = 0; i < count; i++)
+    {
+        probe_init(&_probes[i], &_sim_driver, NULL, PERIOD_MIN_MS + rand() % PERIOD_SPAN_MS, rand() % LATENCY_MAX_MS);
+        probe_schedule(&_probes[i], (uint32_t)now_ms);
+        _shadow[i].release_ms = now_ms;
+        _table[i] = &_probes[i];
+    }
+    uint32_t wait_ms;
+    __check(probe_next(_table, 0, (uint32_t)now_ms, &wait_ms) == NULL && wait_ms == UINT32_MAX, 0, "no probe, yet a wait");
+
+    unsigned runs = 0, overruns = 0, wrapped = 0;
+    for (unsigned step = 1; step <= steps; step++)
+    {
+        probe_t *next = probe_next(_table, count, (uint32_t)now_ms, &wait_ms);
+        uint64_t earliest = UINT64_MAX;
+        int best = -1;
+        for (unsigned i = 0; i < count; i++)
+        {
+            __check(_probes[i].release_ms == (uint32_t)_shadow[i].release_ms, step, "release drifted from the shadow");
+            if (__event(i) > now_ms)
+            {
+                if (__event(i) < earliest) earliest = __event(i);
+            }
+            else if (best < 0 || __deadline(i) < __deadline(best))
+            {
+                best = i;
+            }
+        }
+        if (next == NULL)
+        {
+            __check(best < 0, step, "a probe is due, none picked");
+            __check(wait_ms == earliest - now_ms, step, "wait is not the time to the next event");
+            // the task sleeps, sometimes well past the event
+            uint64_t late = ((unsigned)(rand() % 100) < late_pct) ? rand() % LATE_MAX_MS : 0;
+            uint64_t then = now_ms + wait_ms + late;
+            if ((uint32_t)then < (uint32_t)now_ms) wrapped++;
+            now_ms = then;
+            continue;
+        }
+        unsigned i = next - _probes;
+        __check(best >= 0 && __deadline(i) == __deadline(best), step, "not the earliest deadline");
+
+        probe_value_t values[PROBE_MAX_VALUES];
+        bool reading = (next->state == PROBE_CONVERTING);
+        uint8_t n = probe_step(next, (uint32_t)now_ms, values, PROBE_MAX_VALUES);
+        if (reading)
+        {
+            __check(n == 1, step, "read lost its value");
+            _shadow[i].reads++;
+            __advance(i, now_ms);
+        }
+        else if (next->state == PROBE_CONVERTING)
+        {
+            __check(n == 0, step, "start returned values");
+            _shadow[i].ready_ms = now_ms + next->latency_ms;
+            __check(next->ready_ms == (uint32_t)_shadow[i].ready_ms, step, "ready time drifted from the shadow");
+        }
+        else
+        {
+            __advance(i, now_ms);  // bus error
+        }
+        __check(next->overruns == _shadow[i].overruns, step, "overrun not counted, or counted twice");
+        __check(_shadow[i].release_ms >= now_ms || next->state == PROBE_CONVERTING, step, "released in the past");
+        runs++;
+        // the step itself takes a little time
+        now_ms += rand() % 3;
+    }
+
+    for (unsigned i = 0; i < count; i++) overruns += _probes[i].overruns;
+    printf("%u steps, %u probes, %u%% bus errors, %u%% late wake-ups\n", steps, count, _error_pct, late_pct);
+    printf("events run: %u, overruns: %u, clock wrapped %u time(s), %u errors\n", runs, overruns, wrapped, _errors);
+    __check(wrapped > 0 || steps < 1000, steps, "clock never wrapped");
+    return _errors ? 2 : 0;
+}
@@ -0,0 +1,130 @@
+/*------------------------------------------------------------*-
+  RTC log simulator - host source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Runs the deep sleep wake cycle of lowpower.c against the RTC
+ * ring and the uplink plan of rtc_log.c, with a drifting
+ * temperature and a broker that is sometimes unreachable, and
+ * checks the ring, the threshold uplinks and the wake spacing.
+ *
+ * build (host):
+ *   gcc -O2 -I../../main/include rtc_sim.c ../../main/rtc_log.c -o rtc_sim
+ * run:
+ *   ./rtc_sim [wakes] [devices] [outage_%] [flush_every] [threshold_centi]
+ *
+ --------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rtc_log.h"
+
+// ------ Private constants -----------------------------------
+#define PERIOD_MS           (3000)               // CONFIG_SAMPLE_PERIOD
+#define SAMPLE_US           (750000)             // one 12 bit conversion, radio off
+#define UPLINK_US           (2500000)            // Wi-Fi, TLS and the publishes
+#define STEP_EVERY          (97)                 // wakes between two temperature steps
+#define STEP_CENTI          (150)                // size of a step
+// ------ Private variables -----------------------------------
+static rtc_log_t _log;                           // zeroed, as RTC memory on power-on
+static unsigned _errors = 0;
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+static void __check(int ok, unsigned wake, const char *what)
+{
+    if (ok) return;
+    if (_errors++ < 10) fprintf(stderr, "wake %u: %s\n", wake, what);
+}
+/**
+ * @brief records come out oldest first and the ring accounts for every sample
+ */
+static void __check_ring(unsigned wake, uint32_t acked)
+{
+    rtc_record_t prev, record;
+    for (uint16_t n = 0; rtc_log_peek(&_log, n, &record); n++)
+    {
+        if (n) __check(record.time_s >= prev.time_s, wake, "ring out of order");
+        prev = record;
+    }
+    __check(!rtc_log_peek(&_log, _log.count, &record), wake, "peek past the end");
+    __check(_log.count <= RTC_LOG_CAPACITY, wake, "ring over capacity");
+    __check(_log.samples == acked + _log.dropped + _log.count, wake, "samples lost without being counted");
+}
+int main(int argc, char *argv[])
+{
+    unsigned wakes      = (argc > 1) ? strtoul(argv[1], NULL, 0) : 100000;
+    unsigned devices    = (argc > 2) ? strtoul(argv[2], NULL, 0) : 3;
+    unsigned outage_pct = (argc > 3) ? strtoul(argv[3], NULL, 0) : 10;
+    rtc_plan_t plan = {
+        .period_ms       = PERIOD_MS,
+        .flush_every     = (argc > 4) ? strtoul(argv[4], NULL, 0) : 10,
+        .threshold_centi = (argc > 5) ? strtoul(argv[5], NULL, 0) : 100,
+    };
+    if (devices == 0 || devices > RTC_LOG_DEVICES || outage_pct > 100 || plan.flush_every == 0)
+    {
+        fprintf(stderr, "usage: %s [wakes] [devices 1..%u] [outage_%% <=100] [flush_every >0] [threshold_centi]\n",
+                argv[0], RTC_LOG_DEVICES);
+        return 1;
+    }
+    const rtc_power_t power = { .supply_mv = 3300, .active_ma = 30, .radio_ma = 120, .sleep_ua = 10 };
+
+    srand(1);
+    int16_t centi[RTC_LOG_DEVICES];
+    for (unsigned d = 0; d < devices; d++) centi[d] = 2000 + 100 * d;
+    uint32_t now_s = 0, acked = 0;
+    unsigned uplinks = 0, failed = 0, tripped = 0, since_uplink = 0;
+    for (unsigned wake = 1; wake <= wakes; wake++)
+    {
+        // slow drift, and now and then a step the threshold must catch
+        bool step = (wake % STEP_EVERY) == 0;
+        for (unsigned d = 0; d < devices; d++)
+        {
+            centi[d] += (rand() % 3) - 1;
+            if (step) centi[d] += STEP_CENTI;
+            rtc_record_t record = { .time_s = now_s, .centi = centi[d], .index = d };
+            rtc_log_add(&_log, &plan, &record);
+        }
+        bool must_trip = step && (_log.ref_valid & 1) && STEP_CENTI >= plan.threshold_centi;
+
+        bool uplink = rtc_log_wake(&_log, &plan);
+        __check(uplink || !must_trip, wake, "threshold crossed without an uplink");
+        __check(uplink || since_uplink + 1 < plan.flush_every, wake, "no uplink after flush_every wakes");
+        since_uplink = uplink ? 0 : since_uplink + 1;
+        if (uplink)
+        {
+            uplinks++;
+            if (_log.tripped) tripped++;
+            if ((unsigned)(rand() % 100) < outage_pct)
+            {
+                failed++;
+            }
+            else
+            {
+                // what __flush() publishes, then drops once acknowledged
+                uint16_t sent = 0;
+                rtc_record_t record;
+                while (rtc_log_peek(&_log, sent, &record)) sent++;
+                rtc_log_drop(&_log, sent);
+                acked += sent;
+                __check(_log.count == 0 && !_log.tripped && _log.cycles == 0, wake, "uplink left state behind");
+            }
+        }
+        __check_ring(wake, acked);
+
+        uint64_t awake_us = SAMPLE_US + (uplink ? UPLINK_US : 0);
+        uint64_t sleep_us = rtc_log_sleep_us(&_log, &plan, awake_us, uplink);
+        __check(sleep_us >= RTC_LOG_MIN_SLEEP_US, wake, "sleep shorter than the minimum");
+        if (awake_us + RTC_LOG_MIN_SLEEP_US < (uint64_t)plan.period_ms * 1000)
+            __check(awake_us + sleep_us == (uint64_t)plan.period_ms * 1000, wake, "wakes drift from the period");
+        now_s += (uint32_t)((awake_us + sleep_us) / 1000000);
+    }
+
+    printf("%u wakes, %u devices, %u%% of uplinks failing, flush every %u, threshold %u centi\n",
+           wakes, devices, outage_pct, plan.flush_every, plan.threshold_centi);
+    printf("uplinks: %u (%u by threshold, %u failed), records: %u acked, %u dropped, %u pending\n",
+           uplinks, tripped, failed, acked, _log.dropped, _log.count);
+    printf("energy: %.3f mJ/sample, %u errors\n", rtc_log_energy_mj(&_log, &power), _errors);
+    return _errors ? 2 : 0;
+}
@@ -0,0 +1,238 @@
+/*------------------------------------------------------------*-
+  TRACE to JSON - host source file
+  (c) Minh-An Dao 2020
+  version 1.00 - 19/10/2026
+---------------------------------------------------------------
+ * Converts an event trace dump, from the console or from the
+ * "type=trace" MQTT messages, into the Chrome trace format.
+ * Open the result in chrome://tracing or ui.perfetto.dev.
+ *
+ * build (host):
+ *   gcc -O2 -I../../components/trace/include trace2json.c -o trace2json
+ * run:
+ *   ./trace2json [dump.txt] > trace.json
+ *
+ * Every line holding "TRACE " is read, anything before it (log
+ * prefix, MQTT topic) is ignored. The events of a core are placed
+ * from the last sync event before them, events older than the
+ * first sync left in a ring are dropped.
+ *
+ --------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+// ------ Private constants -----------------------------------
+#define LINE_MAX_LEN        (1024)
+#define CORES               (2)
+#define OPEN_MAX            (16)      // nested begins per event id and core
+
+typedef struct {
+    double ts_us;
+    size_t seq;               // order in the dump, breaks ties
+    uint32_t arg;
+    uint8_t id;
+    uint8_t phase;
+    uint8_t core;
+} event_t;
+
+typedef struct {
+    int synced;
+    uint32_t ccount;          // of the last event placed
+    double us;                // time of the last event placed
+} core_clock_t;
+// ------ Private variables -----------------------------------
+#define TRACE_NAME(id, name)  name,
+static const char *_names[TRACE_IDS] = { TRACE_EVENT_LIST(TRACE_NAME) };
+#undef TRACE_NAME
+static event_t *_events = NULL;
+static size_t _count = 0, _size = 0;
+static core_clock_t _clocks[CORES];
+static int _have_base = 0;
+static uint32_t _base_us = 0;        // first sync seen, every sync is unwrapped around it
+static unsigned _dropped = 0;
+//--------------------------------------------------------------
+// FUNCTION DEFINITIONS
+//--------------------------------------------------------------
+static const char *__name(uint8_t id)
+{
+    return (id < TRACE_IDS) ? _names[id] : "?";
+}
+static int __hex(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+static uint32_t __le32(const uint8_t *b)
+{
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+static void __push(const event_t *event)
+{
+    if (_count == _size)
+    {
+        _size = _size ? _size * 2 : 1024;
+        _events = realloc(_events, _size * sizeof(event_t));
+        if (_events == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    _events[_count++] = *event;
+}
+/**
+ * @brief place one raw event on the time line of its core
+ */
+static void __place(const trace_event_t *raw)
+{
+    if (raw->core >= CORES || raw->mhz == 0)
+    {
+        _dropped++;
+        return;
+    }
+    core_clock_t *clock = &_clocks[raw->core];
+    if (raw->id == TRACE_SYNC)
+    {
+        if (!_have_base)
+        {
+            _have_base = 1;
+            _base_us = raw->arg;
+        }
+        // esp_timer is shared by the cores, it wraps every 71 minutes
+        clock->us = (double)(int32_t)(raw->arg - _base_us);
+        clock->ccount = raw->ccount;
+        clock->synced = 1;
+        return;
+    }
+    if (!clock->synced)
+    {
+        _dropped++;
+        return;
+    }
+    // a sync at least every second keeps the delta far from a wrap of the cycle counter
+    clock->us += (double)(uint32_t)(raw->ccount - clock->ccount) / raw->mhz;
+    clock->ccount = raw->ccount;
+    event_t event = {
+        .ts_us = clock->us,
+        .seq = _count,
+        .arg = raw->arg,
+        .id = raw->id,
+        .phase = raw->phase,
+        .core = raw->core,
+    };
+    __push(&event);
+}
+static void __read_line(const char *line)
+{
+    const char *p = strstr(line, TRACE_LINE_PREFIX);
+    if (p == NULL) return;
+    p += strlen(TRACE_LINE_PREFIX);
+    if (strncmp(p, "v1 core ", 8) == 0)
+    {
+        // a new ring: its first events come before the last ones of the previous dump
+        unsigned core = strtoul(p + 8, NULL, 10);
+        if (core < CORES) _clocks[core].synced = 0;
+        return;
+    }
+    uint8_t bytes[sizeof(trace_event_t)];
+    size_t n = 0;
+    for (; __hex(p[0]) >= 0 && __hex(p[1]) >= 0; p += 2)
+    {
+        bytes[n++] = (uint8_t)(__hex(p[0]) << 4 | __hex(p[1]));
+        if (n < sizeof(bytes)) continue;
+        n = 0;
+        trace_event_t raw = {
+            .ccount = __le32(bytes),
+            .arg = __le32(bytes + 4),
+            .id = bytes[8],
+            .phase = bytes[9],
+            .mhz = bytes[10],
+            .core = bytes[11],
+        };
+        __place(&raw);
+    }
+}
+static int __by_time(const void *a, const void *b)
+{
+    const event_t *x = a, *y = b;
+    if (x->ts_us < y->ts_us) return -1;
+    if (x->ts_us > y->ts_us) return 1;
+    return (x->seq < y->seq) ? -1 : (x->seq > y->seq);
+}
+/**
+ * @brief pair begins and ends into complete events
+ * @note an end closes the last begin of the same id on its core, or on the
+ *       other core for a task that moved in between
+ */
+static void __write_json(FILE *out)
+{
+    static size_t open[TRACE_IDS][CORES][OPEN_MAX];
+    static uint8_t depth[TRACE_IDS][CORES];
+    unsigned unmatched = 0;
+    const char *sep = "";
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (int core = 0; core < CORES; core++)
+    {
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"core %d\"}}",
+                sep, core, core);
+        sep = ",\n";
+    }
+    for (size_t i = 0; i < _count; i++)
+    {
+        const event_t *event = &_events[i];
+        if (event->id >= TRACE_IDS) continue;
+        if (event->phase == TRACE_PHASE_BEGIN)
+        {
+            uint8_t *d = &depth[event->id][event->core];
+            if (*d < OPEN_MAX) open[event->id][event->core][(*d)++] = i;
+            else unmatched++;
+        }
+        else if (event->phase == TRACE_PHASE_END)
+        {
+            int core = event->core;
+            if (depth[event->id][core] == 0) core = !core;
+            if (depth[event->id][core] == 0)
+            {
+                unmatched++;
+                continue;
+            }
+            const event_t *begin = &_events[open[event->id][core][--depth[event->id][core]]];
+            fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"envIoT\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"pid\":0,\"tid\":%d,\"args\":{\"begin\":%u,\"end\":%u}}",
+                    sep, __name(event->id), begin->ts_us, event->ts_us - begin->ts_us,
+                    begin->core, begin->arg, event->arg);
+        }
+        else
+        {
+            fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"envIoT\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+                    "\"pid\":0,\"tid\":%d,\"args\":{\"arg\":%u}}",
+                    sep, __name(event->id), event->ts_us, event->core, event->arg);
+        }
+    }
+    fprintf(out, "\n]}\n");
+    for (int id = 0; id < TRACE_IDS; id++)
+        for (int core = 0; core < CORES; core++) unmatched += depth[id][core];
+    fprintf(stderr, "%zu events, %u before the first sync of their ring, %u begin or end without a pair\n",
+            _count, _dropped, unmatched);
+}
+int main(int argc, char *argv[])
+{
+    FILE *in = stdin;
+    if (argc > 1 && (in = fopen(argv[1], "r")) == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    char line[LINE_MAX_LEN];
+    while (fgets(line, sizeof(line), in)) __read_line(line);
+    if (in != stdin) fclose(in);
+
+    qsort(_events, _count, sizeof(event_t), __by_time);
+    __write_json(stdout);
+    return 0;
+}